@@ -0,0 +1,16 @@
+# Copyright Contributors to the Open Shading Language project.
+# SPDX-License-Identifier: BSD-3-Clause
+# https://github.com/AcademySoftwareFoundation/OpenShadingLanguage/
+
+# Concatenate the Artic std library into one prelude file, in the order
+# given.  Run as a script by artic_add_library() in src/shaders/CMakeLists.txt:
+#   cmake -DOUTPUT=prelude.art "-DINPUTS=a.art|b.art|..." -P artic_prelude.cmake
+# (the inputs are separated by '|', since ';' doesn't survive a COMMAND).
+
+string (REPLACE "|" ";" _inputs "${INPUTS}")
+file (WRITE "${OUTPUT}" "")
+foreach (_input ${_inputs})
+    file (READ "${_input}" _contents)
+    get_filename_component (_name "${_input}" NAME)
+    file (APPEND "${OUTPUT}" "// ---- ${_name}\n${_contents}\n")
+endforeach ()
@@ -16,6 +16,26 @@ add_custom_command (OUTPUT "${CMAKE_BINARY_DIR}/testsuite/runtest.py"
                     MAIN_DEPENDENCY "${CMAKE_SOURCE_DIR}/testsuite/runtest.py")
 add_custom_target ( CopyFiles ALL DEPENDS "${CMAKE_BINARY_DIR}/testsuite/runtest.py" )
 
+# "make benchmark" compares the LLVM JIT and the Artic AOT paths on the
+# shaders of src/shaders and the testsuite, writing benchmark.json into the
+# build directory. The Artic modes need the artic compiler.
+find_program (ARTIC_EXECUTABLE artic)
+find_program (ARTIC_LLVM_COMPILER NAMES clang)
+set (_benchmark_args --build-dir "${CMAKE_BINARY_DIR}"
+                     --source-dir "${CMAKE_SOURCE_DIR}"
+                     --json "${CMAKE_BINARY_DIR}/benchmark.json")
+if (ARTIC_EXECUTABLE)
+    list (APPEND _benchmark_args --artic "${ARTIC_EXECUTABLE}")
+endif ()
+add_custom_target ( benchmark
+                    COMMAND ${Python_EXECUTABLE}
+                        "${CMAKE_SOURCE_DIR}/testsuite/benchmark.py"
+                        ${_benchmark_args}
+                    DEPENDS oslc oslinfo testshade
+                    WORKING_DIRECTORY "${CMAKE_BINARY_DIR}"
+                    COMMENT "Benchmarking LLVM JIT vs Artic AOT"
+                    USES_TERMINAL )
+
 # add_one_testsuite() - set up one testsuite entry
 #
 # Usage:
@@ -83,6 +103,7 @@ macro ( TESTSUITE )
     endif ()
     set (test_all_optix $ENV{TESTSUITE_OPTIX})
     set (test_all_batched $ENV{TESTSUITE_BATCHED})
+    set (test_all_artic $ENV{TESTSUITE_ARTIC})
     # Add the tests if all is well.
     set (ALL_TEST_LIST "")
     set (_testsuite "${CMAKE_SOURCE_DIR}/testsuite")
@@ -142,6 +163,20 @@ macro ( TESTSUITE )
             add_one_testsuite ("${_testname}.batched.opt" "${_testsrcdir}"
                                ENV TESTSHADE_OPT=2 TESTSHADE_BATCHED=1 )
         endif ()
+
+        # With an artic compiler, also run it with the group compiled
+        # ahead of time through Artic (testshade --artic), against the
+        # same refs, if there is an ARTIC marker file in the directory.
+        # If an environment variable $TESTSUITE_ARTIC is nonzero, then
+        # run all tests that way, even if there's no ARTIC marker.
+        if (ARTIC_EXECUTABLE AND ARTIC_LLVM_COMPILER
+            AND (EXISTS "${_testsrcdir}/ARTIC" OR test_all_artic)
+            AND NOT EXISTS "${_testsrcdir}/NOARTIC")
+            add_one_testsuite ("${_testname}.artic" "${_testsrcdir}"
+                               ENV TESTSHADE_OPT=2
+                                   TESTSHADE_ARTIC=${ARTIC_EXECUTABLE}
+                                   TESTSHADE_ARTIC_CC=${ARTIC_LLVM_COMPILER} )
+        endif ()
     endforeach ()
     if (VERBOSE)
         message (STATUS "Added tests: ${ALL_TEST_LIST}")
@@ -155,6 +190,8 @@ macro (osl_add_all_tests)
     TESTSUITE ( aastep allowconnect-err and-or-not-synonyms arithmetic
                 arithmetic-cov
                 array array-derivs array-range array-aassign
+                artic-color artic-loops artic-messages artic-noise
+                artic-slicing artic-spline artic-transform
                 blackbody blendmath breakcont
                 bug-array-heapoffsets bug-locallifetime bug-outputinit
                 bug-param-duplicate bug-peep bug-return
@@ -177,9 +214,12 @@ macro (osl_add_all_tests)
                 group-outputs groupstring
                 hash hashnoise hex hyperb
                 ieee_fp if incdec initlist initops intbits isconnected isconstant
+                jit-async
                 layers layers-Ciassign layers-entry layers-lazy layers-lazyerror
                 layers-nonlazycopy layers-repeatedoutputs
                 linearstep
+                llvm-jit-cache llvm-lazy-jit llvm-parallel-layers
+                llvm-string-hashes
                 logic loop matrix message
                 mergeinstances-duplicate-entrylayers
                 mergeinstances-nouserdata mergeinstances-vararray
@@ -270,4 +310,26 @@ macro (osl_add_all_tests)
         TESTSUITE ( testoptix testoptix-noise example-cuda)
     endif ()
 
+    # With an artic compiler, the shaders of the artic-* tests are also run
+    # through the Artic AOT path, whose images must match the LLVM JIT ones.
+    if (ARTIC_EXECUTABLE)
+        set (_artic_bitmatch_shaders "")
+        foreach (_testname artic-loops artic-noise artic-spline)
+            list (APPEND _artic_bitmatch_shaders
+                  "${CMAKE_SOURCE_DIR}/testsuite/${_testname}/test.osl")
+        endforeach ()
+        add_test (NAME artic-bitmatch
+                  COMMAND ${Python_EXECUTABLE}
+                      "${CMAKE_SOURCE_DIR}/testsuite/benchmark.py"
+                      --build-dir "${CMAKE_BINARY_DIR}"
+                      --source-dir "${CMAKE_SOURCE_DIR}"
+                      --work-dir "${CMAKE_BINARY_DIR}/testsuite/artic-bitmatch"
+                      --json "${CMAKE_BINARY_DIR}/testsuite/artic-bitmatch.json"
+                      --artic "${ARTIC_EXECUTABLE}"
+                      --grid 64 --iters 1 --strict
+                      ${_artic_bitmatch_shaders} )
+        set_tests_properties (artic-bitmatch PROPERTIES ENVIRONMENT
+                              "OpenImageIO_ROOT=${OpenImageIO_ROOT}")
+    endif ()
+
 endmacro()
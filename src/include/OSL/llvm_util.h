@@ -36,6 +36,7 @@ namespace llvm {
   class Module;
   class PointerType;
   class StringRef;
+  class TargetMachine;
   class Type;
   class Value;
   class VectorType;
@@ -110,6 +111,20 @@ public:
     void jit_aggressive(bool val) { m_jit_aggressive = val; }
     bool jit_aggressive() const { return m_jit_aggressive; }
 
+    /// Set the directory of the persistent JIT cache ("" to disable).
+    /// Takes effect at the next make_jit_execengine(): from then on, a
+    /// module named by jit_cache_key() is loaded from the cache instead
+    /// of being compiled when its object is there, and saved to it after
+    /// it is compiled.
+    void jit_cache(string_view dir) { m_jit_cache_dir = dir; }
+    const std::string& jit_cache() const { return m_jit_cache_dir; }
+
+    /// Emit ustring constants as string_symbol()s rather than as the
+    /// address of their characters, so identical IR, and JITed code, is
+    /// generated for them in every process.
+    void string_hashes(bool val) { m_string_hashes = val; }
+    bool string_hashes() const { return m_string_hashes; }
+
     /// Return a reference to the current context.
     llvm::LLVMContext &context () const { return *m_llvm_context; }
 
@@ -126,8 +141,24 @@ public:
         m_llvm_module = m;
         m_ModuleIsFinalized = false;
         m_ModuleIsPruned = false;
+        m_ModuleIsProcessSpecific = false;
     }
 
+    /// Has IR been generated for the current module that bakes in an
+    /// address only valid in this process (a ustring constant, a non-NULL
+    /// constant_ptr)?  Such a module can't go through the JIT cache.
+    bool module_is_process_specific () const { return m_ModuleIsProcessSpecific; }
+
+    /// Compute the JIT cache key of the current module -- a hash of its
+    /// IR, of extra (any option that changes the code generated from
+    /// that IR), of the OSL and LLVM versions and of the target -- and
+    /// make it the module's identifier, so that the JIT cache recognizes
+    /// it.  Call it once the IR is complete, before do_optimize().
+    std::string jit_cache_key (string_view extra = "");
+
+    /// Does the JIT cache hold the object for the given key?
+    bool jit_cache_has (string_view key) const;
+
     /// Create a new empty module.
     llvm::Module *new_module (const char *id = "default");
 
@@ -168,6 +199,10 @@ public:
     /// explicitly instead of relying on dlsym.
     void add_function_mapping (llvm::Function *func, void *addr);
 
+    /// Add a global mapping of the named function to its callable address,
+    /// for code that add_object() loads without the function's declaration.
+    void add_function_mapping (string_view name, void *addr);
+
     /// Set up a new current function that subsequent basic blocks will
     /// be added to.
     void current_function (llvm::Function *func) { m_current_function = func; }
@@ -289,6 +324,35 @@ public:
     /// you have already called do_optimize() if you want optimization.
     void *getPointerToFunction (llvm::Function *func);
 
+    /// Retrieve a callable pointer to the named function, which may be
+    /// defined by the module or by an add_object().
+    void *getPointerToFunction (string_view name);
+
+    /// Split the module into one module per function of units, holding
+    /// that function and its own copies of whatever it calls, so they can
+    /// be optimized and compiled separately (in other threads, with an
+    /// LLVM_Util of theirs set up by jit_target()).  Returns their
+    /// bitcode.  Globals that are written to are only defined by the
+    /// first.  The module is left with just the declarations of the
+    /// units, which getPointerToFunction() finds once the objects of all
+    /// the pieces are add_object()ed.
+    std::vector<std::string> split_module (const std::vector<llvm::Function*> &units,
+                                           std::string *err = nullptr);
+
+    /// Target what the execengine of jit does -- a copy of its
+    /// TargetMachine, its ISA and CPU features -- in
+    /// setup_optimization_passes() and emit_object(), without an engine
+    /// of our own.
+    void jit_target (LLVM_Util &jit);
+
+    /// Compile the module to a native object for the jit_target().
+    /// Return false and set err if that fails.
+    bool emit_object (std::string &object, std::string *err = nullptr);
+
+    /// Load an object made by emit_object() into the execengine, to be
+    /// linked with the module when it is finalized.
+    bool add_object (const std::string &object, std::string *err = nullptr);
+
     /// Wrap ExecutionEngine::InstallLazyFunctionCreator.
     void InstallLazyFunctionCreator (void* (*P)(const std::string &));
 
@@ -636,6 +700,22 @@ public:
         return constant(ustring(s));
     }
 
+    /// Return a char* constant for s that is a reference to the external
+    /// symbol "osl_ustr_<hash>", named after the stable hash of its
+    /// characters (UStringHash::Hash), which the JIT resolves to s.c_str()
+    /// through a table of the strings passed here.  Return NULL if s is
+    /// the NULL ustring or its hash collides with a different string's.
+    llvm::Constant *string_symbol (ustring s);
+
+    /// Return a pointer constant (of the given type, or void* if NULL) for
+    /// p that is a reference to the external symbol "osl_ptr_<name>",
+    /// which the JIT resolves to p, so that IR referring to an object or
+    /// function of this process is still identical in every process.
+    /// Return NULL if p is NULL or name already stands for another
+    /// address.
+    llvm::Constant *pointer_symbol (string_view name, void *p,
+                                    llvm::PointerType *type = NULL);
+
     llvm::Value* llvm_mask_to_native(llvm::Value* llvm_mask);
     llvm::Value* native_to_llvm_mask(llvm::Value* native_mask);
 
@@ -803,6 +883,14 @@ public:
     /// Store to a dereferenced pointer with no masking:   *ptr = val
     void op_unmasked_store (llvm::Value *val, llvm::Value *ptr);
 
+    /// Atomically load a pointer-sized value, with acquire ordering, for
+    /// code that reads what another thread may be writing.
+    llvm::Value *op_load_acquire (llvm::Value *ptr);
+
+    /// Atomically store a pointer-sized value, with release ordering, to
+    /// publish it to threads that op_load_acquire it.
+    void op_store_release (llvm::Value *val, llvm::Value *ptr);
+
     /// Dereference a pointer of a native mask
     /// converting it to a llvm mask (vector of bits):  return native_to_llvm_mask(*ptr)
     llvm::Value * op_load_mask (llvm::Value *native_mask_ptr);
@@ -914,6 +1002,7 @@ public:
 private:
     class MemoryManager;
     class IRBuilder;
+    class ObjectCache;
 
     void SetupLLVM ();
     IRBuilder& builder();
@@ -922,6 +1011,7 @@ private:
     bool m_dumpasm = false;
     bool m_jit_fma = false;
     bool m_jit_aggressive = false;
+    bool m_string_hashes = false;
     PerThreadInfo::Impl *m_thread;
     llvm::LLVMContext *m_llvm_context;
     llvm::Module *m_llvm_module;
@@ -931,6 +1021,9 @@ private:
     llvm::legacy::PassManager *m_llvm_module_passes;
     llvm::legacy::FunctionPassManager *m_llvm_func_passes;
     llvm::ExecutionEngine *m_llvm_exec;
+    ObjectCache *m_llvm_jit_cache = nullptr;
+    std::string m_jit_cache_dir;
+    llvm::TargetMachine *m_target_machine = nullptr;   // of jit_target()
     TargetISA m_target_isa = TargetISA::UNKNOWN;
 
     std::vector<llvm::BasicBlock *> m_return_block;     // stack for func call
@@ -1001,6 +1094,7 @@ private:
     llvm::DISubroutineType * mSubTypeForInlinedFunction;
     bool m_ModuleIsFinalized;
     bool m_ModuleIsPruned;
+    bool m_ModuleIsProcessSpecific = false;
 
     // Additional tracking for masked conditionals, shaders, subroutines, and loop flow control
     struct MaskInfo
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <memory>
+#include <future>
 
 #include <OSL/oslconfig.h>
 #include <OSL/shaderglobals.h>
@@ -36,6 +37,11 @@ typedef const void* TransformationPtr;
 typedef void (*PrepareClosureFunc)(RendererServices*, int id, void* data);
 typedef void (*SetupClosureFunc)(RendererServices*, int id, void* data);
 
+/// Entry point of a shader group compiled ahead of time (for example by
+/// the Artic pipeline).  It is called just like a JITed group: with the
+/// ShaderGlobals of the point being shaded and the group's heap data.
+typedef void (*CompiledGroupFunc)(ShaderGlobals* sg, void* groupdata);
+
 
 namespace pvt {
 class ShadingSystemImpl;
@@ -134,6 +140,11 @@ public:
     ///                              isconnected()? (0)
     ///    int greedyjit          Optimize and compile all shaders up front,
     ///                              versus only as needed (0).
+    ///    int jit_threads        Number of background threads compiling the
+    ///                              groups queued by optimize_group_async
+    ///                              (0 means one per HW core, negative
+    ///                              means none: the queue is then only
+    ///                              served by compile_queued_group). (0)
     ///    int llvm_target_host   Target the specific host architecture for
     ///                              LLVM IR generation. (1)
     ///    int llvm_jit_fma       Allow fused mul/add (0). This can increase
@@ -146,6 +157,27 @@ public:
     ///                              "AVX512_noFMA", or "host" means to
     ///                              figure out what the host can do. ("")
     ///    int llvm_jit_aggressive  Use LLVM "aggressive" JIT mode. (0)
+    ///    string llvm_jit_cache  Directory of a persistent cache of JITed
+    ///                              shader groups, shared by all runs that
+    ///                              use it; "" means no cache. ("")
+    ///    int llvm_string_hashes  Refer to string constants in JITed code
+    ///                              by a hash of their characters, resolved
+    ///                              when the code is loaded, instead of by
+    ///                              their address, so the code is the same
+    ///                              in every process and can go through
+    ///                              the llvm_jit_cache. (0)
+    ///    int llvm_parallel_layers  Optimize and compile the layers of a
+    ///                              group in separate modules on up to
+    ///                              this many threads, then link them
+    ///                              into one JITed group; 0 or 1 means
+    ///                              all in one module on one thread. (0)
+    ///    int llvm_lazy_jit      With lazylayers, leave the layers that only
+    ///                              run on demand to be optimized and JITed
+    ///                              the first time one of them runs, so JIT
+    ///                              time and memory go to the layers that
+    ///                              are used. Groups with such layers are
+    ///                              not stored in the llvm_jit_cache, as
+    ///                              their code refers to the group. (0)
     ///    int vector_width       Vector width to allow for SIMD ops (4).
     ///    int llvm_debugging_symbols  When JITing, generate debug symbols
     ///                             that associate machine code with shader
@@ -186,6 +218,9 @@ public:
     ///    int llvm_output_bitcode  Output the full bitcode for each group,
     ///                              for debugging. (0)
     ///    int llvm_dumpasm       Print the CPU assembly code from the JIT (0)
+    ///    int artic_output       Write each optimized group as Artic source
+    ///                              (<groupname>.art), for AOT compiling
+    ///                              with AnyDSL. (0)
     ///    string llvm_prune_ir_strategy  Strategy for pruning unnecessary
     ///                              IR (choices: "prune" [default],
     ///                              "internalize", or "none").
@@ -327,6 +362,8 @@ public:
     ///   string groupname           The name of the shader group.
     ///   int num_layers             The number of layers in the group.
     ///   string[] layer_names       The names of the layers in the group.
+    ///   string[] shader_names      The names of the shaders (masters) of
+    ///                                the layers in the group.
     ///   int num_textures_needed    The number of texture names that are
     ///                                known to be potentially needed by the
     ///                                group (after optimization).
@@ -777,6 +814,33 @@ public:
     /// specified number of threads (0 means use all available HW cores).
     void optimize_all_groups (int nthreads=0, bool do_jit = true);
 
+    /// Bind the group to an entry point compiled ahead of time instead
+    /// of optimizing and JITing it.  From then on execute() calls entry
+    /// directly (as the group's last layer) with a heap of groupdata_size
+    /// bytes, and the group never costs any optimization or JIT time.
+    /// The group must be complete (ShaderGroupEnd called) and not yet
+    /// JITed.  Return true on success.
+    bool register_compiled_group (ShaderGroup *group, CompiledGroupFunc entry,
+                                  size_t groupdata_size = 0);
+
+    /// Queue the group to be optimized and optionally JITed in the
+    /// background by a pool of "jit_threads" threads, and return a future
+    /// that becomes ready when it has been. Queued groups are compiled in
+    /// order of decreasing priority (first come, first served among equal
+    /// priorities); calling this again for a group that is still queued
+    /// just changes its priority, so the renderer can move the groups it
+    /// needs soonest (visible objects, say) to the front. The group is
+    /// kept alive until it has been compiled.
+    std::shared_future<void> optimize_group_async (ShaderGroupRef group,
+                                                   float priority = 0.0f,
+                                                   bool do_jit = true);
+
+    /// Optimize (and JIT, if requested) the most urgent group queued by
+    /// optimize_group_async on the calling thread, so a thread with
+    /// nothing better to do can help the background threads. Return false
+    /// if the queue was empty.
+    bool compile_queued_group ();
+
     /// Return a pointer to the TextureSystem being used.
     TextureSystem * texturesys () const;
 
@@ -3,6 +3,13 @@
 //
 #include "artic.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include <OpenImageIO/strutil.h>
+
+#include "../liboslexec/string_hash.h"
+
 
 OSL_NAMESPACE_ENTER
 
@@ -174,27 +181,415 @@ artic_simpletype(TypeDesc st)
     return start + end;
 }
 
-template<typename... Args>
-void
-ArticSource::add_source_with_indent(const std::string& code, Args... args)
+const std::string
+artic_soa_string(TypeSpec typeSpec)
 {
-    for (int i = 0; i < m_indent; i++) {
-        m_code += m_indent_string;
+    if (typeSpec.is_triple()) {
+        return "VectorSoA";
+    } else {
+        return "&mut [" + artic_string(typeSpec, 0) + "]";
     }
-    add_source(code, args...);
 }
 
+const std::string
+artic_dual_string(TypeSpec typeSpec)
+{
+    if (typeSpec.is_triple()) {
+        return "Dual2_Vector";
+    } else {
+        return "Dual2_f32";
+    }
+}
 
+static bool
+is_dual_capable(const TypeSpec& typeSpec)
+{
+    return !typeSpec.is_array()
+           && (typeSpec.is_float() || typeSpec.is_int()
+               || typeSpec.is_triple());
+}
 
-template<typename... Args>
-void
-ArticSource::add_source(const std::string& code, Args... args)
+// Builtins with a Dual2 overload in anyosl_std.
+static bool
+is_dual_builtin(ustring name)
+{
+    static const std::unordered_set<std::string> names
+        = { "dot", "length", "normalize", "pow", "sqrt", "sin", "cos" };
+    return names.count(name.string()) != 0;
+}
+
+// Builtins that read the derivatives of their arguments.
+static bool
+is_derivative_builtin(ustring name)
+{
+    return name == "Dx" || name == "Dy" || name == "Dz"
+           || name == "filterwidth" || name == "area";
+}
+
+static const Symbol*
+lvalue_symbol(ASTNode* node)
+{
+    switch (node->nodetype()) {
+    case ASTNode::variable_ref_node: return ((ASTvariable_ref*)node)->sym();
+    case ASTNode::index_node:
+        return lvalue_symbol(((ASTindex*)node)->lvalue().get());
+    case ASTNode::structselect_node:
+        return lvalue_symbol(((ASTstructselect*)node)->lvalue().get());
+    default: return nullptr;
+    }
+}
+
+static void
+collect_symbol_list(ASTNode* node, std::unordered_set<const Symbol*>& syms);
+
+// Collect every symbol read by the expression node.
+static void
+collect_symbols(ASTNode* node, std::unordered_set<const Symbol*>& syms)
+{
+    if (!node) {
+        return;
+    }
+    switch (node->nodetype()) {
+    case ASTNode::variable_ref_node:
+        syms.insert(((ASTvariable_ref*)node)->sym());
+        break;
+    case ASTNode::index_node: {
+        auto n = (ASTindex*)node;
+        collect_symbols(n->lvalue().get(), syms);
+        collect_symbols(n->index().get(), syms);
+        collect_symbols(n->index2().get(), syms);
+        collect_symbols(n->index3().get(), syms);
+        break;
+    }
+    case ASTNode::structselect_node:
+        collect_symbols(((ASTstructselect*)node)->lvalue().get(), syms);
+        break;
+    case ASTNode::preincdec_node:
+        collect_symbols(((ASTpreincdec*)node)->var().get(), syms);
+        break;
+    case ASTNode::postincdec_node:
+        collect_symbols(((ASTpostincdec*)node)->var().get(), syms);
+        break;
+    case ASTNode::binary_expression_node:
+        collect_symbols(((ASTbinary_expression*)node)->left().get(), syms);
+        collect_symbols(((ASTbinary_expression*)node)->right().get(), syms);
+        break;
+    case ASTNode::unary_expression_node:
+        collect_symbols(((ASTunary_expression*)node)->expr().get(), syms);
+        break;
+    case ASTNode::assign_expression_node:
+        collect_symbols(((ASTassign_expression*)node)->expr().get(), syms);
+        break;
+    case ASTNode::ternary_expression_node: {
+        auto n = (ASTternary_expression*)node;
+        collect_symbols(n->cond().get(), syms);
+        collect_symbols(n->trueexpr().get(), syms);
+        collect_symbols(n->falseexpr().get(), syms);
+        break;
+    }
+    case ASTNode::comma_operator_node:
+        collect_symbol_list(((ASTcomma_operator*)node)->expr().get(), syms);
+        break;
+    case ASTNode::typecast_expression_node:
+        collect_symbols(((ASTtypecast_expression*)node)->expr().get(), syms);
+        break;
+    case ASTNode::type_constructor_node:
+        collect_symbol_list(((ASTtype_constructor*)node)->args().get(), syms);
+        break;
+    case ASTNode::compound_initializer_node:
+        collect_symbol_list(((ASTcompound_initializer*)node)->initlist().get(),
+                            syms);
+        break;
+    case ASTNode::function_call_node:
+        collect_symbol_list(((ASTfunction_call*)node)->args().get(), syms);
+        break;
+    default: break;
+    }
+}
+
+static void
+collect_symbol_list(ASTNode* node, std::unordered_set<const Symbol*>& syms)
+{
+    for (; node; node = node->nextptr()) {
+        collect_symbols(node, syms);
+    }
+}
+
+// Does the statement list hold a statement of the given type (with the
+// given opname, to tell 'break' from 'continue')?  Nested loops are only
+// searched with into_loops, since the loopmods in them are their own.
+static bool
+contains_statement(ASTNode* node, ASTNode::NodeType type, const char* opname,
+                   bool into_loops)
+{
+    for (; node; node = node->nextptr()) {
+        if (node->nodetype() == type
+            && (!opname || !strcmp(node->opname(), opname))) {
+            return true;
+        }
+        if (node->nodetype() == ASTNode::conditional_statement_node) {
+            auto n = (ASTconditional_statement*)node;
+            if (contains_statement(n->truestmt().get(), type, opname,
+                                   into_loops)
+                || contains_statement(n->falsestmt().get(), type, opname,
+                                      into_loops)) {
+                return true;
+            }
+        } else if (node->nodetype() == ASTNode::loop_statement_node
+                   && into_loops) {
+            if (contains_statement(((ASTloop_statement*)node)->stmt().get(),
+                                   type, opname, into_loops)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Builtins called for what they do rather than for what they return.
+static bool
+is_side_effect_builtin(ustring name)
+{
+    return name == "printf" || name == "fprintf" || name == "warning"
+           || name == "error" || name == "setmessage" || name == "trace"
+           || name == "exit";
+}
+
+static bool
+has_side_effect_list(ASTNode* node,
+                     std::unordered_set<const ASTNode*>& visiting);
+
+// Does writing the lvalue write a global (or something we can't tell)?
+static bool
+writes_global(ASTNode* lvalue)
+{
+    auto sym = lvalue_symbol(lvalue);
+    return !sym || sym->symtype() == SymTypeGlobal;
+}
+
+// Does the node, a statement or expression of a user function body, do
+// anything the caller can see other than writing the function's output
+// parameters (which the call reports as argument writes)?  That is calling
+// a side-effect builtin or writing a global such as Ci, directly or in the
+// functions it calls.  Unknown nodes count as side effects.
+static bool
+has_side_effect(ASTNode* node, std::unordered_set<const ASTNode*>& visiting)
+{
+    if (!node) {
+        return false;
+    }
+    switch (node->nodetype()) {
+    case ASTNode::literal_node:
+    case ASTNode::variable_ref_node:
+    case ASTNode::loopmod_statement_node: return false;
+    case ASTNode::variable_declaration_node:
+        return has_side_effect(((ASTvariable_declaration*)node)->init().get(),
+                               visiting);
+    case ASTNode::return_statement_node:
+        return has_side_effect(((ASTreturn_statement*)node)->expr().get(),
+                               visiting);
+    case ASTNode::index_node: {
+        auto n = (ASTindex*)node;
+        return has_side_effect(n->lvalue().get(), visiting)
+               || has_side_effect(n->index().get(), visiting)
+               || has_side_effect(n->index2().get(), visiting)
+               || has_side_effect(n->index3().get(), visiting);
+    }
+    case ASTNode::structselect_node:
+        return has_side_effect(((ASTstructselect*)node)->lvalue().get(),
+                               visiting);
+    case ASTNode::preincdec_node:
+        return writes_global(((ASTpreincdec*)node)->var().get());
+    case ASTNode::postincdec_node:
+        return writes_global(((ASTpostincdec*)node)->var().get());
+    case ASTNode::assign_expression_node: {
+        auto n = (ASTassign_expression*)node;
+        return writes_global(n->var().get())
+               || has_side_effect(n->var().get(), visiting)
+               || has_side_effect(n->expr().get(), visiting);
+    }
+    case ASTNode::binary_expression_node:
+        return has_side_effect(((ASTbinary_expression*)node)->left().get(),
+                               visiting)
+               || has_side_effect(((ASTbinary_expression*)node)->right().get(),
+                                  visiting);
+    case ASTNode::unary_expression_node:
+        return has_side_effect(((ASTunary_expression*)node)->expr().get(),
+                               visiting);
+    case ASTNode::ternary_expression_node: {
+        auto n = (ASTternary_expression*)node;
+        return has_side_effect(n->cond().get(), visiting)
+               || has_side_effect(n->trueexpr().get(), visiting)
+               || has_side_effect(n->falseexpr().get(), visiting);
+    }
+    case ASTNode::comma_operator_node:
+        return has_side_effect_list(((ASTcomma_operator*)node)->expr().get(),
+                                    visiting);
+    case ASTNode::typecast_expression_node:
+        return has_side_effect(((ASTtypecast_expression*)node)->expr().get(),
+                               visiting);
+    case ASTNode::type_constructor_node:
+        return has_side_effect_list(((ASTtype_constructor*)node)->args().get(),
+                                    visiting);
+    case ASTNode::compound_initializer_node:
+        return has_side_effect_list(
+            ((ASTcompound_initializer*)node)->initlist().get(), visiting);
+    case ASTNode::conditional_statement_node: {
+        auto n = (ASTconditional_statement*)node;
+        return has_side_effect(n->cond().get(), visiting)
+               || has_side_effect_list(n->truestmt().get(), visiting)
+               || has_side_effect_list(n->falsestmt().get(), visiting);
+    }
+    case ASTNode::loop_statement_node: {
+        auto n = (ASTloop_statement*)node;
+        return has_side_effect_list(n->init().get(), visiting)
+               || has_side_effect(n->cond().get(), visiting)
+               || has_side_effect_list(n->iter().get(), visiting)
+               || has_side_effect_list(n->stmt().get(), visiting);
+    }
+    case ASTNode::function_call_node: {
+        auto n = (ASTfunction_call*)node;
+        if (n->is_user_function()) {
+            // A function that is already being looked at is decided by
+            // the rest of its body.
+            auto func = n->user_function();
+            if (!visiting.count(func)) {
+                visiting.insert(func);
+                if (has_side_effect_list(func->statements().get(), visiting)) {
+                    return true;
+                }
+            }
+        } else if (!n->is_struct_ctr()
+                   && is_side_effect_builtin(n->func()->name())) {
+            return true;
+        }
+        int a = n->typespec().is_void() ? 0 : 1;
+        for (ASTNode* arg = n->args().get(); arg; arg = arg->nextptr(), ++a) {
+            if ((n->argwrite(a) && writes_global(arg))
+                || has_side_effect(arg, visiting)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    default: return true;
+    }
+}
+
+static bool
+has_side_effect_list(ASTNode* node,
+                     std::unordered_set<const ASTNode*>& visiting)
+{
+    for (; node; node = node->nextptr()) {
+        if (has_side_effect(node, visiting)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Is the call to a side-effect builtin, or to a user function whose body
+// has side effects?
+static bool
+is_side_effect_call(ASTfunction_call* call)
+{
+    if (call->is_user_function()) {
+        std::unordered_set<const ASTNode*> visiting { call->user_function() };
+        return has_side_effect_list(call->user_function()->statements().get(),
+                                    visiting);
+    }
+    return is_side_effect_builtin(call->func()->name());
+}
+
+static bool
+is_pure_list(ASTNode* node);
+
+// Can the expression node be dropped when its value isn't needed?  Writes
+// to anything other than the result, and side-effect builtins, can't.
+static bool
+is_pure_expression(ASTNode* node)
+{
+    if (!node) {
+        return true;
+    }
+    switch (node->nodetype()) {
+    case ASTNode::literal_node:
+    case ASTNode::variable_ref_node: return true;
+    case ASTNode::index_node: {
+        auto n = (ASTindex*)node;
+        return is_pure_expression(n->lvalue().get())
+               && is_pure_expression(n->index().get())
+               && is_pure_expression(n->index2().get())
+               && is_pure_expression(n->index3().get());
+    }
+    case ASTNode::structselect_node:
+        return is_pure_expression(((ASTstructselect*)node)->lvalue().get());
+    case ASTNode::binary_expression_node:
+        return is_pure_expression(((ASTbinary_expression*)node)->left().get())
+               && is_pure_expression(
+                   ((ASTbinary_expression*)node)->right().get());
+    case ASTNode::unary_expression_node:
+        return is_pure_expression(((ASTunary_expression*)node)->expr().get());
+    case ASTNode::ternary_expression_node: {
+        auto n = (ASTternary_expression*)node;
+        return is_pure_expression(n->cond().get())
+               && is_pure_expression(n->trueexpr().get())
+               && is_pure_expression(n->falseexpr().get());
+    }
+    case ASTNode::comma_operator_node:
+        return is_pure_list(((ASTcomma_operator*)node)->expr().get());
+    case ASTNode::typecast_expression_node:
+        return is_pure_expression(
+            ((ASTtypecast_expression*)node)->expr().get());
+    case ASTNode::type_constructor_node:
+        return is_pure_list(((ASTtype_constructor*)node)->args().get());
+    case ASTNode::compound_initializer_node:
+        return is_pure_list(
+            ((ASTcompound_initializer*)node)->initlist().get());
+    case ASTNode::function_call_node: {
+        auto n = (ASTfunction_call*)node;
+        if (n->is_struct_ctr()) {
+            return is_pure_list(n->args().get());
+        }
+        if (is_side_effect_call(n)) {
+            return false;
+        }
+        int a = n->typespec().is_void() ? 0 : 1;
+        for (ASTNode* arg = n->args().get(); arg; arg = arg->nextptr(), ++a) {
+            if (n->argwrite(a) || !is_pure_expression(arg)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    default: return false;
+    }
+}
+
+static bool
+is_pure_list(ASTNode* node)
 {
-    m_code += code;
-    add_source(args...);
+    for (; node; node = node->nextptr()) {
+        if (!is_pure_expression(node)) {
+            return false;
+        }
+    }
+    return true;
 }
 
+static bool
+is_int_literal(ASTNode* node)
+{
+    return node && node->nodetype() == ASTNode::literal_node
+           && node->typespec().is_int();
+}
 
+static bool
+is_variable_ref(ASTNode* node, const Symbol* sym)
+{
+    return node && node->nodetype() == ASTNode::variable_ref_node
+           && ((ASTvariable_ref*)node)->sym() == sym;
+}
 
 int
 ArticSource::push_indent()
@@ -297,102 +692,565 @@ ArticTranspiler::dispatch_node(ASTNode::ref n)
     case ASTNode::_last_node: NOT_IMPLEMENTED; break;
     }
 }
+
+// Same scheme as OSLCompilerImpl::track_variable_dependencies, but on the
+// AST: every written symbol depends on the symbols read to produce it, and
+// the null symbol stands in for "$derivs", depending on every argument a
+// builtin takes derivatives of.
 void
-ArticTranspiler::transpile_shader_declaration(ASTshader_declaration* node)
+ArticTranspiler::track_dependencies(ASTNode* node, SymbolDependencies& deps)
 {
-    this->in_shader      = true;
-    ShaderType st        = node->shadertype();
-    std::string ststring = shadertypename(st);
-    auto shadername      = node->shadername().string();
-    source->add_source_with_indent("struct ", shadername, "_in {\n");
-    source->push_indent();
-    std::vector<ASTvariable_declaration*> inputs  = {};
-    std::vector<ASTvariable_declaration*> outputs = {};
-    for (ASTNode::ref f = node->formals(); f; f = f->next()) {
-        auto v = (ASTvariable_declaration*)f.get();
-        if (v->is_output()) {
-            outputs.push_back(v);
+    for (; node; node = node->nextptr()) {
+        switch (node->nodetype()) {
+        case ASTNode::variable_declaration_node: {
+            auto n = (ASTvariable_declaration*)node;
+            if (n->init()) {
+                collect_symbol_list(n->init().get(), deps[n->sym()]);
+                track_dependencies(n->init().get(), deps);
+            }
+            break;
         }
-        inputs.push_back(v);
-        source->add_source_with_indent(v->name().string(), ": ",
-                                       get_artic_type_string(f), ",\n");
-    }
-    source->pop_indent();
-    source->add_source_with_indent("}\n\n");
-
-    source->add_source_with_indent("fn make_", shadername, "_in(inout: shader_inout) -> ",
-                                   shadername, "_in {\n");
-    source->push_indent();
-    for (auto v : inputs) {
-        source->add_source_with_indent("let ", v->name().string(), ": ",
-                                       get_artic_type_string(v), " = ");
-        if (v->init()->nodetype() == ASTNode::NodeType::literal_node) {
-            //TODO: wtf is happening here?
-            auto lit = new ASTtype_constructor(v->typespec(), v->init().get());
-            dispatch_node(lit);
-            //delete lit;
-        } else {
-            dispatch_node(v->init());
+        case ASTNode::assign_expression_node: {
+            auto n  = (ASTassign_expression*)node;
+            auto sym = lvalue_symbol(n->var().get());
+            if (sym) {
+                collect_symbols(n->expr().get(), deps[sym]);
+            }
+            track_dependencies(n->expr().get(), deps);
+            break;
+        }
+        case ASTNode::function_call_node: {
+            auto n = (ASTfunction_call*)node;
+            if (!n->is_struct_ctr()) {
+                std::unordered_set<const Symbol*> read;
+                collect_symbol_list(n->args().get(), read);
+                int a = n->typespec().is_void() ? 0 : 1;
+                for (ASTNode* arg = n->args().get(); arg;
+                     arg = arg->nextptr(), ++a) {
+                    auto sym = lvalue_symbol(arg);
+                    if (sym && n->argwrite(a)) {
+                        deps[sym].insert(read.begin(), read.end());
+                    }
+                    if (n->argtakesderivs(a)) {
+                        collect_symbols(arg, deps[nullptr]);
+                    }
+                }
+            }
+            track_dependencies(n->args().get(), deps);
+            break;
+        }
+        case ASTNode::conditional_statement_node: {
+            auto n = (ASTconditional_statement*)node;
+            track_dependencies(n->cond().get(), deps);
+            track_dependencies(n->truestmt().get(), deps);
+            track_dependencies(n->falsestmt().get(), deps);
+            break;
+        }
+        case ASTNode::loop_statement_node: {
+            auto n = (ASTloop_statement*)node;
+            track_dependencies(n->init().get(), deps);
+            track_dependencies(n->cond().get(), deps);
+            track_dependencies(n->iter().get(), deps);
+            track_dependencies(n->stmt().get(), deps);
+            break;
+        }
+        case ASTNode::return_statement_node:
+            track_dependencies(((ASTreturn_statement*)node)->expr().get(),
+                               deps);
+            break;
+        case ASTNode::preincdec_node:
+        case ASTNode::postincdec_node: {
+            ASTNode* var = node->nodetype() == ASTNode::preincdec_node
+                               ? ((ASTpreincdec*)node)->var().get()
+                               : ((ASTpostincdec*)node)->var().get();
+            auto sym     = lvalue_symbol(var);
+            if (sym) {
+                collect_symbols(var, deps[sym]);
+            }
+            break;
+        }
+        case ASTNode::binary_expression_node:
+            track_dependencies(((ASTbinary_expression*)node)->left().get(),
+                               deps);
+            track_dependencies(((ASTbinary_expression*)node)->right().get(),
+                               deps);
+            break;
+        case ASTNode::unary_expression_node:
+            track_dependencies(((ASTunary_expression*)node)->expr().get(),
+                               deps);
+            break;
+        case ASTNode::ternary_expression_node: {
+            auto n = (ASTternary_expression*)node;
+            track_dependencies(n->cond().get(), deps);
+            track_dependencies(n->trueexpr().get(), deps);
+            track_dependencies(n->falseexpr().get(), deps);
+            break;
+        }
+        case ASTNode::typecast_expression_node:
+            track_dependencies(((ASTtypecast_expression*)node)->expr().get(),
+                               deps);
+            break;
+        case ASTNode::type_constructor_node:
+            track_dependencies(((ASTtype_constructor*)node)->args().get(),
+                               deps);
+            break;
+        case ASTNode::comma_operator_node:
+            track_dependencies(((ASTcomma_operator*)node)->expr().get(), deps);
+            break;
+        default: break;
         }
-        source->add_source(";\n");
-    }
-    emit_shaderinout_copy();
-    source->add_source_with_indent(shadername, "_in{\n");
-    source->push_indent();
-    for (auto v : inputs) {
-        source->add_source_with_indent(v->name().string(), " = ",
-                                       v->name().string(), ",\n");
     }
-    source->pop_indent();
-    source->add_source_with_indent("}\n");
-    source->pop_indent();
-    source->add_source_with_indent("}\n\n");
+}
 
-    source->add_source_with_indent("struct ", shadername, "_out {\n");
-    source->push_indent();
-    for (auto v : outputs) {
-        source->add_source_with_indent(v->name().string(), ": ",
-                                       get_artic_type_string(v), ",\n");
-    }
-    source->pop_indent();
-    source->add_source_with_indent("}\n\n");
 
-    source->add_source_with_indent("fn @", shadername,
-                                   "_impl(arg_in: ", shadername,
-                                   "_in, inout : shader_inout) -> (",
-                                   shadername, "_out, shader_inout) {\n");
-    source->push_indent();
-    for (auto v : inputs) {
-        source->add_source_with_indent("let ", v->is_output() ? "mut " : "",
-                                       v->name().string(), " = arg_in.",
-                                       v->name().string(), ";\n");
+
+void
+ArticTranspiler::compute_derivative_symbols(ASTshader_declaration* node)
+{
+    SymbolDependencies deps;
+    track_dependencies(node->statements().get(), deps);
+
+    deriv_symbols.clear();
+    deriv_globals.clear();
+    std::unordered_set<const Symbol*> visited;
+    std::vector<const Symbol*> pending = { nullptr };
+    while (!pending.empty()) {
+        auto sym = pending.back();
+        pending.pop_back();
+        for (auto dep : deps[sym]) {
+            if (!visited.insert(dep).second) {
+                continue;
+            }
+            pending.push_back(dep);
+            const TypeSpec& ts = dep->typespec();
+            if (ts.is_array() || !(ts.is_float() || ts.is_triple())) {
+                continue;  // only float and triple values carry derivs
+            }
+            deriv_symbols.insert(dep);
+            if (dep->symtype() == SymTypeGlobal) {
+                deriv_globals.insert(dep->name().string());
+            }
+        }
     }
-    emit_shaderinout_copy();
+}
 
-    transpile_statement_list(node->statements());
 
-    source->add_source_with_indent("(", node->shadername().string(),
-                                   "_out {\n");
-    source->push_indent();
-    for (auto v : outputs) {
-        source->add_source_with_indent(v->name().string(), " = ",
-                                       v->name().string(), ",\n");
-    }
-    source->pop_indent();
-    source->add_source_with_indent("},\n");
-    source->add_source_with_indent("");
-    emit_shaderinout_constructor();
-    source->add_source(")\n");
 
-    source->pop_indent();
+bool
+ArticTranspiler::has_derivs(ASTNode* node)
+{
+    if (!emit_derivs || !node) {
+        return false;
+    }
+    const TypeSpec& ts = node->typespec();
+    bool dual_type     = !ts.is_array() && (ts.is_float() || ts.is_triple());
+    switch (node->nodetype()) {
+    case ASTNode::variable_ref_node:
+        return deriv_symbols.count(((ASTvariable_ref*)node)->sym()) != 0;
+    case ASTNode::binary_expression_node: {
+        auto n           = (ASTbinary_expression*)node;
+        std::string word = n->opword();
+        return dual_type && !n->is_boolean_operator()
+               && (word == "add" || word == "sub" || word == "mul"
+                   || word == "div")
+               && (has_derivs(n->left().get()) || has_derivs(n->right().get()));
+    }
+    case ASTNode::unary_expression_node: {
+        auto n           = (ASTunary_expression*)node;
+        std::string word = n->opword();
+        return (word == "neg" || word == "add") && has_derivs(n->expr().get());
+    }
+    case ASTNode::ternary_expression_node: {
+        auto n = (ASTternary_expression*)node;
+        return dual_type
+               && (has_derivs(n->trueexpr().get())
+                   || has_derivs(n->falseexpr().get()));
+    }
+    case ASTNode::assign_expression_node:
+        return has_derivs(((ASTassign_expression*)node)->var().get());
+    case ASTNode::type_constructor_node: {
+        auto args = ((ASTtype_constructor*)node)->args();
+        if (!dual_type || !args) {
+            return false;
+        }
+        if (!args->next()) {
+            return has_derivs(args.get());
+        }
+        int nargs    = 0;
+        bool derivs = false;
+        for (ASTNode* arg = args.get(); arg; arg = arg->nextptr(), ++nargs) {
+            derivs |= has_derivs(arg);
+        }
+        return ts.is_triple() && nargs == 3 && derivs;
+    }
+    case ASTNode::function_call_node: {
+        auto n = (ASTfunction_call*)node;
+        if (!dual_type || n->is_user_function() || n->is_struct_ctr()
+            || !is_dual_builtin(ustring(n->opname()))) {
+            return false;
+        }
+        for (ASTNode* arg = n->args().get(); arg; arg = arg->nextptr()) {
+            if (has_derivs(arg)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    default: return false;
+    }
+}
+
+
+
+// Emit node as a Dual2 value (promoting plain values with zero
+// derivatives) or as a plain value (dropping derivatives).
+void
+ArticTranspiler::dispatch_value(ASTNode::ref node, bool as_dual)
+{
+    bool dual = has_derivs(node.get());
+    if (as_dual && !dual) {
+        source->add_source("make_", artic_dual_string(node->typespec()), "(");
+        if (node->typespec().is_int()) {
+            source->add_source("(");
+            dispatch_node(node);
+            source->add_source(") as f32");
+        } else {
+            dispatch_node(node);
+        }
+        source->add_source(")");
+    } else if (!as_dual && dual) {
+        source->add_source("(");
+        dispatch_node(node);
+        source->add_source(").val");
+    } else {
+        dispatch_node(node);
+    }
+}
+
+
+
+bool
+ArticTranspiler::is_baked_param(ASTvariable_declaration* v)
+{
+    return !v->is_output() && param_values.count(v->name().string())
+           && !artic_param_typename(v->typespec()).empty();
+}
+
+
+
+bool
+ArticTranspiler::is_live(const Symbol* sym)
+{
+    if (live_symbols.count(sym)) {
+        return true;
+    }
+    return (sym->symtype() == SymTypeOutputParam
+            || sym->symtype() == SymTypeGlobal)
+           && requested_outputs.count(sym->name().string());
+}
+
+
+
+bool
+ArticTranspiler::is_dead_statement(ASTNode* node)
+{
+    switch (node->nodetype()) {
+    case ASTNode::variable_declaration_node: {
+        auto n = (ASTvariable_declaration*)node;
+        return !is_live(n->sym()) && is_pure_expression(n->init().get());
+    }
+    case ASTNode::assign_expression_node: {
+        auto n   = (ASTassign_expression*)node;
+        auto sym = lvalue_symbol(n->var().get());
+        return sym && !is_live(sym) && is_pure_expression(n->var().get())
+               && is_pure_expression(n->expr().get());
+    }
+    case ASTNode::preincdec_node: {
+        auto sym = lvalue_symbol(((ASTpreincdec*)node)->var().get());
+        return sym && !is_live(sym);
+    }
+    case ASTNode::postincdec_node: {
+        auto sym = lvalue_symbol(((ASTpostincdec*)node)->var().get());
+        return sym && !is_live(sym);
+    }
+    case ASTNode::function_call_node: {
+        // Only the arguments it writes may be dead.
+        auto n = (ASTfunction_call*)node;
+        if (n->is_struct_ctr()) {
+            return is_pure_list(n->args().get());
+        }
+        if (is_side_effect_call(n)) {
+            return false;
+        }
+        int a = n->typespec().is_void() ? 0 : 1;
+        for (ASTNode* arg = n->args().get(); arg; arg = arg->nextptr(), ++a) {
+            if (n->argwrite(a)) {
+                auto sym = lvalue_symbol(arg);
+                if (!sym || is_live(sym)) {
+                    return false;
+                }
+            } else if (!is_pure_expression(arg)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case ASTNode::conditional_statement_node: {
+        auto n = (ASTconditional_statement*)node;
+        return is_pure_expression(n->cond().get())
+               && all_dead_statements(n->truestmt().get())
+               && all_dead_statements(n->falsestmt().get());
+    }
+    case ASTNode::loop_statement_node: {
+        auto n = (ASTloop_statement*)node;
+        return all_dead_statements(n->init().get())
+               && is_pure_expression(n->cond().get())
+               && all_dead_statements(n->iter().get())
+               && all_dead_statements(n->stmt().get());
+    }
+    default: return false;
+    }
+}
+
+
+
+bool
+ArticTranspiler::all_dead_statements(ASTNode* node)
+{
+    for (; node; node = node->nextptr()) {
+        if (!is_dead_statement(node)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+bool
+ArticTranspiler::mark_live_statements(ASTNode* node)
+{
+    // Everything a kept statement reads is live, as are the conditions
+    // of the ifs and loops around it.  Flow-insensitive, so a symbol is
+    // live everywhere once any kept statement reads it.
+    size_t before = live_symbols.size();
+    for (; node; node = node->nextptr()) {
+        if (is_dead_statement(node)) {
+            continue;
+        }
+        switch (node->nodetype()) {
+        case ASTNode::conditional_statement_node: {
+            auto n = (ASTconditional_statement*)node;
+            collect_symbols(n->cond().get(), live_symbols);
+            mark_live_statements(n->truestmt().get());
+            mark_live_statements(n->falsestmt().get());
+            break;
+        }
+        case ASTNode::loop_statement_node: {
+            auto n = (ASTloop_statement*)node;
+            mark_live_statements(n->init().get());
+            collect_symbols(n->cond().get(), live_symbols);
+            mark_live_statements(n->iter().get());
+            mark_live_statements(n->stmt().get());
+            break;
+        }
+        case ASTNode::variable_declaration_node:
+            collect_symbol_list(((ASTvariable_declaration*)node)->init().get(),
+                                live_symbols);
+            break;
+        case ASTNode::assign_expression_node:
+            // The var too, for its indices and the compound assignments.
+            collect_symbols(((ASTassign_expression*)node)->var().get(),
+                            live_symbols);
+            collect_symbols(node, live_symbols);
+            break;
+        case ASTNode::return_statement_node:
+            collect_symbols(((ASTreturn_statement*)node)->expr().get(),
+                            live_symbols);
+            break;
+        default: collect_symbols(node, live_symbols); break;
+        }
+    }
+    return live_symbols.size() != before;
+}
+
+
+
+void
+ArticTranspiler::transpile_shader_declaration(ASTshader_declaration* node)
+{
+    this->in_shader      = true;
+    ShaderType st        = node->shadertype();
+    std::string ststring = shadertypename(st);
+    auto shadername      = node->shadername().string();
+    compute_derivative_symbols(node);
+
+    // Instance values supplied at compile time become constant functions,
+    // so partial evaluation folds them into the body even when the
+    // _in struct is built by a driver that doesn't know about them.
+    for (ASTNode::ref f = node->formals(); f; f = f->next()) {
+        auto v = (ASTvariable_declaration*)f.get();
+        if (!is_baked_param(v)) {
+            continue;
+        }
+        const TypeSpec& ts = v->typespec();
+        std::vector<std::string> values;
+        for (auto token : OIIO::Strutil::splits(param_values[v->name().string()]))
+            values.emplace_back(token);
+        source->add_source_with_indent("fn @", shadername, "_param_",
+                                       v->name().string(), "() -> ",
+                                       get_artic_type_string(f), " { ",
+                                       artic_param_literal(artic_param_typename(ts),
+                                                           ts.is_array(), values),
+                                       " }\n");
+    }
+
+    source->add_source_with_indent("struct ", shadername, "_in {\n");
+    source->push_indent();
+    std::vector<ASTvariable_declaration*> inputs  = {};
+    std::vector<ASTvariable_declaration*> outputs = {};
+    for (ASTNode::ref f = node->formals(); f; f = f->next()) {
+        auto v = (ASTvariable_declaration*)f.get();
+        if (v->is_output()) {
+            outputs.push_back(v);
+        }
+        inputs.push_back(v);
+        source->add_source_with_indent(v->name().string(), ": ",
+                                       get_artic_type_string(f), ",\n");
+    }
+    source->pop_indent();
+    source->add_source_with_indent("}\n\n");
+
+    source->add_source_with_indent("fn @make_", shadername, "_in(inout: shader_inout) -> ",
+                                   shadername, "_in {\n");
+    source->push_indent();
+    for (auto v : inputs) {
+        source->add_source_with_indent("let ", v->name().string(), ": ",
+                                       get_artic_type_string(v), " = ");
+        if (is_baked_param(v)) {
+            source->add_source(shadername, "_param_", v->name().string(), "()");
+        } else if (v->init()->nodetype() == ASTNode::NodeType::literal_node) {
+            //TODO: wtf is happening here?
+            auto lit = new ASTtype_constructor(v->typespec(), v->init().get());
+            dispatch_node(lit);
+            //delete lit;
+        } else {
+            dispatch_node(v->init());
+        }
+        source->add_source(";\n");
+    }
+    emit_shaderinout_copy();
+    source->add_source_with_indent(shadername, "_in{\n");
+    source->push_indent();
+    for (auto v : inputs) {
+        source->add_source_with_indent(v->name().string(), " = ",
+                                       v->name().string(), ",\n");
+    }
+    source->pop_indent();
+    source->add_source_with_indent("}\n");
+    source->pop_indent();
+    source->add_source_with_indent("}\n\n");
+
+    source->add_source_with_indent("struct ", shadername, "_out {\n");
+    source->push_indent();
+    for (auto v : outputs) {
+        source->add_source_with_indent(v->name().string(), ": ",
+                                       get_artic_type_string(v), ",\n");
+    }
+    source->pop_indent();
     source->add_source_with_indent("}\n\n");
+
+    // Globals the body assigns, the only ones the entries store back.
+    SymbolDependencies deps;
+    track_dependencies(node->statements().get(), deps);
+    written_globals.clear();
+    for (auto& d : deps) {
+        if (d.first && d.first->symtype() == SymTypeGlobal) {
+            written_globals.insert(d.first->name().string());
+        }
+    }
+
+    emit_shader_impl(node, "_impl", inputs, outputs);
+    emit_batch_entry(shadername, outputs);
+    emit_shade_entry(shadername);
+    if (!requested_outputs.empty()) {
+        // The same body without the statements none of the requested
+        // outputs depend on, and an entry storing only those outputs.
+        live_symbols.clear();
+        while (mark_live_statements(node->statements().get())) {
+        }
+        slice_outputs = true;
+        emit_shader_impl(node, "_requested_impl", inputs, outputs);
+        slice_outputs = false;
+        emit_requested_batch_entry(shadername, outputs);
+    }
+    emit_strings_entry(shadername);
     this->in_shader = false;
 }
 
+void
+ArticTranspiler::emit_shader_impl(
+    ASTshader_declaration* node, const std::string& suffix,
+    const std::vector<ASTvariable_declaration*>& inputs,
+    const std::vector<ASTvariable_declaration*>& outputs)
+{
+    auto shadername = node->shadername().string();
+    source->add_source_with_indent("fn @", shadername, suffix,
+                                   "(arg_in: ", shadername,
+                                   "_in, inout : shader_inout) -> (",
+                                   shadername, "_out, shader_inout) {\n");
+    source->push_indent();
+    for (auto v : inputs) {
+        // Baked parameters ignore whatever the caller put in arg_in.
+        std::string value = is_baked_param(v)
+                                ? shadername + "_param_" + v->name().string()
+                                      + "()"
+                                : "arg_in." + v->name().string();
+        if (deriv_symbols.count(v->sym())) {
+            source->add_source_with_indent("let ", v->is_output() ? "mut " : "",
+                                           v->name().string(), " = make_",
+                                           artic_dual_string(v->typespec()),
+                                           "(", value, ");\n");
+        } else {
+            source->add_source_with_indent("let ", v->is_output() ? "mut " : "",
+                                           v->name().string(), " = ", value,
+                                           ";\n");
+        }
+    }
+    emit_derivs = true;
+    emit_shaderinout_copy(true);
+
+    transpile_statement_list(node->statements());
+
+    source->add_source_with_indent("(", node->shadername().string(),
+                                   "_out {\n");
+    source->push_indent();
+    for (auto v : outputs) {
+        source->add_source_with_indent(v->name().string(), " = ",
+                                       v->name().string(),
+                                       deriv_symbols.count(v->sym()) ? ".val"
+                                                                     : "",
+                                       ",\n");
+    }
+    source->pop_indent();
+    source->add_source_with_indent("},\n");
+    source->add_source_with_indent("");
+    emit_shaderinout_constructor();
+    source->add_source(")\n");
+    emit_derivs = false;
+
+    source->pop_indent();
+    source->add_source_with_indent("}\n\n");
+}
+
 void
 ArticTranspiler::transpile_statement_list(ASTNode::ref node)
 {
     while (node) {
+        if (slice_outputs && is_dead_statement(node.get())) {
+            node = node->next();
+            continue;
+        }
         if (node->nodetype() != ASTNode::NodeType::loop_statement_node
             && node->nodetype()
                    != ASTNode::NodeType::conditional_statement_node) {
@@ -421,7 +1279,11 @@ ArticTranspiler::transpile_function_declaration(ASTfunction_declaration* node)
             source->add_source("_", get_artic_type_string(formal_node));
             formal_node = formal_node->next();
         }
-        source->add_source("__", get_artic_type_string(node), "(");
+        source->add_source("__",
+                           node->typespec().is_void()
+                               ? std::string("void")
+                               : get_artic_type_string(node),
+                           "(");
         formal_node = node->formals();
         while (formal_node) {
             auto decl = (ASTvariable_declaration*)formal_node.get();
@@ -448,17 +1310,19 @@ ArticTranspiler::transpile_function_declaration(ASTfunction_declaration* node)
 void
 ArticTranspiler::transpile_variable_declaration(ASTvariable_declaration* node)
 {
+    bool dual = emit_derivs && deriv_symbols.count(node->sym());
     source->add_source("let mut ", node->name().string(), ": ",
-                       get_artic_type_string(node));
+                       dual ? artic_dual_string(node->typespec())
+                            : get_artic_type_string(node));
     if (node->init()) {
         source->add_source(" = ");
         if (node->init()->nodetype()
             != ASTNode::NodeType::type_constructor_node) {
             auto cons = new ASTtype_constructor(node->typespec(),
                                                 node->init().get());
-            dispatch_node(cons);
+            dispatch_value(cons, dual);
         } else {
-            dispatch_node(node->init());
+            dispatch_value(node->init(), dual);
         }
     }
 }
@@ -468,7 +1332,7 @@ ArticTranspiler::transpile_compound_initializer(ASTcompound_initializer* node)
     source->add_source("[");
     auto init_node = node->initlist();
     while (init_node) {
-        dispatch_node(init_node);
+        dispatch_value(init_node, false);
         source->add_source(", ");
         init_node = init_node->next();
     }
@@ -491,7 +1355,12 @@ ArticTranspiler::transpile_preincdec(ASTpreincdec* node)
 void
 ArticTranspiler::transpile_postincdec(ASTpostincdec* node)
 {
-    NOT_IMPLEMENTED;
+    source->add_source("{let postincdec_value = ");
+    dispatch_node(node->var());
+    source->add_source("; ");
+    dispatch_node(node->var());
+    source->add_source(" ", node->is_increment() ? "+" : "-",
+                       "= 1; postincdec_value}");
 }
 void
 ArticTranspiler::transpile_index(ASTindex* node)
@@ -500,14 +1369,14 @@ ArticTranspiler::transpile_index(ASTindex* node)
 
     if (lval->typespec().is_triple()) {
         source->add_source("index_Vector(");
-        dispatch_node(lval);
+        dispatch_value(lval, false);
         source->add_source(", ");
-        dispatch_node(node->index());
+        dispatch_value(node->index(), false);
         source->add_source(")");
     } else {
         dispatch_node(lval);
         source->add_source("[");
-        dispatch_node(node->index());
+        dispatch_value(node->index(), false);
         source->add_source("]");
     }
 }
@@ -522,104 +1391,219 @@ ArticTranspiler::transpile_structureselection(ASTstructselect* node)
     }
 }
 
+void
+ArticTranspiler::transpile_condition(ASTNode::ref cond)
+{
+    if (cond->nodetype() == ASTNode::NodeType::binary_expression_node
+        && ((ASTbinary_expression*)cond.get())->is_boolean_operator()) {
+        dispatch_value(cond, false);
+    } else {
+        source->add_source("make_bool_", get_artic_type_string(cond), "(");
+        dispatch_value(cond, false);
+        source->add_source(")");
+    }
+}
 void
 ArticTranspiler::transpile_conditional_statement(ASTconditional_statement* node)
 {
     auto true_node  = node->truestmt();
     auto false_node = node->falsestmt();
-    if (node->cond()->nodetype() == ASTNode::NodeType::binary_expression_node
-        && ((ASTbinary_expression*)node->cond().get())->is_boolean_operator()) {
-        source->add_source_with_indent("if(");
-        dispatch_node(node->cond());
-        source->add_source(") {\n");
-        source->push_indent();
-        transpile_statement_list(true_node);
-        source->pop_indent();
-        source->add_source_with_indent("}");
-        if (false_node) {
-            source->add_source(" else {\n");
-            source->push_indent();
-            transpile_statement_list(false_node);
-            source->pop_indent();
-            source->add_source_with_indent("}");
-        }
-        source->add_source("\n");
-    } else {
-        source->add_source_with_indent("if(make_bool_",
-                                       get_artic_type_string(node->cond()),
-                                       "(");
-        dispatch_node(node->cond());
-        source->add_source(")) {\n");
+    source->add_source_with_indent("if(");
+    transpile_condition(node->cond());
+    source->add_source(") {\n");
+    source->push_indent();
+    transpile_statement_list(true_node);
+    source->pop_indent();
+    source->add_source_with_indent("}");
+    if (false_node) {
+        source->add_source(" else {\n");
         source->push_indent();
-        transpile_statement_list(true_node);
+        transpile_statement_list(false_node);
         source->pop_indent();
         source->add_source_with_indent("}");
-        if (false_node) {
-            source->add_source(" else {\n");
-            source->push_indent();
-            transpile_statement_list(false_node);
-            source->pop_indent();
-            source->add_source_with_indent("}");
-        }
-        source->add_source("\n");
     }
+    source->add_source("\n");
 }
-void
-ArticTranspiler::transpile_loop_statement(ASTloop_statement* node)
+bool
+ArticTranspiler::is_constant_bound(ASTNode* node)
 {
-    switch (node->get_looptype()) {
-    case ASTloop_statement::LoopFor:
-        source->add_source_with_indent("{\n");
-        source->push_indent();
-        //source->add_source_with_indent("let mut ");
-        source->add_source_with_indent("");
-        dispatch_node(node->init());
-        source->add_source(";\n");
-    case ASTloop_statement::LoopWhile:
-        source->add_source_with_indent("while(");
-        dispatch_node(node->cond());
-        source->add_source(") {\n");
-        break;
-    case ASTloop_statement::LoopDo:
-        source->add_source_with_indent("while({");
-        break;
+    // Literals, and the baked parameters bound to literals up front.
+    if (is_int_literal(node)) {
+        return true;
+    }
+    if (!node || node->nodetype() != ASTNode::variable_ref_node
+        || !node->typespec().is_int()) {
+        return false;
+    }
+    auto sym = ((ASTvariable_ref*)node)->sym();
+    return this->in_shader && sym->symtype() == SymTypeParam
+           && sym->node()
+           && sym->node()->nodetype() == ASTNode::variable_declaration_node
+           && is_baked_param((ASTvariable_declaration*)sym->node());
+}
+bool
+ArticTranspiler::constant_trip_loop(ASTloop_statement* node)
+{
+    // for (int i = A; i < B; ++i), with i <= B, i++ or i += 1 as well
+    if (node->get_looptype() != ASTloop_statement::LoopFor) {
+        return false;
+    }
+    auto init = node->init().get();
+    if (!init || init->nextptr()
+        || init->nodetype() != ASTNode::variable_declaration_node) {
+        return false;
+    }
+    auto decl = (ASTvariable_declaration*)init;
+    auto sym  = decl->sym();
+    if (!decl->typespec().is_int() || !is_constant_bound(decl->init().get())
+        || (emit_derivs && deriv_symbols.count(sym))) {
+        return false;
     }
-    source->push_indent();
-    transpile_statement_list(node->stmt());
 
+    auto cond = node->cond().get();
+    if (!cond || cond->nodetype() != ASTNode::binary_expression_node) {
+        return false;
+    }
+    auto test = (ASTbinary_expression*)cond;
+    if ((strcmp(test->opname(), "<") && strcmp(test->opname(), "<="))
+        || !is_variable_ref(test->left().get(), sym)
+        || !is_constant_bound(test->right().get())) {
+        return false;
+    }
 
-    switch (node->get_looptype()) {
-    case ASTloop_statement::LoopFor:
-        source->add_source_with_indent("");
-        dispatch_node(node->iter());
-        source->add_source(";");
-        source->pop_indent();
-        source->add_source("\n");
-        source->add_source_with_indent("}\n");
+    auto iter = node->iter().get();
+    if (!iter || iter->nextptr()) {
+        return false;
+    }
+    bool step = false;
+    if (iter->nodetype() == ASTNode::preincdec_node) {
+        auto n = (ASTpreincdec*)iter;
+        step   = n->is_increment() && is_variable_ref(n->var().get(), sym);
+    } else if (iter->nodetype() == ASTNode::postincdec_node) {
+        auto n = (ASTpostincdec*)iter;
+        step   = n->is_increment() && is_variable_ref(n->var().get(), sym);
+    } else if (iter->nodetype() == ASTNode::assign_expression_node) {
+        auto n = (ASTassign_expression*)iter;
+        step   = !strcmp(n->opname(), "+=")
+               && is_variable_ref(n->var().get(), sym)
+               && is_int_literal(n->expr().get())
+               && ((ASTliteral*)n->expr().get())->intval() == 1;
+    }
+    if (!step) {
+        return false;
+    }
+
+    // The body runs as a closure, so it may not assign the counter or
+    // return from the enclosing function.
+    SymbolDependencies deps;
+    track_dependencies(node->stmt().get(), deps);
+    return !deps.count(sym)
+           && !contains_statement(node->stmt().get(),
+                                  ASTNode::return_statement_node, nullptr,
+                                  true);
+}
+void
+ArticTranspiler::transpile_loop_statement(ASTloop_statement* node)
+{
+    // Artic binds 'break' and 'continue' per loop, so they are renamed
+    // after the loop they belong to before nested loops shadow them.
+    std::string id    = std::to_string(next_loop++);
+    bool has_break    = contains_statement(node->stmt().get(),
+                                           ASTNode::loopmod_statement_node,
+                                           "break", false);
+    bool has_continue = contains_statement(node->stmt().get(),
+                                           ASTNode::loopmod_statement_node,
+                                           "continue", false);
+    loop_break.push_back("break_" + id);
+    loop_continue.push_back("continue_" + id);
+
+    if (constant_trip_loop(node)) {
+        // A range loop over bounds known up front, which partial
+        // evaluation unrolls completely.
+        auto decl = (ASTvariable_declaration*)node->init().get();
+        auto test = (ASTbinary_expression*)node->cond().get();
+        source->add_source_with_indent("for ", decl->name().string(),
+                                       " in unroll(");
+        dispatch_value(decl->init(), false);
+        source->add_source(", ");
+        dispatch_value(test->right(), false);
+        source->add_source(strcmp(test->opname(), "<=") ? "" : " + 1",
+                           ") {\n");
+        source->push_indent();
+        if (has_break) {
+            source->add_source_with_indent("let break_", id, " = break;\n");
+        }
+        if (has_continue) {
+            source->add_source_with_indent("let continue_", id,
+                                           " = continue;\n");
+        }
+        transpile_statement_list(node->stmt());
         source->pop_indent();
         source->add_source_with_indent("}\n");
-        break;
-    case ASTloop_statement::LoopWhile:
+    } else {
+        // The body of a loop with a 'continue' runs inside a one-shot
+        // inner loop whose break is the OSL 'continue', so that the step
+        // and the do-while test still run after it.
+        auto type = node->get_looptype();
+        if (type == ASTloop_statement::LoopFor) {
+            source->add_source_with_indent("{\n");
+            source->push_indent();
+            transpile_statement_list(node->init());
+        }
+        source->add_source_with_indent("while ");
+        if (type == ASTloop_statement::LoopDo || !node->cond()) {
+            source->add_source("true");
+        } else {
+            transpile_condition(node->cond());
+        }
+        source->add_source(" {\n");
+        source->push_indent();
+        if (has_break) {
+            source->add_source_with_indent("let break_", id, " = break;\n");
+        }
+        if (has_continue) {
+            source->add_source_with_indent("while true {\n");
+            source->push_indent();
+            source->add_source_with_indent("let continue_", id,
+                                           " = break;\n");
+        }
+        transpile_statement_list(node->stmt());
+        if (has_continue) {
+            source->add_source_with_indent("break()\n");
+            source->pop_indent();
+            source->add_source_with_indent("}\n");
+        }
+        if (type == ASTloop_statement::LoopFor) {
+            transpile_statement_list(node->iter());
+        }
+        if (type == ASTloop_statement::LoopDo) {
+            source->add_source_with_indent("if !(");
+            transpile_condition(node->cond());
+            source->add_source(") { break() }\n");
+        }
         source->pop_indent();
         source->add_source_with_indent("}\n");
-        break;
-    case ASTloop_statement::LoopDo:
-        dispatch_node(node->cond());
-        source->pop_indent();
-        source->add_source_with_indent("}){}\n");
-        break;
+        if (type == ASTloop_statement::LoopFor) {
+            source->pop_indent();
+            source->add_source_with_indent("}\n");
+        }
     }
+
+    loop_break.pop_back();
+    loop_continue.pop_back();
 }
 void
 ArticTranspiler::transpile_loopmod_statement(ASTloopmod_statement* node)
 {
-    NOT_IMPLEMENTED;
+    source->add_source(!strcmp(node->opname(), "break") ? loop_break.back()
+                                                         : loop_continue.back(),
+                       "()");
 }
 void
 ArticTranspiler::transpile_return_statement(ASTreturn_statement* node)
 {
     source->add_source("return(");
-    dispatch_node(node->expr());
+    dispatch_value(node->expr(), false);
     source->add_source(")");
 }
 void
@@ -629,25 +1613,44 @@ ArticTranspiler::transpile_binary_expression(ASTbinary_expression* node)
     auto right = node->right();
     if (node->is_boolean_operator()) {
         source->add_source("(");
-        dispatch_node(left);
+        dispatch_value(left, false);
         source->add_source(") ", node->opname(), " (");
-        dispatch_node(right);
+        dispatch_value(right, false);
+        source->add_source(")");
+    } else if (has_derivs(node)) {
+        source->add_source("ops_", artic_dual_string(left->typespec()), "().",
+                           node->opword(), "_",
+                           artic_dual_string(right->typespec()), "(");
+        dispatch_value(left, true);
+        source->add_source(", ");
+        dispatch_value(right, true);
         source->add_source(")");
     } else {
         source->add_source(
             "ops_", artic_type_string_to_string(get_artic_type_string(left)),
             "().", node->opword(), "_", get_artic_type_string(right), "(");
-        dispatch_node(left);
+        dispatch_value(left, false);
         source->add_source(", ");
-        dispatch_node(right);
+        dispatch_value(right, false);
         source->add_source(")");
     }
 }
 void
 ArticTranspiler::transpile_unary_expression(ASTunary_expression* node)
 {
+    if (has_derivs(node)) {
+        if (std::string(node->opword()) == "neg") {
+            source->add_source("neg_", artic_dual_string(node->typespec()),
+                               "(");
+        } else {
+            source->add_source("(");
+        }
+        dispatch_node(node->expr());
+        source->add_source(")");
+        return;
+    }
     source->add_source(node->opname(), "(");
-    dispatch_node(node->expr());
+    dispatch_value(node->expr(), false);
     source->add_source(")");
 }
 void
@@ -663,17 +1666,24 @@ ArticTranspiler::transpile_assign_expression(ASTassign_expression* node)
     dispatch_node(node->var());
     source->add_source(" = ");
 
+    bool dual = has_derivs(node->var().get());
     if (node->expr()->nodetype() == ASTNode::NodeType::literal_node) {
         auto lit = new ASTtype_constructor(node->typespec(), node->expr().get());
-        dispatch_node(lit);
+        dispatch_value(lit, dual);
         //delete lit;
     } else {
         if(node->typespec() != node->expr()->typespec()){
-            source->add_source("(");
-            dispatch_node(node->expr());
-            source->add_source(") as ", get_artic_type_string(node));
+            if (dual) {
+                auto cons = new ASTtype_constructor(node->typespec(),
+                                                    node->expr().get());
+                dispatch_value(cons, true);
+            } else {
+                source->add_source("(");
+                dispatch_value(node->expr(), false);
+                source->add_source(") as ", get_artic_type_string(node));
+            }
         } else {
-            dispatch_node(node->expr());
+            dispatch_value(node->expr(), dual);
         }
 
     }
@@ -684,12 +1694,13 @@ ArticTranspiler::transpile_assign_expression(ASTassign_expression* node)
 void
 ArticTranspiler::transpile_ternary_expression(ASTternary_expression* node)
 {
+    bool dual = has_derivs(node);
     source->add_source("if (");
-    dispatch_node(node->cond());
+    dispatch_value(node->cond(), false);
     source->add_source(") {");
-    dispatch_node(node->trueexpr());
+    dispatch_value(node->trueexpr(), dual);
     source->add_source("} else {");
-    dispatch_node(node->falseexpr());
+    dispatch_value(node->falseexpr(), dual);
     source->add_source("}");
 }
 
@@ -703,7 +1714,7 @@ ArticTranspiler::transpile_typecast_expression(ASTtypecast_expression* node)
 {
     source->add_source("ops_", get_artic_type_string(node->expr()), "().as_",
                        get_artic_type_string(node), "(");
-    dispatch_node(node->expr());
+    dispatch_value(node->expr(), false);
     source->add_source(")");
 }
 void
@@ -713,6 +1724,18 @@ ArticTranspiler::transpile_type_constructor(ASTtype_constructor* node)
         && !node->args()->next()) {  // copy-constructor
         dispatch_node(node->args());
         return;
+    } else if (has_derivs(node)) {  // triple with derivs from floats
+        ASTNode* x = node->args().get();
+        ASTNode* y = x->nextptr() ? x->nextptr() : x;
+        ASTNode* z = x->nextptr() ? y->nextptr() : x;
+        source->add_source("make_Dual2_Vector_f32(");
+        dispatch_value(x, true);
+        source->add_source(", ");
+        dispatch_value(y, true);
+        source->add_source(", ");
+        dispatch_value(z, true);
+        source->add_source(")");
+        return;
     } else if (node->typespec().is_float()
                || node->typespec()
                       .is_int()) {
@@ -720,14 +1743,42 @@ ArticTranspiler::transpile_type_constructor(ASTtype_constructor* node)
             dispatch_node(node->args()); // initializing trivially with literal
         } else {
             source->add_source("(");
-            dispatch_node(node->args());
+            dispatch_value(node->args(), false);
             source->add_source(") as ", get_artic_type_string(node));
         }
 
         return;
     } else if (node->typespec().is_closure()
                && node->args()->typespec().is_int()) {
-        source->add_source("EMPTY_CLOSURE");
+        source->add_source("empty_closure()");
+        return;
+    } else if (node->typespec().is_matrix()) {
+        // matrix(f), matrix(m00, ..., m33) and their forms naming a
+        // coordinate system are std library calls, mangled like builtins.
+        source->add_source("matrix");
+        for (ASTNode::ref arg = node->args(); arg; arg = arg->next())
+            source->add_source("_", get_artic_type_string(arg));
+        source->add_source("__Matrix(");
+        for (ASTNode::ref arg = node->args(); arg; arg = arg->next()) {
+            dispatch_value(arg, false);
+            source->add_source(", ");
+        }
+        emit_shaderinout_constructor();
+        source->add_source(")");
+        return;
+    } else if (node->typespec().is_color()
+               && node->args()->typespec().is_string()) {
+        // So is color(space, r, g, b), which converts from the space.
+        source->add_source("color");
+        for (ASTNode::ref arg = node->args(); arg; arg = arg->next())
+            source->add_source("_", get_artic_type_string(arg));
+        source->add_source("__Vector(");
+        for (ASTNode::ref arg = node->args(); arg; arg = arg->next()) {
+            dispatch_value(arg, false);
+            source->add_source(", ");
+        }
+        emit_shaderinout_constructor();
+        source->add_source(")");
         return;
     }
 
@@ -761,7 +1812,7 @@ ArticTranspiler::dispath_constructor_argument(TypeSpec ts, ASTNode::ref arg,
                                               int i)
 {
     if (ts.is_triple()) {
-        dispatch_node(arg);
+        dispatch_value(arg, false);
     } else if (ts.is_structure()) {
         auto fs   = ts.structspec()->field(i).type;
         auto cons = ASTtype_constructor(fs, arg.get());
@@ -779,32 +1830,64 @@ ArticTranspiler::transpile_function_call(ASTfunction_call* node)
         auto constructor = ASTtype_constructor(node);
         transpile_type_constructor(&constructor);
     } else {
+        // Dual2 builtins get all their numeric arguments as duals, the
+        // derivative builtins get whatever their argument carries, and
+        // everything else only sees plain values.
+        bool dual_call  = has_derivs(node);
+        bool deriv_call = !node->is_user_function()
+                          && is_derivative_builtin(ustring(node->opname()));
         std::vector<ASTNode::ref> args = {};
+        std::vector<bool> dual_args    = {};
         auto arg_node                  = node->args();
         source->add_source(node->opname());
         while (arg_node) {
+            bool dual = dual_call ? is_dual_capable(arg_node->typespec())
+                                  : deriv_call && has_derivs(arg_node.get());
             args.push_back(arg_node);
-            source->add_source("_", get_artic_type_string(arg_node));
+            dual_args.push_back(dual);
+            source->add_source("_", dual ? artic_dual_string(arg_node->typespec())
+                                         : get_artic_type_string(arg_node));
             arg_node = arg_node->next();
         }
-        source->add_source("__", get_artic_type_string(node), "(");
+        // Void results are mangled as "void", as the Artic backend does.
+        source->add_source("__",
+                           node->typespec().is_void()
+                               ? std::string("void")
+                           : dual_call ? artic_dual_string(node->typespec())
+                                       : get_artic_type_string(node),
+                           "(");
 
         auto func_node                   = node->user_function();
         ASTvariable_declaration* argnode = nullptr;
         if (func_node) {
             argnode = (ASTvariable_declaration*)func_node->formals().get();
         }
-        for (auto arg : args) {
+        int first_arg = node->typespec().is_void() ? 0 : 1;
+        for (size_t i = 0; i < args.size(); ++i) {
+            auto arg = args[i];
+            bool output = false;
+            bool by_ref = false;
             if (argnode) {
-                if (argnode->is_output()) {
-                    source->add_source("&mut ");
-                }
+                output = by_ref = argnode->is_output();
                 argnode = (ASTvariable_declaration*)argnode->next().get();
+            } else if (!func_node) {
+                // Builtins that write an argument (getattribute,
+                // getmessage, getmatrix, ...) take it by reference.
+                by_ref = node->argwrite(first_arg + int(i));
             }
-            if(arg->typespec().is_array()) {
+            if (by_ref)
+                source->add_source("&mut ");
+            // Written builtin arrays are passed like the backend does.
+            if (arg->typespec().is_array() && (output || !by_ref))
                 source->add_source("&");
+            if (output && has_derivs(arg.get())) {
+                // derivatives of output arguments are not tracked through
+                // user functions
+                dispatch_node(arg);
+                source->add_source(".val");
+            } else {
+                dispatch_value(arg, dual_args[i]);
             }
-            dispatch_node(arg);
             source->add_source(", ");
             if(arg->typespec().is_array()) {
                 source->add_source("||{", std::to_string(get_array_size(arg)), "}, ");
@@ -823,11 +1906,7 @@ ArticTranspiler::transpile_literal_node(ASTliteral* node)
         source->add_source(std::to_string(node->floatval()));
     } else if (node->typespec().is_string()) {
         add_string_constant(node->strval());
-        std::string sval = node->strval();
-        if (sval.empty()) {
-            sval = "empty_string";
-        }
-        source->add_source("String::", sval);
+        source->add_source(artic_string_hash(node->strval()));
     } else {
         NOT_IMPLEMENTED;
     }
@@ -877,45 +1956,616 @@ ArticTranspiler::generate_struct_definition(TypeSpec typeSpec)
         source->add_source_with_indent("}\n\n");
     }
 }
+// The shader_inout globals, in declaration order.  dx/dy name the
+// shader_inout fields holding the derivatives, if the renderer supplies them.
+struct ArticGlobal {
+    const char* name;
+    const char* type;
+    bool writable;
+    const char* dx;
+    const char* dy;
+};
+
+static const ArticGlobal artic_globals[] = {
+    { "P", "Vector", true, "dPdx", "dPdy" },
+    { "I", "Vector", false, "dIdx", "dIdy" },
+    { "N", "Vector", true, nullptr, nullptr },
+    { "Ng", "Vector", false, nullptr, nullptr },
+    { "dPdu", "Vector", false, nullptr, nullptr },
+    { "dPdv", "Vector", false, nullptr, nullptr },
+    { "Ps", "Vector", false, nullptr, nullptr },
+    { "u", "f32", false, "dudx", "dudy" },
+    { "v", "f32", false, "dvdx", "dvdy" },
+    { "time", "f32", false, nullptr, nullptr },
+    { "dtime", "f32", false, nullptr, nullptr },
+    { "dPdtime", "Vector", false, nullptr, nullptr },
+    { "Ci", "Closure", true, nullptr, nullptr },
+};
+
+static const char* artic_global_derivs[] = { "dPdx", "dPdy", "dIdx", "dIdy",
+                                             "dudx", "dudy", "dvdx", "dvdy" };
+
 void
-ArticTranspiler::emit_shaderinout_copy()
+ArticTranspiler::emit_shaderinout_copy(bool with_derivs)
 {
-    source->add_source_with_indent("let mut P = inout.P;\n");
-    source->add_source_with_indent("let I = inout.I;\n");
-    source->add_source_with_indent("let mut N = inout.N;\n");
-    source->add_source_with_indent("let Ng = inout.Ng;\n");
-    source->add_source_with_indent("let dPdu = inout.dPdu;\n");
-    source->add_source_with_indent("let dPdv = inout.dPdv;\n");
-    source->add_source_with_indent("let Ps = inout.Ps;\n");
-    source->add_source_with_indent("let u = inout.u;\n");
-    source->add_source_with_indent("let v = inout.v;\n");
-    source->add_source_with_indent("let time = inout.time;\n");
-    source->add_source_with_indent("let dtime = inout.dtime;\n");
-    source->add_source_with_indent("let dPdtime = inout.dPdtime;\n");
-    source->add_source_with_indent("let mut Ci = inout.Ci;\n");
+    for (auto& g : artic_globals) {
+        source->add_source_with_indent("let ", g.writable ? "mut " : "",
+                                       g.name, " = ");
+        if (with_derivs && deriv_globals.count(g.name)) {
+            if (g.dx) {
+                source->add_source("Dual2_", g.type, "{ val = inout.", g.name,
+                                   ", dx = inout.", g.dx, ", dy = inout.",
+                                   g.dy, " };\n");
+            } else {
+                source->add_source("make_Dual2_", g.type, "(inout.", g.name,
+                                   ");\n");
+            }
+        } else {
+            source->add_source("inout.", g.name, ";\n");
+        }
+    }
 }
 void
 ArticTranspiler::emit_shaderinout_constructor()
 {
     source->add_source("shader_inout {\n");
     source->push_indent();
-    source->add_source_with_indent("P = P,\n");
-    source->add_source_with_indent("I = I,\n");
-    source->add_source_with_indent("N = N,\n");
-    source->add_source_with_indent("Ng = Ng,\n");
-    source->add_source_with_indent("dPdu = dPdu,\n");
-    source->add_source_with_indent("dPdv = dPdv,\n");
-    source->add_source_with_indent("Ps = Ps,\n");
-    source->add_source_with_indent("u = u,\n");
-    source->add_source_with_indent("v = v,\n");
-    source->add_source_with_indent("time = time,\n");
-    source->add_source_with_indent("dtime = dtime,\n");
-    source->add_source_with_indent("dPdtime = dPdtime,\n");
-    source->add_source_with_indent("Ci = Ci,\n");
+    for (auto& g : artic_globals) {
+        bool dual = emit_derivs && deriv_globals.count(g.name);
+        source->add_source_with_indent(g.name, " = ", g.name,
+                                       dual ? ".val" : "", ",\n");
+    }
+    for (auto d : artic_global_derivs) {
+        source->add_source_with_indent(d, " = inout.", d, ",\n");
+    }
+    source->add_source_with_indent("shaderglobals = inout.shaderglobals,\n");
     source->pop_indent();
     source->add_source_with_indent("}");
 }
 
 
 
+void
+ArticTranspiler::emit_batch_entry(
+    const std::string& shadername,
+    const std::vector<ASTvariable_declaration*>& outputs)
+{
+    // Closures are handed to the renderer one point at a time, through
+    // closure_sink, so closure outputs get no SoA array: only Ci reaches
+    // the renderer, like for the scalar entry.
+    source->add_source_with_indent("struct ", shadername, "_out_soa {\n");
+    source->push_indent();
+    for (auto v : outputs) {
+        if (!v->typespec().is_closure()) {
+            source->add_source_with_indent(v->name().string(), ": ",
+                                           artic_soa_string(v->typespec()),
+                                           ",\n");
+        }
+    }
+    source->pop_indent();
+    source->add_source_with_indent("}\n\n");
+
+    source->add_source_with_indent("fn @", shadername,
+                                   "_batch(count: i32, globals: shader_inout_soa, outputs: ",
+                                   shadername,
+                                   "_out_soa, closure_sink: fn(i32, Closure) -> ()) -> () {\n");
+    source->push_indent();
+    source->add_source_with_indent("shade_batch(", std::to_string(vector_width),
+                                   ", count, |i| {\n");
+    source->push_indent();
+    source->add_source_with_indent("let inout = load_shader_inout(globals, i);\n");
+    source->add_source_with_indent("let (out, result) = ", shadername, "_impl(make_",
+                                   shadername, "_in(inout), inout);\n");
+    for (auto v : outputs) {
+        if (v->typespec().is_closure()) {
+            continue;
+        }
+        if (v->typespec().is_triple()) {
+            source->add_source_with_indent("store_Vector_soa(outputs.",
+                                           v->name().string(), ", i, out.",
+                                           v->name().string(), ");\n");
+        } else {
+            source->add_source_with_indent("outputs.", v->name().string(),
+                                           "(i) = out.", v->name().string(),
+                                           ";\n");
+        }
+    }
+    emit_globals_store(false);
+    source->add_source_with_indent("closure_sink(i, result.Ci);\n");
+    source->pop_indent();
+    source->add_source_with_indent("})\n");
+    source->pop_indent();
+    source->add_source_with_indent("}\n\n");
+}
+
+void
+ArticTranspiler::emit_globals_store(bool requested_only)
+{
+    // Of the globals in shader_inout_soa only P and N can be written.
+    for (const char* g : { "P", "N" }) {
+        if (written_globals.count(g)
+            && (!requested_only || requested_outputs.count(g))) {
+            source->add_source_with_indent("store_Vector_soa(globals.", g,
+                                           ", i, result.", g, ");\n");
+        }
+    }
+}
+
+void
+ArticTranspiler::emit_requested_batch_entry(
+    const std::string& shadername,
+    const std::vector<ASTvariable_declaration*>& outputs)
+{
+    // Like <shader>_batch, for the requested outputs only: AOV passes
+    // that need one output don't pay for the rest of the shader.
+    source->add_source_with_indent("struct ", shadername,
+                                   "_requested_soa {\n");
+    source->push_indent();
+    for (auto v : outputs) {
+        if (!v->typespec().is_closure()
+            && requested_outputs.count(v->name().string())) {
+            source->add_source_with_indent(v->name().string(), ": ",
+                                           artic_soa_string(v->typespec()),
+                                           ",\n");
+        }
+    }
+    source->pop_indent();
+    source->add_source_with_indent("}\n\n");
+
+    source->add_source_with_indent("fn @", shadername,
+                                   "_requested_batch(count: i32, globals: shader_inout_soa, outputs: ",
+                                   shadername,
+                                   "_requested_soa, closure_sink: fn(i32, Closure) -> ()) -> () {\n");
+    source->push_indent();
+    source->add_source_with_indent("shade_batch(", std::to_string(vector_width),
+                                   ", count, |i| {\n");
+    source->push_indent();
+    source->add_source_with_indent("let inout = load_shader_inout(globals, i);\n");
+    source->add_source_with_indent("let (out, result) = ", shadername,
+                                   "_requested_impl(make_", shadername,
+                                   "_in(inout), inout);\n");
+    for (auto v : outputs) {
+        if (v->typespec().is_closure()
+            || !requested_outputs.count(v->name().string())) {
+            continue;
+        }
+        if (v->typespec().is_triple()) {
+            source->add_source_with_indent("store_Vector_soa(outputs.",
+                                           v->name().string(), ", i, out.",
+                                           v->name().string(), ");\n");
+        } else {
+            source->add_source_with_indent("outputs.", v->name().string(),
+                                           "(i) = out.", v->name().string(),
+                                           ";\n");
+        }
+    }
+    emit_globals_store(true);
+    if (requested_outputs.count("Ci")) {
+        source->add_source_with_indent("closure_sink(i, result.Ci);\n");
+    }
+    source->pop_indent();
+    source->add_source_with_indent("})\n");
+    source->pop_indent();
+    source->add_source_with_indent("}\n\n");
+}
+
+void
+ArticTranspiler::emit_shade_entry(const std::string& shadername)
+{
+    // One point at a time with the default parameter values, for renderers
+    // that link the compiled shaders and evaluate Ci through the
+    // osl_artic_closure_* entry points.
+    source->add_source_with_indent("#[export]\n");
+    source->add_source_with_indent("fn ", shadername,
+                                   "_shade(sg: &mut ShaderGlobals, ci: &mut Closure) -> () {\n");
+    source->push_indent();
+    source->add_source_with_indent("let inout = load_shader_globals(sg);\n");
+    source->add_source_with_indent("let (_out, result) = ", shadername,
+                                   "_impl(make_", shadername,
+                                   "_in(inout), inout);\n");
+    source->add_source_with_indent("store_shader_globals(sg, result);\n");
+    source->add_source_with_indent("*ci = result.Ci;\n");
+    source->pop_indent();
+    source->add_source_with_indent("}\n\n");
+}
+
+void
+ArticTranspiler::emit_strings_entry(const std::string& shadername)
+{
+    // String literals are written as their hashes; renderers call this
+    // once after loading the compiled shaders so the operations that need
+    // the characters can find them.
+    std::vector<std::string> strings(const_strings.begin(),
+                                     const_strings.end());
+    std::sort(strings.begin(), strings.end());
+    source->add_source_with_indent("#[export]\n");
+    source->add_source_with_indent("fn ", shadername,
+                                   "_load_strings() -> () {\n");
+    source->push_indent();
+    for (auto& str : strings) {
+        if (!str.empty()) {
+            source->add_source_with_indent("string_intern(",
+                                           artic_string_literal(str), ");\n");
+        }
+    }
+    source->pop_indent();
+    source->add_source_with_indent("}\n\n");
+}
+
+// Artic wants a decimal point (or exponent) in every float literal.
+static std::string
+artic_float_literal(string_view value)
+{
+    std::string f(value);
+    if (f.find_first_of(".eEn") == std::string::npos) {
+        f += ".0";
+    } else if (f.find('.') == std::string::npos) {
+        size_t e = f.find_first_of("eE");
+        if (e != std::string::npos) {
+            f.insert(e, ".0");
+        }
+    }
+    return f;
+}
+
+
+
+int
+ArticGroupFuser::find_layer(string_view layername) const
+{
+    for (int i = int(layers.size()) - 1; i >= 0; --i) {
+        if (layers[i].layername == layername) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+
+bool
+ArticGroupFuser::parse(string_view groupspec, std::string& errdesc)
+{
+    using OIIO::Strutil::parse_char;
+    using OIIO::Strutil::parse_identifier;
+    using OIIO::Strutil::parse_until;
+    using OIIO::Strutil::parse_word;
+    using OIIO::Strutil::skip_whitespace;
+
+    layers.clear();
+    std::vector<Param> pending_params;
+    string_view p = groupspec;  // parse view
+    while (p.size()) {
+        skip_whitespace(p);
+        if (!p.size()) {
+            break;
+        }
+        while (parse_char(p, ';'))  // skip blank statements
+            ;
+        string_view keyword = parse_word(p);
+
+        if (keyword == "shader") {
+            Layer layer;
+            layer.shadername = std::string(parse_identifier(p));
+            skip_whitespace(p);
+            layer.layername = std::string(parse_until(p, " \t\r\n,;"));
+            if (layer.layername.empty()) {
+                layer.layername = OIIO::Strutil::sprintf("%s_%d",
+                                                         layer.shadername,
+                                                         layers.size());
+            }
+            layer.params = std::move(pending_params);
+            pending_params.clear();
+            layers.push_back(std::move(layer));
+        } else if (keyword == "connect") {
+            skip_whitespace(p);
+            string_view lay1 = parse_until(p, " \t\r\n.");
+            parse_char(p, '.');
+            string_view param1 = parse_until(p, " \t\r\n,;");
+            skip_whitespace(p);
+            string_view lay2 = parse_until(p, " \t\r\n.");
+            parse_char(p, '.');
+            string_view param2 = parse_until(p, " \t\r\n,;");
+            int src = find_layer(lay1);
+            int dst = find_layer(lay2);
+            if (src < 0 || dst < 0 || src >= dst) {
+                errdesc = OIIO::Strutil::sprintf(
+                    "Invalid connection %s.%s -> %s.%s", lay1, param1, lay2,
+                    param2);
+                return false;
+            }
+            if (param1.find('[') != string_view::npos
+                || param2.find('[') != string_view::npos) {
+                errdesc = OIIO::Strutil::sprintf(
+                    "Component connections are not supported for Artic: "
+                    "%s.%s -> %s.%s",
+                    lay1, param1, lay2, param2);
+                return false;
+            }
+            layers[dst].connections.push_back(
+                { src, std::string(param1), std::string(param2) });
+        } else {
+            Param param;
+            param.type = std::string((keyword == "param") ? parse_word(p)
+                                                          : keyword);
+            param.arraylen = 0;
+            if (parse_char(p, '[')) {
+                param.arraylen = -1;
+                OIIO::Strutil::parse_int(p, param.arraylen);
+                parse_char(p, ']');
+            }
+            param.name = std::string(parse_identifier(p));
+            while (parse_char(p, '.')) {  // struct field
+                param.name += "." + std::string(parse_identifier(p));
+            }
+            if (param.type.empty() || param.name.empty()) {
+                errdesc = OIIO::Strutil::sprintf("Unknown statement: \"%s\"",
+                                                 keyword);
+                return false;
+            }
+            if (!artic_param_bakeable(param.type)) {
+                errdesc = OIIO::Strutil::sprintf(
+                    "Parameters of type %s are not supported for Artic: %s",
+                    param.type, param.name);
+                return false;
+            }
+            while (1) {
+                skip_whitespace(p);
+                if (!p.size() || p[0] == ';' || p[0] == ',') {
+                    break;
+                }
+                if (OIIO::Strutil::parse_prefix(p, "[[")) {
+                    // skip metadata, such as lockgeom
+                    parse_until(p, "]");
+                    OIIO::Strutil::parse_prefix(p, "]]");
+                    continue;
+                }
+                string_view value;
+                if (p[0] == '\"') {
+                    if (!OIIO::Strutil::parse_string(p, value)) {
+                        break;
+                    }
+                } else {
+                    value = parse_until(p, " \t\r\n;");
+                }
+                param.values.emplace_back(value);
+            }
+            pending_params.push_back(std::move(param));
+        }
+        parse_char(p, ';') || parse_char(p, ',');
+    }
+    if (layers.empty()) {
+        errdesc = "No shader layers in group";
+        return false;
+    }
+    return true;
+}
+
+
+
+std::string
+artic_string_hash(string_view str)
+{
+    if (str.empty())
+        return "0";
+    std::string literal = Strutil::sprintf(
+        "0x%016llx", (unsigned long long)UStringHash::Hash(std::string(str).c_str()));
+    bool printable = str.find("*/") == string_view::npos
+                     && std::all_of(str.begin(), str.end(), [](char c) {
+                            return isprint((unsigned char)c);
+                        });
+    if (printable)
+        literal += " /* \"" + std::string(str) + "\" */";
+    return literal;
+}
+
+
+
+std::string
+artic_string_literal(string_view str)
+{
+    std::string literal = "\"";
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            literal += '\\';
+        literal += c;
+    }
+    return literal + "\"";
+}
+
+
+
+std::string
+artic_param_typename(const TypeSpec& typespec)
+{
+    if (typespec.is_closure_based() || typespec.is_structure_based())
+        return std::string();
+    TypeSpec elem = typespec.elementtype();
+    if (elem.is_float())
+        return "float";
+    if (elem.is_int())
+        return "int";
+    if (elem.is_string())
+        return "string";
+    if (elem.is_matrix())
+        return "matrix";
+    if (elem.is_triple())
+        return "color";
+    return std::string();
+}
+
+
+
+bool
+artic_param_bakeable(string_view type)
+{
+    return type == "float" || type == "int" || type == "color"
+           || type == "point" || type == "vector" || type == "normal"
+           || type == "matrix" || type == "string";
+}
+
+
+
+std::string
+artic_param_literal(const std::string& type, bool is_array,
+                    const std::vector<std::string>& values)
+{
+    size_t aggregate = 1;
+    if (type == "color" || type == "point" || type == "vector"
+        || type == "normal") {
+        aggregate = 3;
+    } else if (type == "matrix") {
+        aggregate = 16;
+    }
+    size_t nelements = std::max(size_t(1), values.size() / aggregate);
+    std::string literal;
+    if (is_array) {
+        literal += "[";
+    }
+    for (size_t e = 0; e < nelements; ++e) {
+        auto value = [&](size_t i) {
+            size_t v = e * aggregate + i;
+            return v < values.size() ? values[v] : std::string("0");
+        };
+        if (type == "float") {
+            literal += artic_float_literal(value(0));
+        } else if (type == "int") {
+            literal += value(0);
+        } else if (type == "string") {
+            literal += artic_string_hash(value(0));
+        } else if (aggregate == 3) {
+            literal += "make_vector(" + artic_float_literal(value(0)) + ", "
+                       + artic_float_literal(value(1)) + ", "
+                       + artic_float_literal(value(2)) + ")";
+        } else {
+            literal += "Matrix{";
+            for (size_t i = 0; i < 16; ++i) {
+                literal += "m" + std::to_string(i / 4 + 1) + "_n"
+                           + std::to_string(i % 4 + 1) + " = "
+                           + artic_float_literal(value(i)) + ", ";
+            }
+            literal += "}";
+        }
+        if (is_array) {
+            literal += ", ";
+        }
+    }
+    if (is_array) {
+        literal += "]";
+    }
+    return literal;
+}
+
+
+
+void
+ArticGroupFuser::emit(const std::string& groupname)
+{
+    // Like lazy layer evaluation, only layers that feed the last layer
+    // (directly or indirectly) are run at all.
+    int nlayers = int(layers.size());
+    std::vector<bool> needed(nlayers, false);
+    needed[nlayers - 1] = true;
+    for (int i = nlayers - 1; i >= 0; --i) {
+        if (needed[i]) {
+            for (auto& c : layers[i].connections) {
+                needed[c.srclayer] = true;
+            }
+        }
+    }
+
+    const Layer& last = layers[nlayers - 1];
+    source->add_source_with_indent("fn @", groupname,
+                                   "_impl(inout: shader_inout) -> (",
+                                   last.shadername, "_out, shader_inout) {\n");
+    source->push_indent();
+    source->add_source_with_indent("let globals_0 = inout;\n");
+    int globals = 0;
+    for (int i = 0; i < nlayers; ++i) {
+        if (!needed[i]) {
+            continue;
+        }
+        const Layer& layer = layers[i];
+        std::string layer_id = "layer" + std::to_string(i);
+        std::string inout    = "globals_" + std::to_string(globals);
+        source->add_source_with_indent("// ", layer.layername, " (",
+                                       layer.shadername, ")\n");
+        source->add_source_with_indent("let mut ", layer_id, "_in = make_",
+                                       layer.shadername, "_in(", inout,
+                                       ");\n");
+        for (auto& param : layer.params) {
+            source->add_source_with_indent(layer_id, "_in.", param.name,
+                                           " = ");
+            source->add_source(artic_param_literal(param.type,
+                                                   param.arraylen != 0,
+                                                   param.values),
+                               ";\n");
+        }
+        for (auto& c : layer.connections) {
+            source->add_source_with_indent(layer_id, "_in.", c.dstparam,
+                                           " = layer",
+                                           std::to_string(c.srclayer), "_out.",
+                                           c.srcparam, ";\n");
+        }
+        ++globals;
+        source->add_source_with_indent("let (", layer_id, "_out, globals_",
+                                       std::to_string(globals), ") = ",
+                                       layer.shadername, "_impl(", layer_id,
+                                       "_in, ", inout, ");\n");
+    }
+    source->add_source_with_indent("(layer", std::to_string(nlayers - 1),
+                                   "_out, globals_", std::to_string(globals),
+                                   ")\n");
+    source->pop_indent();
+    source->add_source_with_indent("}\n\n");
+
+    // Same signature as the <shader>_shade entries, so a renderer can bind
+    // a fused group in place of its last layer.
+    source->add_source_with_indent("#[export]\n");
+    source->add_source_with_indent("fn ", groupname,
+                                   "_shade(sg: &mut ShaderGlobals, ci: &mut Closure) -> () {\n");
+    source->push_indent();
+    source->add_source_with_indent("let (_out, result) = ", groupname,
+                                   "_impl(load_shader_globals(sg));\n");
+    source->add_source_with_indent("store_shader_globals(sg, result);\n");
+    source->add_source_with_indent("*ci = result.Ci;\n");
+    source->pop_indent();
+    source->add_source_with_indent("}\n\n");
+
+    // The literals of the inlined shaders, and the string values baked
+    // into the layer parameters.
+    source->add_source_with_indent("#[export]\n");
+    source->add_source_with_indent("fn ", groupname,
+                                   "_load_strings() -> () {\n");
+    source->push_indent();
+    std::vector<std::string> shaders;
+    for (int i = 0; i < nlayers; ++i) {
+        if (!needed[i]) {
+            continue;
+        }
+        const Layer& layer = layers[i];
+        if (std::find(shaders.begin(), shaders.end(), layer.shadername)
+            == shaders.end()) {
+            shaders.push_back(layer.shadername);
+            source->add_source_with_indent(layer.shadername,
+                                           "_load_strings();\n");
+        }
+        for (auto& param : layer.params) {
+            if (param.type != "string") {
+                continue;
+            }
+            for (auto& value : param.values) {
+                if (!value.empty()) {
+                    source->add_source_with_indent(
+                        "string_intern(", artic_string_literal(value), ");\n");
+                }
+            }
+        }
+    }
+    source->pop_indent();
+    source->add_source_with_indent("}\n\n");
+}
+
+
+
 OSL_NAMESPACE_EXIT
\ No newline at end of file
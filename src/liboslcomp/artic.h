@@ -6,9 +6,11 @@
 #define OSL_ARTIC_H
 
 #include <iostream>
+#include <map>
 #include <string>
 #include <utility>
 #include "ast.h"
+#include <unordered_map>
 #include <unordered_set>
 
 OSL_NAMESPACE_ENTER
@@ -39,6 +41,38 @@ get_artic_type_string(ASTNode::ref node);
 const std::string
 artic_simpletype(TypeDesc typedesc);
 
+const std::string
+artic_soa_string(TypeSpec typeSpec);
+
+const std::string
+artic_dual_string(TypeSpec typeSpec);
+
+/// Can artic_param_literal write values of the named parameter type
+/// ("float", "color", ...) as a literal?
+bool
+artic_param_bakeable(string_view type);
+
+/// Artic literal for a parameter value given as the whitespace-separated
+/// tokens of a serialized group ("float", "color", "string", ...).
+std::string
+artic_param_literal(const std::string& type, bool is_array,
+                    const std::vector<std::string>& values);
+
+/// Artic literal for a string: its hash, the same as ustring::hash() and
+/// UStringHash::Hash, which is how Artic shaders carry strings (see
+/// anyosl_string.art).  The characters follow in a comment.
+std::string
+artic_string_hash(string_view str);
+
+/// Artic string literal (a NUL-terminated &[u8]) holding str.
+std::string
+artic_string_literal(string_view str);
+
+/// Type name accepted by artic_param_literal for a shader parameter, or
+/// an empty string if values of that type can't be baked.
+std::string
+artic_param_typename(const TypeSpec& typespec);
+
 
 class ArticSource {
 public:
@@ -72,6 +106,28 @@ private:
 };
 
 
+
+template<typename... Args>
+void
+ArticSource::add_source_with_indent(const std::string& code, Args... args)
+{
+    for (int i = 0; i < m_indent; i++) {
+        m_code += m_indent_string;
+    }
+    add_source(code, args...);
+}
+
+
+
+template<typename... Args>
+void
+ArticSource::add_source(const std::string& code, Args... args)
+{
+    m_code += code;
+    add_source(args...);
+}
+
+
 class ArticTranspiler {
 
 
@@ -80,11 +136,69 @@ public:
     ArticTranspiler(ArticSource* source, OSLCompiler* compiler) : source(source) {}
     void dispatch_node(ASTNode::ref);
     void generate_struct_definition(TypeSpec typeSpec);
+    void set_vector_width(int width) { vector_width = width; }
+
+    /// Instance values (whitespace-separated tokens, keyed by parameter
+    /// name) that are baked into the shader as compile-time constants.
+    void set_param_values(const std::map<std::string, std::string>& values)
+    {
+        param_values = values;
+    }
+
+    /// Outputs (output parameters, or the globals P, N and Ci) that the
+    /// extra <shader>_requested_batch entry computes and stores.  Empty
+    /// for no such entry.
+    void set_requested_outputs(const std::vector<std::string>& outputs)
+    {
+        requested_outputs.clear();
+        requested_outputs.insert(outputs.begin(), outputs.end());
+    }
 
 private:
 
     bool in_shader = false;
 
+    int vector_width = 8;
+
+    std::map<std::string, std::string> param_values = {};
+
+    bool is_baked_param(ASTvariable_declaration* v);
+
+    /// Output slicing for the requested outputs: the symbols they depend
+    /// on, found by mark_live_statements, and whether the statements
+    /// writing none of them are dropped while transpiling.
+    std::unordered_set<std::string> requested_outputs = {};
+    std::unordered_set<const Symbol*> live_symbols    = {};
+    bool slice_outputs                                = false;
+
+    bool is_live(const Symbol* sym);
+
+    bool is_dead_statement(ASTNode* node);
+
+    bool all_dead_statements(ASTNode* node);
+
+    bool mark_live_statements(ASTNode* node);
+
+    /// Names of the globals the shader body assigns.
+    std::unordered_set<std::string> written_globals = {};
+
+    /// Symbols of the shader body that carry derivatives, and the names
+    /// of the globals among them.  Only consulted while emit_derivs is set.
+    std::unordered_set<const Symbol*> deriv_symbols = {};
+    std::unordered_set<std::string> deriv_globals   = {};
+    bool emit_derivs                                = false;
+
+    typedef std::unordered_map<const Symbol*, std::unordered_set<const Symbol*>>
+        SymbolDependencies;
+
+    void compute_derivative_symbols(ASTshader_declaration* node);
+
+    void track_dependencies(ASTNode* node, SymbolDependencies& deps);
+
+    bool has_derivs(ASTNode* node);
+
+    void dispatch_value(ASTNode::ref node, bool as_dual);
+
     void transpile_shader_declaration(ASTshader_declaration* node);
 
     void transpile_function_declaration(ASTfunction_declaration* node);
@@ -103,8 +217,14 @@ private:
 
     void transpile_structureselection(ASTstructselect* node);
 
+    void transpile_condition(ASTNode::ref cond);
+
     void transpile_conditional_statement(ASTconditional_statement* node);
 
+    bool is_constant_bound(ASTNode* node);
+
+    bool constant_trip_loop(ASTloop_statement* node);
+
     void transpile_loop_statement(ASTloop_statement* node);
 
     void transpile_loopmod_statement(ASTloopmod_statement* node);
@@ -133,10 +253,28 @@ private:
 
     void dispath_constructor_argument(TypeSpec ts, ASTNode::ref arg, int i);
 
-    void emit_shaderinout_copy();
+    void emit_shaderinout_copy(bool with_derivs = false);
 
     void emit_shaderinout_constructor();
 
+    void emit_shader_impl(ASTshader_declaration* node,
+                          const std::string& suffix,
+                          const std::vector<ASTvariable_declaration*>& inputs,
+                          const std::vector<ASTvariable_declaration*>& outputs);
+
+    void emit_batch_entry(const std::string& shadername,
+                          const std::vector<ASTvariable_declaration*>& outputs);
+
+    void emit_requested_batch_entry(
+        const std::string& shadername,
+        const std::vector<ASTvariable_declaration*>& outputs);
+
+    void emit_globals_store(bool requested_only);
+
+    void emit_shade_entry(const std::string& shadername);
+
+    void emit_strings_entry(const std::string& shadername);
+
     std::string get_arg_name(TypeSpec typeSpec, int argnum);
 
     void add_string_constant(const std::string& s);
@@ -148,6 +286,59 @@ private:
     ArticSource* source;
 
     std::unordered_set<std::string> const_strings = {};
+
+    /// Names the 'break' and 'continue' of the enclosing loops are bound
+    /// to, innermost last.
+    std::vector<std::string> loop_break    = {};
+    std::vector<std::string> loop_continue = {};
+    int next_loop                          = 0;
+};
+
+/// A shader group, in the text form written by ShaderGroup::serialize()
+/// (and accepted by ShadingSystem::ShaderGroupBegin), fused into a single
+/// Artic function.  Each layer's shader must have been transpiled with
+/// `oslc -t artic` on its own; the fused function inlines the layers that
+/// the last layer depends on, in dependency order, and wires connections
+/// through plain locals so AnyDSL can optimize across layers and drop the
+/// outputs nobody reads.
+class ArticGroupFuser {
+public:
+    ArticGroupFuser(ArticSource* source) : source(source) {}
+
+    /// Parse a serialized group.  Return false and fill in errdesc if
+    /// it could not be understood.
+    bool parse(string_view groupspec, std::string& errdesc);
+
+    /// Emit `<groupname>_impl(inout: shader_inout)`, returning the last
+    /// layer's outputs and the resulting globals.
+    void emit(const std::string& groupname);
+
+private:
+    struct Param {
+        std::string type;
+        int arraylen;
+        std::string name;
+        std::vector<std::string> values;
+    };
+
+    struct Connection {
+        int srclayer;
+        std::string srcparam;
+        std::string dstparam;
+    };
+
+    struct Layer {
+        std::string shadername;
+        std::string layername;
+        std::vector<Param> params;
+        std::vector<Connection> connections;
+    };
+
+    int find_layer(string_view layername) const;
+
+    std::vector<Layer> layers = {};
+
+    ArticSource* source;
 };
 
 OSL_NAMESPACE_EXIT
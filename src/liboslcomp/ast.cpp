@@ -713,6 +713,14 @@ ASTpostincdec::childname(size_t i) const
 
 
 
+bool
+ASTpostincdec::is_increment() const
+{
+    return m_op == Incr;
+}
+
+
+
 ASTindex::ASTindex(OSLCompilerImpl* comp, ASTNode* expr, ASTNode* index,
                    ASTNode* index2, ASTNode* index3)
     : ASTNode(index_node, comp, 0, expr, index /*NO: index2, index3*/)
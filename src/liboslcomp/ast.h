@@ -600,6 +600,7 @@ public:
     TypeSpec typecheck(TypeSpec expected);
     Symbol* codegen(Symbol* dest = NULL);
 
+    bool is_increment() const;
     ref var() const { return child(0); }
 };
 
@@ -787,6 +788,19 @@ public:
         return func() ? (ASTfunction_declaration*)func()->node() : nullptr;
     }
 
+    /// Is the argument number 'arg' read by the op?
+    ///
+    bool argread(int arg) const;
+    /// Is the argument number 'arg' written by the op?
+    ///
+    bool argwrite(int arg) const;
+    /// Does the op take derivatives of argument number 'arg'?
+    ///
+    bool argtakesderivs(int arg) const
+    {
+        return (arg < 32) ? (m_argtakesderivs & (1 << arg)) != 0 : false;
+    }
+
 private:
     /// Handle all the special cases for built-ins.  This includes
     /// irregular patterns of which args are read vs written, special
@@ -801,12 +815,6 @@ private:
     /// Handle "funcion calls" that are really struct ctrs.
     TypeSpec typecheck_struct_constructor();
 
-    /// Is the argument number 'arg' read by the op?
-    ///
-    bool argread(int arg) const;
-    /// Is the argument number 'arg' written by the op?
-    ///
-    bool argwrite(int arg) const;
     /// Declare that argument number 'arg' is read by this op.
     ///
     void argread(int arg, bool val)
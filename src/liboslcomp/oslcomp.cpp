@@ -262,6 +262,9 @@ OSLCompilerImpl::read_compile_options(const std::vector<std::string>& options,
     m_output_filename.clear();
     m_preprocess_only = false;
     m_compile_target  = CompileTargets::OSO;
+    m_artic_group     = false;
+    m_artic_params.clear();
+    m_artic_outputs.clear();
     for (size_t i = 0; i < options.size(); ++i) {
         if (options[i] == "-v") {
             // verbose mode
@@ -283,6 +286,23 @@ OSLCompilerImpl::read_compile_options(const std::vector<std::string>& options,
                 || options[i] == "ARTIC") {
                 m_compile_target = CompileTargets::ARTIC;
             }
+        } else if (options[i] == "-artic-group") {
+            m_artic_group = true;
+        } else if (options[i] == "-param" && i < options.size() - 2) {
+            m_artic_params[options[i + 1]] = options[i + 2];
+            i += 2;
+        } else if (options[i] == "-artic-output" && i < options.size() - 1) {
+            ++i;
+            m_artic_outputs.push_back(options[i]);
+        } else if (options[i] == "-artic-width" && i < options.size() - 1) {
+            ++i;
+            int width = OIIO::Strutil::from_string<int>(options[i]);
+            if (width == 1 || width == 4 || width == 8 || width == 16)
+                m_artic_vector_width = width;
+            else
+                warningf(ustring(), 0,
+                         "Unsupported Artic vector width %s, using %d",
+                         options[i], m_artic_vector_width);
         } else if (options[i] == "-O0") {
             m_optimizelevel = 0;
         } else if (options[i] == "-O" || options[i] == "-O1") {
@@ -427,6 +447,9 @@ OSLCompilerImpl::compile(string_view filename,
 
     read_compile_options(options, defines, includepaths);
 
+    if (m_compile_target == CompileTargets::ARTIC && m_artic_group)
+        return compile_artic_group(filename);
+
     // Determine where the installed shader include directory is, and
     // look for ../shaders/stdosl.h and force it to include.
     if (stdoslpath.empty()) {
@@ -468,22 +491,7 @@ OSLCompilerImpl::compile(string_view filename,
         ArticSource artic_source("  ");
         if (!error_encountered()) {
             if(m_compile_target == CompileTargets::ARTIC){
-                ArticTranspiler artic_transpiler(&artic_source, nullptr);
-                for(auto sym: this->symtab()){
-                    if(sym->is_structure()){
-                        artic_transpiler.generate_struct_definition(sym->typespec());
-                    } else if(sym->node() && sym->node()->nodetype() != ASTNode::NodeType::variable_declaration_node){
-                        auto node = sym->node();
-                        if(!node->is_std_node()){
-                            artic_transpiler.dispatch_node(node);
-                        }
-                    }
-
-                }
-                artic_transpiler.dispatch_node(shader());
-                if(m_debug){
-                    artic_source.print();
-                }
+                transpile_artic(artic_source);
 
             } else {
                 shader()->codegen();
@@ -584,22 +592,7 @@ OSLCompilerImpl::compile_buffer(string_view sourcecode, std::string& osobuffer,
         ArticSource artic_source("  ");
         if (!error_encountered()) {
             if(m_compile_target == CompileTargets::ARTIC){
-                ArticTranspiler artic_transpiler(&artic_source, nullptr);
-                for(auto sym: this->symtab()){
-                    if(sym->is_structure()){
-                        artic_transpiler.generate_struct_definition(sym->typespec());
-                    } else if(sym->node() && sym->node()->nodetype() != ASTNode::NodeType::variable_declaration_node){
-                        auto node = sym->node();
-                        if(!node->is_std_node()){
-                            artic_transpiler.dispatch_node(node);
-                        }
-                    }
-
-                }
-                artic_transpiler.dispatch_node(shader());
-                if(m_debug){
-                    artic_source.print();
-                }
+                transpile_artic(artic_source);
             } else {
                 shader()->codegen();
                 track_variable_dependencies();
@@ -715,7 +708,8 @@ std::string
 OSLCompilerImpl::default_output_filename()
 {
     if (m_shader && shader_decl())
-        return shader_decl()->shadername().string() + ".oso";
+        return shader_decl()->shadername().string()
+               + (m_compile_target == CompileTargets::ARTIC ? ".art" : ".oso");
     return std::string();
 }
 
@@ -889,6 +883,106 @@ OSLCompilerImpl::write_oso_symbol(const Symbol* sym)
     osof("\n");
 }
 
+void
+OSLCompilerImpl::transpile_artic(ArticSource& artic_source)
+{
+    ArticTranspiler artic_transpiler(&artic_source, nullptr);
+    artic_transpiler.set_vector_width(m_artic_vector_width);
+    artic_transpiler.set_param_values(m_artic_params);
+    for (auto& p : m_artic_params) {
+        bool found = false;
+        for (ASTNode::ref f = shader_decl() ? shader_decl()->formals()
+                                                 : ASTNode::ref();
+             f && !found;
+             f = f->next()) {
+            auto v = (ASTvariable_declaration*)f.get();
+            found  = v->name() == p.first
+                    && !artic_param_typename(v->typespec()).empty()
+                    && !v->is_output();
+        }
+        if (!found)
+            warningf(ustring(), 0,
+                     "-param %s does not name a bakeable shader input, ignored",
+                     p.first);
+    }
+    artic_transpiler.set_requested_outputs(m_artic_outputs);
+    for (auto& name : m_artic_outputs) {
+        bool found = name == "P" || name == "N" || name == "Ci";
+        for (ASTNode::ref f = shader_decl() ? shader_decl()->formals()
+                                                 : ASTNode::ref();
+             f && !found;
+             f = f->next()) {
+            auto v = (ASTvariable_declaration*)f.get();
+            found  = v->name() == name && v->is_output();
+        }
+        if (!found)
+            warningf(ustring(), 0,
+                     "-artic-output %s does not name a shader output, ignored",
+                     name);
+    }
+    for (auto sym : this->symtab()) {
+        if (sym->is_structure()) {
+            artic_transpiler.generate_struct_definition(sym->typespec());
+        } else if (sym->node()
+                   && sym->node()->nodetype()
+                          != ASTNode::NodeType::variable_declaration_node) {
+            auto node = sym->node();
+            if (!node->is_std_node()) {
+                artic_transpiler.dispatch_node(node);
+            }
+        }
+    }
+    artic_transpiler.dispatch_node(shader());
+    if (m_debug) {
+        artic_source.print();
+    }
+}
+
+bool
+OSLCompilerImpl::compile_artic_group(string_view filename)
+{
+    std::string groupspec;
+    if (!OIIO::Filesystem::read_text_file(filename, groupspec)) {
+        errorf(ustring(), 0, "Could not read \"%s\"", filename);
+        return false;
+    }
+
+    ArticSource artic_source("  ");
+    ArticGroupFuser fuser(&artic_source);
+    std::string errdesc;
+    if (!fuser.parse(groupspec, errdesc)) {
+        errorf(ustring(filename), 0, "%s", errdesc);
+        return false;
+    }
+
+    // The group is named after the file, made into a valid identifier
+    std::string groupname = OIIO::Filesystem::filename(
+        OIIO::Filesystem::replace_extension(filename, ""));
+    for (auto& c : groupname)
+        if (!isalnum(c))
+            c = '_';
+    fuser.emit(groupname);
+    if (m_debug)
+        artic_source.print();
+
+    if (m_output_filename.empty())
+        m_output_filename = groupname + ".art";
+    OIIO::ofstream artic_output;
+    OIIO::Filesystem::open(artic_output, m_output_filename);
+    if (!artic_output.good()) {
+        errorf(ustring(), 0, "Could not open \"%s\"", m_output_filename);
+        return false;
+    }
+    m_osofile = &artic_output;
+    write_artic_file(artic_source.get_code());
+    artic_output.close();
+    if (!artic_output.good()) {
+        errorf(ustring(), 0, "Failed to write to \"%s\"", m_output_filename);
+        return false;
+    }
+    return !error_encountered();
+}
+
 void OSLCompilerImpl::write_artic_file(const std::string& code)
 {
     OSL_DASSERT(m_osofile && m_osofile->good());
@@ -19,6 +19,8 @@
 
 OSL_NAMESPACE_ENTER
 
+class ArticSource;
+
 namespace pvt {
 
 
@@ -388,6 +390,14 @@ private:
     void write_oso_file(string_view options,
                         string_view preprocessed_source = "");
     void write_artic_file(const std::string& code);
+
+    /// Transpile the typechecked AST (user functions, structs and the
+    /// shader itself) into Artic source.
+    void transpile_artic(ArticSource& artic_source);
+
+    /// Read a serialized shader group and write it out as a single fused
+    /// Artic function (-t artic -artic-group).
+    bool compile_artic_group(string_view filename);
     void write_oso_const_value(const ConstantSymbol* sym) const;
     void write_oso_symbol(const Symbol* sym);
     void write_oso_metadata(const ASTNode* metanode) const;
@@ -503,6 +513,10 @@ private:
     std::set<ustring> m_file_dependencies;  ///< All include file dependencies
     std::stack<TypeSpec> m_typespec_stack;  ///< Just for function_declaration
     CompileTargets m_compile_target;
+    int m_artic_vector_width = 8;  ///< SIMD width of the Artic batch entry
+    bool m_artic_group = false;    ///< Input is a serialized shader group
+    std::map<std::string, std::string> m_artic_params;  ///< -param values
+    std::vector<std::string> m_artic_outputs;  ///< -artic-output names
 };
 
 
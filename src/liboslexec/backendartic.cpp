@@ -0,0 +1,1794 @@
+// Copyright Contributors to the Open Shading Language project.
+// SPDX-License-Identifier: BSD-3-Clause
+// https://github.com/AcademySoftwareFoundation/OpenShadingLanguage
+
+#include <algorithm>
+#include <cctype>
+
+#include <OpenImageIO/filesystem.h>
+#include <OpenImageIO/strutil.h>
+
+#include "oslexec_pvt.h"
+#include "../liboslcomp/oslcomp_pvt.h"
+#include "../liboslcomp/artic.h"
+#include "backendartic.h"
+
+using namespace OSL;
+using namespace OSL::pvt;
+
+OSL_NAMESPACE_ENTER
+
+namespace pvt {
+
+static ustring op_if("if");
+static ustring op_break("break");
+static ustring op_continue("continue");
+static ustring op_return("return");
+static ustring op_functioncall("functioncall");
+static ustring op_functioncall_nr("functioncall_nr");
+static ustring op_end("end");
+static ustring op_nop("nop");
+static ustring op_useparam("useparam");
+static ustring op_closure("closure");
+static ustring op_setmessage("setmessage");
+static ustring op_getmessage("getmessage");
+
+
+
+// Replace everything that can't appear in an Artic identifier.
+static std::string
+artic_identifier(string_view name)
+{
+    std::string id(name);
+    for (auto& c : id)
+        if (!isalnum((unsigned char)c))
+            c = '_';
+    return id;
+}
+
+
+
+// TextureOpt::InterpMode of an "interp" texture option, -1 if unknown.
+static int
+artic_interp_code(ustring name)
+{
+    if (name == Strings::smartcubic)
+        return TextureOpt::InterpSmartBicubic;
+    if (name == Strings::linear)
+        return TextureOpt::InterpBilinear;
+    if (name == Strings::cubic)
+        return TextureOpt::InterpBicubic;
+    if (name == Strings::closest)
+        return TextureOpt::InterpClosest;
+    return -1;
+}
+
+
+
+// Mangled name of a type as it appears in std library function names.
+static std::string
+artic_mangled_type(const TypeSpec& type)
+{
+    return artic_type_string_to_string(artic_string(type, 0));
+}
+
+
+
+// TypeDesc value (see anyosl_renderer.art) describing a type to the
+// renderer imports.
+static std::string
+artic_typedesc(TypeDesc t)
+{
+    return Strutil::sprintf("TypeDesc { basetype = %d, aggregate = %d, "
+                            "vecsemantics = %d, arraylen = %d }",
+                            (int)t.basetype, (int)t.aggregate,
+                            (int)t.vecsemantics, t.arraylen);
+}
+
+
+
+// Artic literal of the zero value (empty string, empty closure) of a type.
+static std::string
+artic_zero_literal(const TypeSpec& type)
+{
+    if (type.is_closure_based())
+        return "empty_closure()";
+    TypeDesc t = type.simpletype();
+    int n      = std::max(1, type.arraylength()) * int(t.aggregate);
+    std::vector<std::string> values(n, type.is_string_based() ? "" : "0");
+    return artic_param_literal(artic_param_typename(type), type.is_array(),
+                               values);
+}
+
+
+
+// Does a layer getmessage the literal name without a source?
+static bool
+reads_message(const ShaderInstance* inst, ustring name)
+{
+    for (auto&& op : inst->ops()) {
+        if (op.opname() != op_getmessage || op.nargs() != 3)
+            continue;
+        const Symbol* sym = inst->argsymbol(op.firstarg() + 1);
+        if (sym->is_constant() && sym->get_string() == name)
+            return true;
+    }
+    return false;
+}
+
+
+
+BackendArtic::BackendArtic(ShadingSystemImpl& shadingsys, ShaderGroup& group,
+                           ShadingContext* ctx)
+    : OSOProcessorBase(shadingsys, group, ctx)
+    , m_source(new ArticSource("    "))
+    , m_ok(true)
+    , m_next_block(0)
+    , m_color_system(false)
+{
+}
+
+
+
+BackendArtic::~BackendArtic()
+{
+    delete m_source;
+}
+
+
+
+std::string
+BackendArtic::artic_layer_name(int layer) const
+{
+    ShaderInstance* linst = group()[layer];
+    return artic_identifier(Strutil::sprintf("%s_%s_%d", group().name(),
+                                             linst->layername(), linst->id()));
+}
+
+
+
+std::string
+BackendArtic::symbol_name(const Symbol& sym) const
+{
+    int index = int(&sym - &inst()->symbols()[0]);
+    return Strutil::sprintf("%s_%d", artic_identifier(sym.name()), index);
+}
+
+
+
+std::string
+BackendArtic::symbol_literal(const Symbol& sym) const
+{
+    const TypeSpec& type(sym.typespec());
+    bool local = sym.symtype() == SymTypeLocal || sym.symtype() == SymTypeTemp;
+    if (!sym.data() || local || type.is_closure_based())
+        return artic_zero_literal(type);
+
+    TypeDesc t = type.simpletype();
+    int n      = std::max(1, type.arraylength()) * int(t.aggregate);
+    std::vector<std::string> values;
+    for (int i = 0; i < n; ++i) {
+        if (type.is_float_based())
+            values.push_back(Strutil::sprintf("%.9g", sym.get_float(i)));
+        else if (type.is_int_based())
+            values.push_back(Strutil::sprintf("%d", sym.get_int(i)));
+        else
+            values.push_back(((const ustring*)sym.data())[i].string());
+    }
+    return artic_param_literal(artic_param_typename(type), type.is_array(),
+                               values);
+}
+
+
+
+std::string
+BackendArtic::symbol_value(const Symbol& sym) const
+{
+    if (sym.is_constant())
+        return symbol_literal(sym);
+    if (sym.symtype() == SymTypeGlobal)
+        return "sg." + sym.name().string();
+    return symbol_name(sym);
+}
+
+
+
+std::string
+BackendArtic::convert(const Symbol& src, const TypeSpec& dst) const
+{
+    const TypeSpec& type(src.typespec());
+    std::string val = symbol_value(src);
+    if (dst.is_closure_based())
+        return type.is_closure_based() ? val : "empty_closure()";
+    if (type == dst || (type.is_triple() && dst.is_triple()))
+        return val;
+    if (dst.is_float() && type.is_int())
+        return "(" + val + " as f32)";
+    if (dst.is_int() && type.is_float())
+        return "(" + val + " as i32)";
+    if (dst.is_triple() && (type.is_float() || type.is_int())) {
+        std::string f = type.is_int() ? "(" + val + " as f32)" : val;
+        return "make_vector(" + f + ", " + f + ", " + f + ")";
+    }
+    return "ops_" + artic_mangled_type(type) + "().as_" + artic_string(dst, 0)
+           + "(" + val + ")";
+}
+
+
+
+std::string
+BackendArtic::string_chars(const Symbol& sym) const
+{
+    if (sym.is_constant())
+        return artic_string_literal(sym.get_string());
+    return "string_chars(" + symbol_value(sym) + ")";
+}
+
+
+
+std::string
+BackendArtic::test_nonzero(const Symbol& sym) const
+{
+    const TypeSpec& type(sym.typespec());
+    if (type.is_float())
+        return symbol_value(sym) + " != 0.0";
+    return symbol_value(sym) + " != 0";
+}
+
+
+
+std::string
+BackendArtic::deriv_value(const Symbol& sym, int axis) const
+{
+    static const char* global_derivs[][3] = { { "P", "dPdx", "dPdy" },
+                                              { "I", "dIdx", "dIdy" },
+                                              { "u", "dudx", "dudy" },
+                                              { "v", "dvdx", "dvdy" } };
+    if (sym.symtype() == SymTypeGlobal) {
+        for (auto& d : global_derivs)
+            if (sym.name() == d[0])
+                return std::string("sg.") + d[axis];
+    }
+    return sym.typespec().is_triple() ? "make_vector(0.0, 0.0, 0.0)" : "0.0";
+}
+
+
+
+void
+BackendArtic::run()
+{
+    m_source->add_source("// Optimized shader group \"",
+                         group().name().string(), "\"\n\n");
+    find_artic_messages();
+    for (int layer = 0; layer < group().nlayers(); ++layer) {
+        set_inst(layer);
+        if (inst()->unused())
+            continue;
+        build_artic_instance();
+    }
+    build_artic_group_entry();
+    build_artic_texture_handles();
+    build_artic_batch_constants();
+    build_artic_color_system();
+    build_artic_strings();
+    m_artic_source = m_source->get_code();
+
+    // Make a safe group name that doesn't have "/" in it, the same way
+    // the LLVM bitcode dump does.
+    std::string safegroup;
+    safegroup = Strutil::replace(group().name(), "/", "_", true);
+    safegroup = Strutil::replace(safegroup, ":", "_", true);
+    if (safegroup.size() > 235)
+        safegroup = Strutil::sprintf("TRUNC_%s_%d",
+                                     safegroup.substr(safegroup.size() - 235),
+                                     group().id());
+    std::string name = Strutil::sprintf("%s.art", safegroup);
+    OIIO::ofstream out;
+    OIIO::Filesystem::open(out, name);
+    if (out) {
+        out << m_artic_source;
+        shadingsys().infof("Wrote optimized Artic source to '%s'", name);
+    } else {
+        shadingsys().errorf("Could not write to '%s'", name);
+    }
+}
+
+
+
+// Is the parameter fed by a whole-value connection from an earlier layer?
+// Those become arguments of the layer function.
+static const Connection*
+complete_connection(const ShaderInstance* inst, int param)
+{
+    for (int c = 0, Nc = inst->nconnections(); c < Nc; ++c) {
+        const Connection& con(inst->connection(c));
+        if (con.dst.param == param && con.is_complete())
+            return &con;
+    }
+    return nullptr;
+}
+
+
+
+void
+BackendArtic::build_artic_instance()
+{
+    std::string fname = artic_layer_name(layer());
+    SymbolVec& syms(inst()->symbols());
+
+    // String literals and parameter values are written as their hashes,
+    // so the group interns their characters when it is loaded.
+    for (auto&& s : syms) {
+        bool param = s.symtype() == SymTypeParam
+                     || s.symtype() == SymTypeOutputParam;
+        if (!s.typespec().is_string_based() || !s.data()
+            || !(s.is_constant() || param))
+            continue;
+        for (int i = 0, e = std::max(1, s.typespec().arraylength()); i < e;
+             ++i) {
+            ustring str = ((const ustring*)s.data())[i];
+            if (!str.empty()
+                && std::find(m_strings.begin(), m_strings.end(), str)
+                       == m_strings.end())
+                m_strings.push_back(str);
+        }
+    }
+
+    // Outputs, and anything read by a later layer, are returned.
+    m_source->add_source_with_indent("struct ", fname, "_out {\n");
+    m_source->push_indent();
+    for (auto&& s : syms) {
+        if (s.symtype() == SymTypeOutputParam || s.connected_down())
+            m_source->add_source_with_indent(artic_identifier(s.name()), ": ",
+                                             artic_string(s.typespec(), 0),
+                                             ",\n");
+    }
+    for (size_t k = 0; k < m_messages.size(); ++k) {
+        if (m_messages[k].layer != layer())
+            continue;
+        std::string msg = "message_" + std::to_string(k);
+        m_source->add_source_with_indent(msg, ": ",
+                                         artic_string(m_messages[k].type, 0),
+                                         ",\n");
+        m_source->add_source_with_indent(msg, "_set: bool,\n");
+    }
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n\n");
+
+    m_source->add_source_with_indent("fn @", fname, "(inout: shader_inout, "
+                                     "space: fn(i32) -> NamedSpace, "
+                                     "attribute: fn(i32) -> UniformAttribute");
+    for (int i = 0, e = int(syms.size()); i < e; ++i) {
+        if (syms[i].connected() && complete_connection(inst(), i))
+            m_source->add_source(", conn_", symbol_name(syms[i]), ": ",
+                                 artic_string(syms[i].typespec(), 0));
+    }
+    for (size_t k = 0; k < m_messages.size(); ++k) {
+        const ArticMessage& m(m_messages[k]);
+        if (m.layer < layer() && reads_message(inst(), m.name))
+            m_source->add_source(", message_", std::to_string(k), ": ",
+                                 artic_string(m.type, 0), ", message_",
+                                 std::to_string(k), "_set: bool");
+    }
+    m_source->add_source(") -> (", fname, "_out, shader_inout) {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent("let mut sg = inout;\n");
+
+    // The messages this layer is the first to set live here until the
+    // layer returns them.
+    for (size_t k = 0; k < m_messages.size(); ++k) {
+        if (m_messages[k].layer != layer())
+            continue;
+        std::string msg = "message_" + std::to_string(k);
+        m_source->add_source_with_indent("let mut ", msg, ": ",
+                                         artic_string(m_messages[k].type, 0),
+                                         " = ",
+                                         artic_zero_literal(m_messages[k].type),
+                                         ";\n");
+        m_source->add_source_with_indent("let mut ", msg, "_set = false;\n");
+    }
+
+    // Every symbol is a mutable local; constants and globals are used in
+    // place.  Struct symbols are split into their fields by the compiler.
+    for (int i = 0, e = int(syms.size()); i < e; ++i) {
+        const Symbol& s(syms[i]);
+        if (s.is_constant() || s.symtype() == SymTypeGlobal
+            || s.typespec().is_structure_based())
+            continue;
+        bool param = s.symtype() == SymTypeParam
+                     || s.symtype() == SymTypeOutputParam;
+        if (!s.everused() && !param)
+            continue;
+        std::string init = symbol_literal(s);
+        if (s.connected()) {
+            if (complete_connection(inst(), i)) {
+                init = "conn_" + symbol_name(s);
+            } else {
+                shadingcontext()->errorf(
+                    "Artic: partial connection to %s.%s is not supported",
+                    inst()->layername(), s.name());
+                m_ok = false;
+            }
+        }
+        m_source->add_source_with_indent("let mut ", symbol_name(s), ": ",
+                                         artic_string(s.typespec(), 0), " = ",
+                                         init, ";\n");
+    }
+
+    // The body runs in a local function so that 'exit' can leave it from
+    // any depth of loops and inlined calls.
+    m_source->add_source_with_indent("fn @run() -> () {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent("let exit_layer = return;\n");
+    for (auto&& s : param_range(inst())) {
+        // Geometrically varying parameters take the renderer's userdata
+        // of the same name, if it has any, instead of their defaults.
+        bool init_ops = s.has_init_ops()
+                        && s.valuesource() == Symbol::DefaultVal;
+        bool userdata = !s.lockgeom() && !s.connected()
+                        && !s.typespec().is_closure_based()
+                        && !s.typespec().is_structure_based();
+        if (userdata) {
+            std::string get = Strutil::sprintf(
+                "userdata_value(sg.shaderglobals, %s, %s, &mut %s)",
+                artic_string_literal(s.name()),
+                artic_typedesc(s.typespec().simpletype()), symbol_name(s));
+            if (!init_ops) {
+                m_source->add_source_with_indent(get, ";\n");
+                continue;
+            }
+            m_source->add_source_with_indent("if !", get, " {\n");
+            m_source->push_indent();
+        }
+        if (init_ops)
+            build_artic_code(s.initbegin(), s.initend());
+        if (userdata) {
+            m_source->pop_indent();
+            m_source->add_source_with_indent("}\n");
+        }
+    }
+    build_artic_code(inst()->maincodebegin(), inst()->maincodeend());
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+    m_source->add_source_with_indent("run();\n");
+
+    m_source->add_source_with_indent("(", fname, "_out {\n");
+    m_source->push_indent();
+    for (auto&& s : syms) {
+        if (s.symtype() == SymTypeOutputParam || s.connected_down())
+            m_source->add_source_with_indent(artic_identifier(s.name()), " = ",
+                                             symbol_name(s), ",\n");
+    }
+    for (size_t k = 0; k < m_messages.size(); ++k) {
+        if (m_messages[k].layer != layer())
+            continue;
+        std::string msg = "message_" + std::to_string(k);
+        m_source->add_source_with_indent(msg, " = ", msg, ",\n");
+        m_source->add_source_with_indent(msg, "_set = ", msg, "_set,\n");
+    }
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}, sg)\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n\n");
+}
+
+
+
+std::string
+BackendArtic::build_artic_layer_calls()
+{
+    m_source->add_source_with_indent("let globals_0 = inout;\n");
+    int k = 0;
+    for (int layer = 0; layer < group().nlayers(); ++layer) {
+        ShaderInstance* linst = group()[layer];
+        if (linst->unused())
+            continue;
+        m_source->add_source_with_indent("let (layer", std::to_string(layer),
+                                         "_out, globals_", std::to_string(k + 1),
+                                         ") = ", artic_layer_name(layer),
+                                         "(globals_", std::to_string(k),
+                                         ", space, attribute");
+        for (int i = 0, e = int(linst->symbols().size()); i < e; ++i) {
+            const Connection* con = linst->symbol(i)->connected()
+                                        ? complete_connection(linst, i)
+                                        : nullptr;
+            if (con) {
+                const Symbol* src = group()[con->srclayer]->symbol(
+                    con->src.param);
+                m_source->add_source(", layer", std::to_string(con->srclayer),
+                                     "_out.", artic_identifier(src->name()));
+            }
+        }
+        for (size_t m = 0; m < m_messages.size(); ++m) {
+            const ArticMessage& msg(m_messages[m]);
+            if (msg.layer < layer && reads_message(linst, msg.name))
+                m_source->add_source(", layer", std::to_string(msg.layer),
+                                     "_out.message_", std::to_string(m),
+                                     ", layer", std::to_string(msg.layer),
+                                     "_out.message_", std::to_string(m),
+                                     "_set");
+        }
+        m_source->add_source(");\n");
+        ++k;
+    }
+    return "globals_" + std::to_string(k);
+}
+
+
+
+void
+BackendArtic::build_artic_output_stores()
+{
+    // Slot i of outputs is the i-th renderer output, the same order in
+    // which the renderer named them.  Each is looked up the way
+    // find_symbol does, from the last layer back.
+    const std::vector<ustring>& aovs(shadingsys().renderer_outputs(group()));
+    for (size_t slot = 0; slot < aovs.size(); ++slot) {
+        ustring layername, name = aovs[slot];
+        size_t dot = name.find('.');
+        if (dot != ustring::npos) {
+            layername = ustring(name, 0, dot);
+            name      = ustring(name, dot + 1);
+        }
+        for (int layer = group().nlayers() - 1; layer >= 0; --layer) {
+            const ShaderInstance* linst = group()[layer];
+            if (linst->unused()
+                || (!layername.empty() && linst->layername() != layername))
+                continue;
+            int index         = linst->findsymbol(name);
+            const Symbol* sym = index >= 0 ? linst->symbol(index) : nullptr;
+            if (!sym || sym->symtype() != SymTypeOutputParam)
+                continue;
+            // Closures and strings have no plain memory layout to hand
+            // back; the slot is left alone.
+            if (!sym->typespec().is_closure_based()
+                && !sym->typespec().is_string_based())
+                m_source->add_source_with_indent(
+                    "*bitcast[&mut ", artic_string(sym->typespec(), 0),
+                    "](output(", std::to_string(slot), ")) = layer",
+                    std::to_string(layer), "_out.",
+                    artic_identifier(sym->name()), ";\n");
+            break;
+        }
+    }
+}
+
+
+
+void
+BackendArtic::build_artic_group_entry()
+{
+    std::string group_name = artic_identifier(group().name());
+    m_source->add_source_with_indent("fn @", group_name,
+                                     "_impl(inout: shader_inout, "
+                                     "space: fn(i32) -> NamedSpace, "
+                                     "attribute: fn(i32) -> UniformAttribute) -> shader_inout {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent(build_artic_layer_calls(), "\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+
+    // The same, also storing the renderer outputs through output(slot).
+    m_source->add_source_with_indent("\nfn @", group_name,
+                                     "_impl_outputs(inout: shader_inout, "
+                                     "space: fn(i32) -> NamedSpace, "
+                                     "attribute: fn(i32) -> UniformAttribute, "
+                                     "output: fn(i32) -> &mut [u8]) -> shader_inout {\n");
+    m_source->push_indent();
+    std::string globals = build_artic_layer_calls();
+    build_artic_output_stores();
+    m_source->add_source_with_indent(globals, "\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+
+    // The native entry takes the same arguments as a JITed group, so it
+    // can be bound with ShadingSystem::register_compiled_group.
+    m_source->add_source_with_indent("\n#[export]\n");
+    m_source->add_source_with_indent("fn ", group_name,
+                                     "_entry(sg: &mut ShaderGlobals, "
+                                     "_groupdata: &mut [u8]) -> () {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent(group_name, "_with_batch_constants("
+                                     "bitcast[ShaderGlobalsPtr](sg), |space, attribute| {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent("store_shader_globals(sg, ", group_name,
+                                     "_impl(load_shader_globals(sg), space, attribute));\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("})\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+
+    // Drivers that read the renderer outputs directly, like testshade
+    // --artic, pass one pointer per output...
+    m_source->add_source_with_indent("\n#[export]\n");
+    m_source->add_source_with_indent("fn ", group_name,
+                                     "_outputs(sg: &mut ShaderGlobals, "
+                                     "outputs: &[&mut [u8]]) -> () {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent(group_name, "_with_batch_constants("
+                                     "bitcast[ShaderGlobalsPtr](sg), |space, attribute| {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent("store_shader_globals(sg, ", group_name,
+                                     "_impl_outputs(load_shader_globals(sg), "
+                                     "space, attribute, |slot| outputs(slot)));\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("})\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+
+    // ...or, for count points at once, one base pointer and byte stride
+    // per output.  The named spaces and uniform attributes are resolved
+    // once for the batch, with the globals of its first point.
+    m_source->add_source_with_indent("\n#[export]\n");
+    m_source->add_source_with_indent("fn ", group_name,
+                                     "_batch(count: i32, sgs: &mut [ShaderGlobals], "
+                                     "outputs: &[&mut [u8]], strides: &[i32]) -> () {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent("if count <= 0 { return() }\n");
+    m_source->add_source_with_indent(group_name, "_with_batch_constants("
+                                     "bitcast[ShaderGlobalsPtr](&mut sgs(0)), |space, attribute| {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent("shade_batch(",
+                                     std::to_string(shadingsys().vector_width()),
+                                     ", count, |i| {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent("let sg = &mut sgs(i);\n");
+    m_source->add_source_with_indent("store_shader_globals(sg, ", group_name,
+                                     "_impl_outputs(load_shader_globals(sg), space, attribute, "
+                                     "|slot| bitcast[&mut [u8]](&mut outputs(slot)(i * strides(slot)))));\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("})\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("})\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+}
+
+
+
+bool
+BackendArtic::build_artic_code(int beginop, int endop)
+{
+    for (int opnum = beginop; opnum < endop; ++opnum) {
+        const Opcode& op = inst()->ops()[opnum];
+        ustring opname   = op.opname();
+        if (opname == op_if) {
+            m_source->add_source_with_indent("if ",
+                                             test_nonzero(*opargsym(op, 0)),
+                                             " {\n");
+            m_source->push_indent();
+            build_artic_code(opnum + 1, op.jump(0));
+            m_source->pop_indent();
+            m_source->add_source_with_indent("} else {\n");
+            m_source->push_indent();
+            build_artic_code(op.jump(0), op.jump(1));
+            m_source->pop_indent();
+            m_source->add_source_with_indent("}\n");
+        } else if (opname == Strings::op_for || opname == Strings::op_while
+                   || opname == Strings::op_dowhile) {
+            build_artic_loop(op, opnum);
+        } else if (opname == op_functioncall
+                   || opname == op_functioncall_nr) {
+            // Inlined function bodies get their own Artic function, whose
+            // return continuation implements the OSL 'return'.
+            std::string fn = "inlined_" + std::to_string(m_next_block++);
+            m_source->add_source_with_indent("fn @", fn, "() -> () {\n");
+            m_source->push_indent();
+            m_function_return.push_back("return");
+            build_artic_code(opnum + 1, op.jump(0));
+            m_function_return.pop_back();
+            m_source->pop_indent();
+            m_source->add_source_with_indent("}\n");
+            m_source->add_source_with_indent(fn, "();\n");
+        } else if (opname == op_break) {
+            m_source->add_source_with_indent(m_loop_break.back(), "();\n");
+        } else if (opname == op_continue) {
+            m_source->add_source_with_indent(m_loop_continue.back(), "();\n");
+        } else if (opname == op_return) {
+            m_source->add_source_with_indent(m_function_return.empty()
+                                                 ? "exit_layer"
+                                                 : m_function_return.back(),
+                                             "();\n");
+        } else if (opname == Strings::op_exit) {
+            m_source->add_source_with_indent("exit_layer();\n");
+        } else if (opname == op_nop || opname == op_end
+                   || opname == op_useparam) {
+            // Nothing to do: all used layers run up front.
+        } else if (!build_artic_op(op)) {
+            shadingcontext()->errorf("Artic: Unsupported op %s in layer %s\n",
+                                     opname, inst()->layername());
+            m_ok = false;
+        }
+
+        // If the op we coded jumps around, skip past its recursive block
+        // executions.
+        int next = op.farthest_jump();
+        if (next >= 0)
+            opnum = next - 1;
+    }
+    return m_ok;
+}
+
+
+
+bool
+BackendArtic::build_artic_loop(const Opcode& op, int opnum)
+{
+    // Artic binds 'break' per loop, so the body runs inside a one-shot
+    // inner loop whose break is the OSL 'continue' (it still runs the
+    // step code), and the outer loop's break is named for the body.
+    std::string id   = std::to_string(m_next_block++);
+    bool dowhile     = op.opname() == Strings::op_dowhile;
+    std::string test = "if !(" + test_nonzero(*opargsym(op, 0))
+                       + ") { break() }\n";
+
+    build_artic_code(opnum + 1, op.jump(0));  // init
+    m_source->add_source_with_indent("while true {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent("let break_", id, " = break;\n");
+    if (!dowhile) {
+        build_artic_code(op.jump(0), op.jump(1));
+        m_source->add_source_with_indent(test);
+    }
+    m_source->add_source_with_indent("while true {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent("let continue_", id, " = break;\n");
+    m_loop_break.push_back("break_" + id);
+    m_loop_continue.push_back("continue_" + id);
+    build_artic_code(op.jump(1), op.jump(2));
+    m_loop_break.pop_back();
+    m_loop_continue.pop_back();
+    m_source->add_source_with_indent("break()\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+    build_artic_code(op.jump(2), op.jump(3));  // step
+    if (dowhile) {
+        build_artic_code(op.jump(0), op.jump(1));
+        m_source->add_source_with_indent(test);
+    }
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+    return m_ok;
+}
+
+
+
+bool
+BackendArtic::build_artic_op(const Opcode& op)
+{
+    std::string opname = op.opname().string();
+    int nargs          = op.nargs();
+    auto arg           = [&](int i) -> const Symbol& {
+        return *opargsym(op, i);
+    };
+    auto value = [&](int i) { return symbol_value(arg(i)); };
+
+    if (opname == "assign" && nargs == 2) {
+        m_source->add_source_with_indent(value(0), " = ",
+                                         convert(arg(1), arg(0).typespec()),
+                                         ";\n");
+        return true;
+    }
+
+    if ((opname == "add" || opname == "sub" || opname == "mul"
+         || opname == "div" || opname == "mod")
+        && nargs == 3) {
+        m_source->add_source_with_indent(
+            value(0), " = ops_", artic_mangled_type(arg(1).typespec()), "().",
+            opname, "_", artic_string(arg(2).typespec(), 0), "(", value(1),
+            ", ", value(2), ");\n");
+        return true;
+    }
+
+    if (opname == "neg" && nargs == 2) {
+        m_source->add_source_with_indent(value(0), " = neg_",
+                                         artic_mangled_type(arg(1).typespec()),
+                                         "(", value(1), ");\n");
+        return true;
+    }
+
+    if (opname == "compl" && nargs == 2) {
+        m_source->add_source_with_indent(value(0), " = !", value(1), ";\n");
+        return true;
+    }
+
+    static const char* compare_ops[][2] = { { "eq", "==" }, { "neq", "!=" },
+                                            { "lt", "<" },  { "gt", ">" },
+                                            { "le", "<=" }, { "ge", ">=" } };
+    for (auto& cmp : compare_ops) {
+        if (opname != cmp[0] || nargs != 3)
+            continue;
+        const TypeSpec& a(arg(1).typespec());
+        const TypeSpec& b(arg(2).typespec());
+        std::string test;
+        if (a.is_triple() || b.is_triple()) {
+            // Component-wise, all components must compare equal
+            std::string l = convert(arg(1), TypeDesc::TypeVector);
+            std::string r = convert(arg(2), TypeDesc::TypeVector);
+            test = Strutil::sprintf("(%s).x == (%s).x && (%s).y == (%s).y "
+                                    "&& (%s).z == (%s).z",
+                                    l, r, l, r, l, r);
+            if (opname == "neq")
+                test = "!(" + test + ")";
+        } else {
+            TypeSpec common = (a.is_float() || b.is_float())
+                                  ? TypeSpec(TypeDesc::TypeFloat)
+                                  : a;
+            test = convert(arg(1), common) + " " + cmp[1] + " "
+                   + convert(arg(2), common);
+        }
+        m_source->add_source_with_indent(value(0), " = if ", test,
+                                         " { 1 } else { 0 };\n");
+        return true;
+    }
+
+    if ((opname == "and" || opname == "or") && nargs == 3) {
+        m_source->add_source_with_indent(value(0), " = if ",
+                                         test_nonzero(arg(1)),
+                                         opname == "and" ? " && " : " || ",
+                                         test_nonzero(arg(2)),
+                                         " { 1 } else { 0 };\n");
+        return true;
+    }
+
+    static const char* bit_ops[][2] = { { "bitand", "&" }, { "bitor", "|" },
+                                        { "xor", "^" },    { "shl", "<<" },
+                                        { "shr", ">>" } };
+    for (auto& bit : bit_ops) {
+        if (opname == bit[0] && nargs == 3) {
+            m_source->add_source_with_indent(value(0), " = ", value(1), " ",
+                                             bit[1], " ", value(2), ";\n");
+            return true;
+        }
+    }
+
+    if (opname == "compref" && nargs == 3) {
+        if (arg(2).is_constant())
+            m_source->add_source_with_indent(value(0), " = ", value(1), ".",
+                                             std::string(1, "xyz"[arg(2).get_int() % 3]),
+                                             ";\n");
+        else
+            m_source->add_source_with_indent(value(0), " = index_Vector(",
+                                             value(1), ", ", value(2), ");\n");
+        return true;
+    }
+
+    if (opname == "compassign" && nargs == 3) {
+        std::string val = convert(arg(2), TypeDesc::TypeFloat);
+        if (arg(1).is_constant()) {
+            m_source->add_source_with_indent(value(0), ".",
+                                             std::string(1, "xyz"[arg(1).get_int() % 3]),
+                                             " = ", val, ";\n");
+        } else {
+            m_source->add_source_with_indent("match ", value(1), " {\n");
+            m_source->push_indent();
+            m_source->add_source_with_indent("0 => ", value(0), ".x = ", val,
+                                             ",\n");
+            m_source->add_source_with_indent("1 => ", value(0), ".y = ", val,
+                                             ",\n");
+            m_source->add_source_with_indent("_ => ", value(0), ".z = ", val,
+                                             "\n");
+            m_source->pop_indent();
+            m_source->add_source_with_indent("}\n");
+        }
+        return true;
+    }
+
+    if (opname == "aref" && nargs == 3) {
+        m_source->add_source_with_indent(value(0), " = ", value(1), "(",
+                                         value(2), ");\n");
+        return true;
+    }
+
+    if (opname == "aassign" && nargs == 3) {
+        m_source->add_source_with_indent(
+            value(0), "(", value(1), ") = ",
+            convert(arg(2), arg(0).typespec().elementtype()), ";\n");
+        return true;
+    }
+
+    if (opname == "mxcompref" && nargs == 4) {
+        if (!arg(2).is_constant() || !arg(3).is_constant())
+            return false;
+        m_source->add_source_with_indent(value(0), " = ", value(1), ".m",
+                                         std::to_string(arg(2).get_int() + 1),
+                                         "_n",
+                                         std::to_string(arg(3).get_int() + 1),
+                                         ";\n");
+        return true;
+    }
+
+    if (opname == "mxcompassign" && nargs == 4) {
+        if (!arg(1).is_constant() || !arg(2).is_constant())
+            return false;
+        m_source->add_source_with_indent(value(0), ".m",
+                                         std::to_string(arg(1).get_int() + 1),
+                                         "_n",
+                                         std::to_string(arg(2).get_int() + 1),
+                                         " = ",
+                                         convert(arg(3), TypeDesc::TypeFloat),
+                                         ";\n");
+        return true;
+    }
+
+    if (opname == "arraylength" && nargs == 2) {
+        m_source->add_source_with_indent(value(0), " = ",
+                                         std::to_string(
+                                             arg(1).typespec().arraylength()),
+                                         ";\n");
+        return true;
+    }
+
+    if (opname == "texture" || opname == "texture3d"
+        || opname == "environment")
+        return build_artic_texture(op);
+
+    if (opname == "gettextureinfo" && nargs == 4)
+        return build_artic_gettextureinfo(op);
+
+    if (opname == "matrix" && nargs >= 3 && arg(1).typespec().is_string())
+        return build_artic_matrix(op);
+
+    if (opname == "getmatrix" && nargs == 4)
+        return build_artic_getmatrix(op);
+
+    if ((opname == "transform" || opname == "transformv"
+         || opname == "transformn")
+        && (nargs == 3 || nargs == 4))
+        return build_artic_transform(op);
+
+    if (opname == "getattribute" && nargs >= 3 && nargs <= 5)
+        return build_artic_getattribute(op);
+
+    if (op.opname() == op_setmessage && nargs == 2)
+        return build_artic_setmessage(op);
+
+    if (op.opname() == op_getmessage && (nargs == 3 || nargs == 4))
+        return build_artic_getmessage(op);
+
+    if (opname == "trace" && nargs >= 3)
+        return build_artic_trace(op);
+
+    if ((opname == "color" || opname == "point" || opname == "vector"
+         || opname == "normal")
+        && nargs == 4) {
+        m_source->add_source_with_indent(
+            value(0), " = make_vector(", convert(arg(1), TypeDesc::TypeFloat),
+            ", ", convert(arg(2), TypeDesc::TypeFloat), ", ",
+            convert(arg(3), TypeDesc::TypeFloat), ");\n");
+        return true;
+    }
+
+    if (((opname == "blackbody" || opname == "wavelength_color"
+          || opname == "luminance")
+         && nargs == 2)
+        || (opname == "transformc" && nargs == 4)
+        || (opname == "color" && nargs == 5 && arg(1).typespec().is_string()))
+        return build_artic_color(op);
+
+    // Everything else calls the std library function of the same name,
+    // mangled like the calls the AST transpiler emits.  Arg 0 is the
+    // result if the op writes it; other written args are passed by
+    // reference.
+    int first         = 0;
+    std::string call  = opname;
+    std::string lhs   = "";
+    std::string ret   = "void";
+    if (op.opname() == op_closure) {
+        // closure Result [weight] "name" args...
+        first = arg(1).typespec().is_string() ? 1 : 2;
+        call  = arg(first).get_string().string();
+        ++first;
+        lhs   = value(0) + " = ";
+        ret   = "Closure";
+    } else if (nargs && op.argwrite(0)) {
+        first = 1;
+        lhs   = value(0) + " = ";
+        ret   = artic_mangled_type(arg(0).typespec());
+    }
+    std::string args;
+    for (int i = first; i < nargs; ++i) {
+        const TypeSpec& type(arg(i).typespec());
+        call += "_" + artic_mangled_type(type);
+        if (op.argwrite(i))
+            args += "&mut ";
+        else if (type.is_array())
+            args += "&";
+        args += value(i) + ", ";
+        if (type.is_array())
+            args += "||{" + std::to_string(type.arraylength()) + "}, ";
+    }
+    call += "__" + ret + "(" + args + "sg)";
+    if (op.opname() == op_closure && first == 3)
+        call = "ops_Closure().mul_" + artic_mangled_type(arg(1).typespec())
+               + "(" + call + ", " + value(1) + ")";
+    m_source->add_source_with_indent(lhs, call, ";\n");
+    return true;
+}
+
+
+
+bool
+BackendArtic::texture_file(const Symbol& filename, std::string& name,
+                           std::string& handle)
+{
+    // Strings don't carry their characters yet, so only literal file
+    // names can be handed to the renderer.
+    if (!filename.is_constant())
+        return false;
+    ustring file = filename.get_string();
+    name         = artic_string_literal(file);
+    handle       = "0 as u64";
+    if (shadingsys().opt_texture_handle()) {
+        auto found = std::find(m_texture_files.begin(), m_texture_files.end(),
+                               file);
+        int slot   = int(found - m_texture_files.begin());
+        if (found == m_texture_files.end())
+            m_texture_files.push_back(file);
+        handle = Strutil::sprintf("%s_texture_handles(%d)",
+                                  artic_identifier(group().name()), slot);
+    }
+    return true;
+}
+
+
+
+bool
+BackendArtic::build_artic_texture_options(const Opcode& op, int first,
+                                          bool tex3d, std::string& alpha)
+{
+    m_source->add_source_with_indent("let mut texopt = default_texture_opt();\n");
+    auto set = [&](const char* field, const std::string& val) {
+        m_source->add_source_with_indent("texopt.", field, " = ", val, ";\n");
+    };
+    for (int a = first; a + 1 < op.nargs(); a += 2) {
+        const Symbol& Name(*opargsym(op, a));
+        const Symbol& Val(*opargsym(op, a + 1));
+        ustring name = Name.get_string();
+        if (name.empty())  // skip empty string param name
+            continue;
+        const TypeSpec& type(Val.typespec());
+        bool numeric = type.is_float() || type.is_int();
+        std::string fval = numeric ? convert(Val, TypeDesc::TypeFloat) : "";
+
+        if ((name == Strings::width || name == Strings::blur) && numeric) {
+            std::string field = name.string();
+            set(("s" + field).c_str(), fval);
+            set(("t" + field).c_str(), fval);
+            if (tex3d)
+                set(("r" + field).c_str(), fval);
+        } else if ((name == Strings::swidth || name == Strings::twidth
+                    || name == Strings::rwidth || name == Strings::sblur
+                    || name == Strings::tblur || name == Strings::rblur
+                    || name == Strings::fill || name == Strings::time)
+                   && numeric) {
+            set(name.c_str(), fval);
+        } else if ((name == Strings::firstchannel || name == Strings::subimage)
+                   && type.is_int()) {
+            set(name.c_str(), symbol_value(Val));
+        } else if (name == Strings::subimage && type.is_string()) {
+            // Only the default (empty) subimage name can be expressed.
+            if (!Val.is_constant() || !Val.get_string().empty())
+                return false;
+        } else if ((name == Strings::wrap || name == Strings::swrap
+                    || name == Strings::twrap || name == Strings::rwrap)
+                   && type.is_string()) {
+            if (!Val.is_constant())
+                return false;
+            std::string code = std::to_string(
+                (int)TextureOpt::decode_wrapmode(Val.get_string()));
+            if (name == Strings::wrap) {
+                set("swrap", code);
+                set("twrap", code);
+                if (tex3d)
+                    set("rwrap", code);
+            } else {
+                set(name.c_str(), code);
+            }
+        } else if (name == Strings::interp && type.is_string()) {
+            if (!Val.is_constant())
+                return false;
+            int code = artic_interp_code(Val.get_string());
+            if (code >= 0)
+                set("interp", std::to_string(code));
+        } else if (name == Strings::alpha && type.is_float()) {
+            alpha = symbol_value(Val);
+        } else if (name == Strings::missingcolor && type.is_triple()) {
+            set("missingcolor", symbol_value(Val));
+            set("has_missingcolor", "1");
+        } else if (name == Strings::missingalpha && numeric) {
+            set("missingalpha", fval);
+            set("has_missingcolor", "1");
+        } else if (name == Strings::errormessage && type.is_string()) {
+            // No way to hand a message back until strings carry text.
+            return false;
+        } else {
+            shadingcontext()->errorf(
+                "Unknown texture%s optional argument: \"%s\", <%s> (%s:%d)",
+                tex3d ? "3d" : "", name, type.simpletype(), op.sourcefile(),
+                op.sourceline());
+        }
+    }
+    return true;
+}
+
+
+
+bool
+BackendArtic::build_artic_texture(const Opcode& op)
+{
+    // texture     Result filename s t [dsdx dtdx dsdy dtdy] options...
+    // texture3d   Result filename P [dPdx dPdy] options...
+    // environment Result filename R [dRdx dRdy] options...
+    auto arg = [&](int i) -> const Symbol& { return *opargsym(op, i); };
+    bool tex2d = op.opname() == "texture";
+    bool tex3d = op.opname() == "texture3d";
+    const Symbol& Result(arg(0));
+    int nchans = Result.typespec().aggregate();
+
+    std::string name, handle;
+    if (!texture_file(arg(1), name, handle))
+        return false;
+
+    std::string lookup;
+    int first_optional_arg;
+    if (tex2d) {
+        bool user_derivs   = op.nargs() > 4 && arg(4).typespec().is_float();
+        first_optional_arg = user_derivs ? 8 : 4;
+        const Symbol& S(arg(2));
+        const Symbol& T(arg(3));
+        lookup = Strutil::sprintf(
+            "texture_lookup(sg.shaderglobals, %s, %s, texopt, %s, %s, %s, %s, "
+            "%s, %s, %d)",
+            name, handle, convert(S, TypeDesc::TypeFloat),
+            convert(T, TypeDesc::TypeFloat),
+            user_derivs ? convert(arg(4), TypeDesc::TypeFloat)
+                        : deriv_value(S, 1),
+            user_derivs ? convert(arg(5), TypeDesc::TypeFloat)
+                        : deriv_value(T, 1),
+            user_derivs ? convert(arg(6), TypeDesc::TypeFloat)
+                        : deriv_value(S, 2),
+            user_derivs ? convert(arg(7), TypeDesc::TypeFloat)
+                        : deriv_value(T, 2),
+            nchans);
+    } else {
+        bool user_derivs   = op.nargs() > 3 && arg(3).typespec().is_triple();
+        first_optional_arg = user_derivs ? 5 : 3;
+        const Symbol& P(arg(2));
+        lookup = Strutil::sprintf(
+            "%s_lookup(sg.shaderglobals, %s, %s, texopt, %s, %s, %s, %d)",
+            tex3d ? "texture3d" : "environment", name, handle,
+            symbol_value(P),
+            user_derivs ? symbol_value(arg(3)) : deriv_value(P, 1),
+            user_derivs ? symbol_value(arg(4)) : deriv_value(P, 2), nchans);
+    }
+
+    m_source->add_source_with_indent("{\n");
+    m_source->push_indent();
+    std::string alpha;
+    if (!build_artic_texture_options(op, first_optional_arg, tex3d, alpha)) {
+        m_source->pop_indent();
+        return false;
+    }
+    m_source->add_source_with_indent("let texres = ", lookup, ";\n");
+    m_source->add_source_with_indent(symbol_value(Result), " = ",
+                                     Result.typespec().is_triple()
+                                         ? "texture_result_Vector"
+                                         : "texture_result_f32",
+                                     "(texres);\n");
+    if (!alpha.empty())
+        m_source->add_source_with_indent(alpha, " = texture_result_alpha(texres, ",
+                                         std::to_string(nchans), ");\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+    return true;
+}
+
+
+
+bool
+BackendArtic::build_artic_gettextureinfo(const Opcode& op)
+{
+    // gettextureinfo Result filename dataname data
+    const Symbol& Result(*opargsym(op, 0));
+    const Symbol& Dataname(*opargsym(op, 2));
+    const Symbol& Data(*opargsym(op, 3));
+    TypeDesc t = Data.typespec().simpletype();
+
+    std::string name, handle;
+    if (!texture_file(*opargsym(op, 1), name, handle)
+        || !Dataname.is_constant() || t.basetype == TypeDesc::STRING)
+        return false;
+
+    m_source->add_source_with_indent(
+        symbol_value(Result), " = ",
+        Strutil::sprintf("gettextureinfo_lookup(sg.shaderglobals, %s, %s, "
+                         "%s, %d, %d, %d, &mut %s)",
+                         name, handle,
+                         artic_string_literal(Dataname.get_string()),
+                         (int)t.basetype, (int)t.arraylen, (int)t.aggregate,
+                         symbol_value(Data)),
+        ";\n");
+    return true;
+}
+
+
+
+void
+BackendArtic::build_artic_texture_handles()
+{
+    std::string group_name = artic_identifier(group().name());
+    size_t n               = m_texture_files.size();
+    if (n) {
+        m_source->add_source_with_indent("\nstatic mut ", group_name,
+                                         "_texture_handles: [u64 * ",
+                                         std::to_string(n), "] = [");
+        for (size_t i = 0; i < n; ++i)
+            m_source->add_source(i ? ", " : "", "0");
+        m_source->add_source("];\n");
+    }
+
+    // Drivers call this once after loading the compiled group, the same
+    // point at which the LLVM backend resolves its handles while JITing.
+    m_source->add_source_with_indent("\n#[export]\n");
+    m_source->add_source_with_indent("fn ", group_name,
+                                     "_load_textures(shaderglobals: "
+                                     "ShaderGlobalsPtr) -> () {\n");
+    m_source->push_indent();
+    for (size_t i = 0; i < n; ++i)
+        m_source->add_source_with_indent(
+            group_name, "_texture_handles(", std::to_string(i),
+            ") = texture_handle(shaderglobals, ",
+            artic_string_literal(m_texture_files[i]), ");\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+}
+
+
+
+bool
+BackendArtic::is_common_space(const Symbol& name) const
+{
+    if (!name.is_constant() || !name.typespec().is_string())
+        return false;
+    ustring space = name.get_string();
+    return space == Strings::common
+           || space == shadingsys().commonspace_synonym();
+}
+
+
+
+std::string
+BackendArtic::named_space(const Symbol& name)
+{
+    if (!name.is_constant())
+        return "space_String(" + symbol_value(name) + ", sg)";
+    ustring space = name.get_string();
+    if (is_common_space(name))
+        return "common_space()";
+    // "object" and "shader" follow the object being shaded, so they are
+    // looked up for every point.
+    if (space == Strings::object || space == Strings::shader)
+        return "named_space(sg.shaderglobals, " + artic_string_literal(space)
+               + ")";
+    auto found = std::find(m_named_spaces.begin(), m_named_spaces.end(),
+                           space);
+    int slot   = int(found - m_named_spaces.begin());
+    if (found == m_named_spaces.end())
+        m_named_spaces.push_back(space);
+    return Strutil::sprintf("space(%d)", slot);
+}
+
+
+
+bool
+BackendArtic::build_artic_matrix(const Opcode& op)
+{
+    // matrix Result fromspace tospace
+    // matrix Result fromspace f
+    // matrix Result fromspace m00 m01 ... m33
+    auto arg  = [&](int i) -> const Symbol& { return *opargsym(op, i); };
+    int nargs = op.nargs();
+    std::string from = named_space(arg(1));
+    std::string m;
+    if (nargs == 3 && arg(2).typespec().is_string()) {
+        m_source->add_source_with_indent(
+            symbol_value(arg(0)), " = space_transform(", from, ", ",
+            named_space(arg(2)), ");\n");
+        return true;
+    } else if (nargs == 3) {
+        m = "scalar_matrix(" + convert(arg(2), TypeDesc::TypeFloat) + ")";
+    } else if (nargs == 18) {
+        m = "Matrix {";
+        for (int i = 0; i < 16; ++i)
+            m += Strutil::sprintf(" m%d_n%d = %s,", i / 4 + 1, i % 4 + 1,
+                                  convert(arg(i + 2), TypeDesc::TypeFloat));
+        m += " }";
+    } else {
+        return false;
+    }
+    // The matrix is given in fromspace, like osl_prepend_matrix_from.
+    m_source->add_source_with_indent(symbol_value(arg(0)), " = ",
+                                     is_common_space(arg(1))
+                                         ? m
+                                         : "matrix_mul(" + from + ".matrix, "
+                                               + m + ")",
+                                     ";\n");
+    return true;
+}
+
+
+
+bool
+BackendArtic::build_artic_getmatrix(const Opcode& op)
+{
+    // getmatrix Result fromspace tospace M
+    const Symbol& Result(*opargsym(op, 0));
+    const Symbol& From(*opargsym(op, 1));
+    const Symbol& To(*opargsym(op, 2));
+    const Symbol& M(*opargsym(op, 3));
+    m_source->add_source_with_indent("{\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent("let from_space = ", named_space(From),
+                                     ";\n");
+    m_source->add_source_with_indent("let to_space = ", named_space(To),
+                                     ";\n");
+    m_source->add_source_with_indent(symbol_value(M), " = space_transform("
+                                     "from_space, to_space);\n");
+    m_source->add_source_with_indent(symbol_value(Result), " = if from_space.ok"
+                                     " && to_space.ok { 1 } else { 0 };\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+    return true;
+}
+
+
+
+bool
+BackendArtic::build_artic_transform(const Opcode& op)
+{
+    // transform Result [fromspace] tospace P
+    // transform Result M P
+    // (the same for transformv and transformn)
+    int nargs = op.nargs();
+    const Symbol& Result(*opargsym(op, 0));
+    const Symbol& To(*opargsym(op, nargs - 2));
+    const Symbol& P(*opargsym(op, nargs - 1));
+    const Symbol* From = nargs == 4 ? opargsym(op, 1) : nullptr;
+
+    std::string m;
+    if (To.typespec().is_matrix())
+        m = symbol_value(To);
+    else if (!From || is_common_space(*From))
+        m = named_space(To) + ".inverse";
+    else if (is_common_space(To))
+        m = named_space(*From) + ".matrix";
+    else
+        m = "space_transform(" + named_space(*From) + ", " + named_space(To)
+            + ")";
+
+    const char* fn = op.opname() == "transformv"   ? "transform_vector"
+                     : op.opname() == "transformn" ? "transform_normal"
+                                                   : "transform_point";
+    m_source->add_source_with_indent(symbol_value(Result), " = ", fn, "(", m,
+                                     ", ", symbol_value(P), ");\n");
+    return true;
+}
+
+
+
+bool
+BackendArtic::build_artic_getattribute(const Opcode& op)
+{
+    // getattribute Result [object] name [index] value
+    int nargs          = op.nargs();
+    bool array_lookup  = opargsym(op, nargs - 2)->typespec().is_int();
+    bool object_lookup = opargsym(op, 2)->typespec().is_string() && nargs >= 4;
+    const Symbol& Result(*opargsym(op, 0));
+    const Symbol* Object = object_lookup ? opargsym(op, 1) : nullptr;
+    const Symbol& Name(*opargsym(op, object_lookup ? 2 : 1));
+    const Symbol* Index = array_lookup ? opargsym(op, nargs - 2) : nullptr;
+    const Symbol& Value(*opargsym(op, nargs - 1));
+    if (Value.typespec().is_closure_based()
+        || Value.typespec().is_structure_based())
+        return false;
+    TypeDesc type = Value.typespec().simpletype();
+
+    std::string lookup = Strutil::sprintf(
+        "attribute_value(sg.shaderglobals, %s, %s, %s, %s, %s, &mut %s)",
+        Object ? string_chars(*Object) : "\"\"", string_chars(Name),
+        array_lookup ? "true" : "false", Index ? symbol_value(*Index) : "0",
+        artic_typedesc(type), symbol_value(Value));
+
+    // A query with nothing but literals may have the same answer for
+    // every point, which the renderer tells by answering it without
+    // one.  Whatever fits the table is asked for once per batch, and
+    // only asked for again per point when the renderer can't say.
+    bool uniform = Name.is_constant() && (!Object || Object->is_constant())
+                   && (!Index || Index->is_constant()) && type.size() <= 64;
+    if (!uniform) {
+        m_source->add_source_with_indent(symbol_value(Result), " = ", lookup,
+                                         ";\n");
+        return true;
+    }
+    ArticAttribute attr { Object ? Object->get_string() : ustring(),
+                          Name.get_string(), array_lookup,
+                          Index ? Index->get_int() : 0, type };
+    size_t slot = 0;
+    while (slot < m_attributes.size()
+           && !(m_attributes[slot].object == attr.object
+                && m_attributes[slot].name == attr.name
+                && m_attributes[slot].array_lookup == attr.array_lookup
+                && m_attributes[slot].index == attr.index
+                && m_attributes[slot].type == attr.type))
+        ++slot;
+    if (slot == m_attributes.size())
+        m_attributes.push_back(attr);
+    m_source->add_source_with_indent(symbol_value(Result),
+                                     " = uniform_attribute_value(attribute(",
+                                     std::to_string(slot), "), &mut ",
+                                     symbol_value(Value), ", || ", lookup,
+                                     ");\n");
+    return true;
+}
+
+
+
+void
+BackendArtic::find_artic_messages()
+{
+    for (int layer = 0; layer < group().nlayers(); ++layer) {
+        const ShaderInstance* linst = group()[layer];
+        if (linst->unused())
+            continue;
+        for (auto&& op : linst->ops()) {
+            if (op.opname() != op_setmessage || op.nargs() != 2)
+                continue;
+            const Symbol* name  = linst->argsymbol(op.firstarg());
+            const Symbol* value = linst->argsymbol(op.firstarg() + 1);
+            if (name->is_constant() && literal_message(name->get_string()) < 0)
+                m_messages.push_back(
+                    { name->get_string(), value->typespec(), layer });
+        }
+    }
+}
+
+
+
+int
+BackendArtic::literal_message(ustring name) const
+{
+    for (size_t k = 0; k < m_messages.size(); ++k)
+        if (m_messages[k].name == name)
+            return int(k);
+    return -1;
+}
+
+
+
+bool
+BackendArtic::build_artic_setmessage(const Opcode& op)
+{
+    // setmessage name value
+    const Symbol& Name(*opargsym(op, 0));
+    const Symbol& Value(*opargsym(op, 1));
+    if (!Name.is_constant()) {
+        // Closures can't be stored outside of the shader.
+        if (Value.typespec().is_closure_based())
+            return false;
+        m_source->add_source_with_indent(
+            Strutil::sprintf("message_set(sg.shaderglobals, %s, %s, %s, %d);\n",
+                             string_chars(Name),
+                             artic_typedesc(Value.typespec().simpletype()),
+                             symbol_value(Value), layer()));
+        return true;
+    }
+
+    // Only the first layer to set a message sets it, and only once, like
+    // osl_setmessage; anything else is an error there and ignored here.
+    const ArticMessage& m(m_messages[literal_message(Name.get_string())]);
+    if (m.layer != layer()
+        || artic_string(m.type, 0) != artic_string(Value.typespec(), 0))
+        return true;
+    std::string msg = "message_"
+                      + std::to_string(literal_message(Name.get_string()));
+    m_source->add_source_with_indent("if !", msg, "_set {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent(msg, " = ", symbol_value(Value), ";\n");
+    m_source->add_source_with_indent(msg, "_set = true;\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+    return true;
+}
+
+
+
+bool
+BackendArtic::build_artic_getmessage(const Opcode& op)
+{
+    // getmessage Result [source] name value
+    bool has_source = op.nargs() == 4;
+    const Symbol& Result(*opargsym(op, 0));
+    const Symbol& Name(*opargsym(op, 1 + has_source));
+    const Symbol& Value(*opargsym(op, 2 + has_source));
+    if (has_source || !Name.is_constant()) {
+        if (Value.typespec().is_closure_based())
+            return false;
+        m_source->add_source_with_indent(
+            Strutil::sprintf("%s = message_get(sg.shaderglobals, %s, %s, %s, "
+                             "&mut %s, %d);\n",
+                             symbol_value(Result),
+                             has_source ? string_chars(*opargsym(op, 1))
+                                        : "\"\"",
+                             string_chars(Name),
+                             artic_typedesc(Value.typespec().simpletype()),
+                             symbol_value(Value), layer()));
+        return true;
+    }
+
+    // Messages nobody sets, that a later layer sets or that have another
+    // type are never found (osl_getmessage reports the last two).
+    int k = literal_message(Name.get_string());
+    if (k < 0 || m_messages[k].layer > layer()
+        || artic_string(m_messages[k].type, 0)
+               != artic_string(Value.typespec(), 0)) {
+        m_source->add_source_with_indent(symbol_value(Result), " = 0;\n");
+        return true;
+    }
+    std::string msg = "message_" + std::to_string(k);
+    m_source->add_source_with_indent("if ", msg, "_set {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent(symbol_value(Value), " = ", msg, ";\n");
+    m_source->add_source_with_indent(symbol_value(Result), " = 1;\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("} else {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent(symbol_value(Result), " = 0;\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+    return true;
+}
+
+
+
+bool
+BackendArtic::build_artic_trace(const Opcode& op)
+{
+    // trace Result P R [token value]...
+    const Symbol& Result(*opargsym(op, 0));
+    const Symbol& Pos(*opargsym(op, 1));
+    const Symbol& Dir(*opargsym(op, 2));
+    m_source->add_source_with_indent("{\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent("let mut traceopt = default_trace_opt();\n");
+    for (int a = 3; a + 1 < op.nargs(); a += 2) {
+        const Symbol& Name(*opargsym(op, a));
+        const Symbol& Val(*opargsym(op, a + 1));
+        ustring name     = Name.get_string();
+        TypeDesc valtype = Val.typespec().simpletype();
+        if ((name == Strings::mindist || name == Strings::maxdist)
+            && valtype == TypeDesc::FLOAT) {
+            m_source->add_source_with_indent("traceopt.", name.string(), " = ",
+                                             symbol_value(Val), ";\n");
+        } else if (name == Strings::shade && valtype == TypeDesc::INT) {
+            m_source->add_source_with_indent("traceopt.shade = ",
+                                             symbol_value(Val), ";\n");
+        } else if (name == Strings::traceset && valtype == TypeDesc::STRING) {
+            m_source->add_source_with_indent("traceopt.traceset = ",
+                                             symbol_value(Val), ";\n");
+        } else {
+            shadingcontext()->errorf(
+                "Unknown trace() optional argument: \"%s\", <%s> (%s:%d)",
+                name, valtype, op.sourcefile(), op.sourceline());
+        }
+    }
+    m_source->add_source_with_indent(
+        symbol_value(Result), " = trace_ray(sg.shaderglobals, traceopt, ",
+        symbol_value(Pos), ", ", deriv_value(Pos, 1), ", ",
+        deriv_value(Pos, 2), ", ", symbol_value(Dir), ", ",
+        deriv_value(Dir, 1), ", ", deriv_value(Dir, 2), ");\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+    return true;
+}
+
+
+
+bool
+BackendArtic::build_artic_color(const Opcode& op)
+{
+    // blackbody Result temperature
+    // wavelength_color Result lambda
+    // luminance Result C
+    // transformc Result fromspace tospace C
+    // color Result fromspace c0 c1 c2
+    ustring opname = op.opname();
+    auto arg       = [&](int i) -> const Symbol& { return *opargsym(op, i); };
+    std::string cs = color_system();
+    std::string val;
+    if (opname == "blackbody" || opname == "wavelength_color") {
+        val = Strutil::sprintf("color_%s(%s, %s)",
+                               opname == "blackbody" ? "blackbody"
+                                                     : "wavelength",
+                               cs, convert(arg(1), TypeDesc::TypeFloat));
+    } else if (opname == "luminance") {
+        val = "color_luminance(" + cs + ", " + symbol_value(arg(1)) + ")";
+    } else {
+        // Between two linear spaces named literally, the std library
+        // folds this into one matrix multiply.
+        std::string to = "Strings::rgb", c;
+        if (opname == "transformc") {
+            to = symbol_value(arg(2));
+            c  = symbol_value(arg(3));
+        } else {
+            c = Strutil::sprintf("make_vector(%s, %s, %s)",
+                                 convert(arg(2), TypeDesc::TypeFloat),
+                                 convert(arg(3), TypeDesc::TypeFloat),
+                                 convert(arg(4), TypeDesc::TypeFloat));
+        }
+        val = Strutil::sprintf("color_transformc(%s, %s, %s, %s, "
+                               "sg.shaderglobals)",
+                               cs, symbol_value(arg(1)), to, c);
+    }
+    m_source->add_source_with_indent(symbol_value(arg(0)), " = ", val, ";\n");
+    return true;
+}
+
+
+
+std::string
+BackendArtic::color_system()
+{
+    if (shadingsys().colorsystem().colorspace() == Strings::Rec709)
+        return "default_color_system()";
+    m_color_system = true;
+    return artic_identifier(group().name()) + "_color_system()";
+}
+
+
+
+// Artic literal of a color, as a Color or as an [f32 * 3] table row.
+static std::string
+artic_color_literal(const Color3& c, bool row)
+{
+    std::vector<std::string> values { Strutil::sprintf("%.9g", c.x),
+                                      Strutil::sprintf("%.9g", c.y),
+                                      Strutil::sprintf("%.9g", c.z) };
+    return row ? artic_param_literal("float", true, values)
+               : artic_param_literal("color", false, values);
+}
+
+
+
+// color_matrix() call of an Imath matrix, whose rows transform colors the
+// same way on both sides.
+static std::string
+artic_color_matrix(const Matrix33& m)
+{
+    return Strutil::sprintf(
+        "color_matrix([%s, %s, %s])",
+        artic_color_literal(Color3(m[0][0], m[0][1], m[0][2]), true),
+        artic_color_literal(Color3(m[1][0], m[1][1], m[1][2]), true),
+        artic_color_literal(Color3(m[2][0], m[2][1], m[2][2]), true));
+}
+
+
+
+void
+BackendArtic::build_artic_color_system()
+{
+    if (!m_color_system)
+        return;
+    // The same tables set_colorspace computed for the JIT, as constants.
+    const ColorSystem& cs(shadingsys().colorsystem());
+    std::string group_name = artic_identifier(group().name());
+    int n                  = cs.blackbody_table_size();
+    m_source->add_source_with_indent("\nstatic ", group_name,
+                                     "_blackbody_table: [[f32 * 3] * ",
+                                     std::to_string(n), "] = [\n");
+    m_source->push_indent();
+    for (int i = 0; i < n; ++i)
+        m_source->add_source_with_indent(
+            artic_color_literal(cs.blackbody_table()[i], true),
+            i + 1 < n ? ",\n" : "\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("];\n");
+
+    m_source->add_source_with_indent("\nfn @", group_name,
+                                     "_color_system() -> ColorSystem {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent("ColorSystem {\n");
+    m_source->push_indent();
+    m_source->add_source_with_indent("name = ",
+                                     artic_string_hash(cs.colorspace()),
+                                     ",\n");
+    m_source->add_source_with_indent("xyz_to_rgb = ",
+                                     artic_color_matrix(cs.XYZ2RGB()), ",\n");
+    m_source->add_source_with_indent("rgb_to_xyz = ",
+                                     artic_color_matrix(cs.RGB2XYZ()), ",\n");
+    m_source->add_source_with_indent(
+        "luminance_scale = ",
+        artic_color_literal(cs.luminance_scale(), false), ",\n");
+    m_source->add_source_with_indent("blackbody_table = @|i| "
+                                     "color_table_entry(",
+                                     group_name, "_blackbody_table(i))\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+}
+
+
+
+
+void
+BackendArtic::build_artic_batch_constants()
+{
+    // The group entries run their body with space(slot) returning the
+    // coordinate system of each slot and attribute(slot) the attribute
+    // query of each slot, looked up through the renderer once for all
+    // the points they shade.
+    std::string group_name = artic_identifier(group().name());
+    m_source->add_source_with_indent("\nfn @", group_name,
+                                     "_with_batch_constants(shaderglobals: "
+                                     "ShaderGlobalsPtr, body: fn(fn(i32) -> "
+                                     "NamedSpace, fn(i32) -> UniformAttribute) "
+                                     "-> ()) -> () {\n");
+    m_source->push_indent();
+    std::string space = "|_| common_space()";
+    if (size_t n = m_named_spaces.size()) {
+        m_source->add_source_with_indent("let spaces = [");
+        for (size_t i = 0; i < n; ++i)
+            m_source->add_source(i ? ", " : "", "named_space(shaderglobals, ",
+                                 artic_string_literal(m_named_spaces[i]),
+                                 ")");
+        m_source->add_source("];\n");
+        space = "|slot| spaces(slot)";
+    }
+    std::string attribute = "|_| no_uniform_attribute()";
+    if (size_t n = m_attributes.size()) {
+        m_source->add_source_with_indent("let attributes = [");
+        for (size_t i = 0; i < n; ++i) {
+            const ArticAttribute& a(m_attributes[i]);
+            m_source->add_source(i ? ",\n" : "\n");
+            m_source->push_indent();
+            m_source->add_source_with_indent(
+                "uniform_attribute(shaderglobals, ",
+                artic_string_literal(a.object), ", ",
+                artic_string_literal(a.name), ", ",
+                a.array_lookup ? "true" : "false", ", ",
+                std::to_string(a.index), ", ", artic_typedesc(a.type), ")");
+            m_source->pop_indent();
+        }
+        m_source->add_source("\n");
+        m_source->add_source_with_indent("];\n");
+        attribute = "|slot| attributes(slot)";
+    }
+    m_source->add_source_with_indent("body(", space, ", ", attribute, ")\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+}
+
+
+
+void
+BackendArtic::build_artic_strings()
+{
+    // Like _load_textures, called once by the drivers after loading the
+    // compiled group and before shading with it.
+    std::string group_name = artic_identifier(group().name());
+    m_source->add_source_with_indent("\n#[export]\n");
+    m_source->add_source_with_indent("fn ", group_name,
+                                     "_load_strings() -> () {\n");
+    m_source->push_indent();
+    for (ustring str : m_strings)
+        m_source->add_source_with_indent("string_intern(",
+                                         artic_string_literal(str), ");\n");
+    m_source->pop_indent();
+    m_source->add_source_with_indent("}\n");
+}
+
+
+
+};  // namespace pvt
+OSL_NAMESPACE_EXIT
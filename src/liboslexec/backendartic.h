@@ -0,0 +1,230 @@
+// Copyright Contributors to the Open Shading Language project.
+// SPDX-License-Identifier: BSD-3-Clause
+// https://github.com/AcademySoftwareFoundation/OpenShadingLanguage
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "oslexec_pvt.h"
+using namespace OSL;
+using namespace OSL::pvt;
+
+
+OSL_NAMESPACE_ENTER
+
+class ArticSource;
+
+namespace pvt {  // OSL::pvt
+
+
+
+/// OSOProcessor that writes the optimized instructions of a shader group
+/// (after RuntimeOptimizer::run) as Artic source, so that AOT-compiled
+/// shaders start from code that has already been constant folded and
+/// stripped of dead code.
+///
+/// Every used layer becomes one Artic function taking the globals, the
+/// group's per-batch constants (named coordinate systems and attributes),
+/// its connected parameters and the messages earlier layers set for it,
+/// and returning its output parameters; a group entry `<group>_impl`
+/// runs the layers in order.  Control flow is
+/// rebuilt from the op jump targets, the same way BackendLLVM builds its
+/// basic blocks, and each remaining op becomes a call into the Artic
+/// std library using the naming scheme of the AST transpiler.
+class BackendArtic final : public OSOProcessorBase {
+public:
+    BackendArtic(ShadingSystemImpl& shadingsys, ShaderGroup& group,
+                 ShadingContext* context);
+
+    virtual ~BackendArtic();
+
+    /// Generate the Artic source for the whole group.
+    virtual void run();
+
+    /// The generated source (valid after run()).
+    const std::string& artic_source() const { return m_artic_source; }
+
+    /// Did every op in the group have an Artic translation?
+    bool ok() const { return m_ok; }
+
+private:
+    /// Emit the function for the current layer.
+    void build_artic_instance();
+
+    /// Emit the ops in [beginop,endop), recursing into the blocks of
+    /// control flow ops.
+    bool build_artic_code(int beginop, int endop);
+
+    /// Emit one op that isn't control flow.
+    bool build_artic_op(const Opcode& op);
+
+    /// Emit a structured loop for a for/while/dowhile op.
+    bool build_artic_loop(const Opcode& op, int opnum);
+
+    /// Emit a texture, texture3d or environment op.
+    bool build_artic_texture(const Opcode& op);
+
+    /// Emit the TextureOpt for the optional token/value args of a texture
+    /// op starting at arg first, and find its "alpha" output.
+    bool build_artic_texture_options(const Opcode& op, int first, bool tex3d,
+                                     std::string& alpha);
+
+    /// Emit a gettextureinfo op.
+    bool build_artic_gettextureinfo(const Opcode& op);
+
+    /// Artic string literal and handle expression for a texture file name.
+    /// Literal names get a slot of the group's handle table when the
+    /// opt_texture_handle option is on.
+    bool texture_file(const Symbol& filename, std::string& name,
+                      std::string& handle);
+
+    /// Emit the group entries, which run all used layers in order.
+    void build_artic_group_entry();
+
+    /// Emit the calls of all used layers, starting from the globals
+    /// 'inout'; return the name of the resulting globals.
+    std::string build_artic_layer_calls();
+
+    /// Emit the stores of the renderer outputs through output(slot),
+    /// after build_artic_layer_calls.
+    void build_artic_output_stores();
+
+    /// Emit the group's texture handle table and the entry that resolves
+    /// it once when the compiled group is loaded.
+    void build_artic_texture_handles();
+
+    /// Emit a matrix op that names a coordinate system.
+    bool build_artic_matrix(const Opcode& op);
+
+    /// Emit a getmatrix op.
+    bool build_artic_getmatrix(const Opcode& op);
+
+    /// Emit a transform, transformv or transformn op.
+    bool build_artic_transform(const Opcode& op);
+
+    /// Emit a getattribute op.  Literal queries get a slot of the group's
+    /// uniform attribute table, asked for once per shade batch.
+    bool build_artic_getattribute(const Opcode& op);
+
+    /// Emit a setmessage or getmessage op.
+    bool build_artic_setmessage(const Opcode& op);
+    bool build_artic_getmessage(const Opcode& op);
+
+    /// Emit a trace op.
+    bool build_artic_trace(const Opcode& op);
+
+    /// Emit a blackbody, wavelength_color, luminance or transformc op, or
+    /// a color op naming the color space of its components.
+    bool build_artic_color(const Opcode& op);
+
+    /// ColorSystem expression for the shading system's colorspace.
+    std::string color_system();
+
+    /// Emit the tables of the shading system's colorspace, if the group
+    /// uses them and they aren't the std library's default Rec709 ones.
+    void build_artic_color_system();
+
+    /// Find the messages the used layers set under literal names.
+    void find_artic_messages();
+
+    /// Index of the group message with the given literal name, -1 if no
+    /// layer sets it.
+    int literal_message(ustring name) const;
+
+    /// NamedSpace expression for the coordinate system named by a string
+    /// symbol.  Literal renderer spaces get a slot of the group's named
+    /// space table, resolved once per shade batch.
+    std::string named_space(const Symbol& name);
+
+    /// Is name the literal "common" space (or its synonym)?
+    bool is_common_space(const Symbol& name) const;
+
+    /// Emit the function that resolves the group's named space and
+    /// uniform attribute tables and runs a body with them, for the group
+    /// entries.
+    void build_artic_batch_constants();
+
+    /// Emit the entry that interns the characters of the group's string
+    /// literals and string parameter values when it is loaded.
+    void build_artic_strings();
+
+    /// Artic identifier of a symbol of the current layer.
+    std::string symbol_name(const Symbol& sym) const;
+
+    /// Expression reading a symbol: a literal for constants, the global
+    /// struct field for globals, the local otherwise.
+    std::string symbol_value(const Symbol& sym) const;
+
+    /// Artic literal holding the value stored with a symbol (its constant
+    /// value or the instance value of a parameter).
+    std::string symbol_literal(const Symbol& sym) const;
+
+    /// Expression converting src to the type dst.
+    std::string convert(const Symbol& src, const TypeSpec& dst) const;
+
+    /// NUL-terminated characters of a string symbol, for the renderer
+    /// imports.
+    std::string string_chars(const Symbol& sym) const;
+
+    /// Boolean expression that is true when sym is nonzero.
+    std::string test_nonzero(const Symbol& sym) const;
+
+    /// Expression for the x (axis 1) or y (axis 2) derivative of sym.
+    /// Only the derivatives of globals are known; the rest are zero.
+    std::string deriv_value(const Symbol& sym, int axis) const;
+
+    /// Name of the Artic function for a layer.
+    std::string artic_layer_name(int layer) const;
+
+    ArticSource* m_source;
+    std::string m_artic_source;
+    bool m_ok;
+
+    /// Names of the continuations bound for the enclosing loops and
+    /// inlined function calls, innermost last.
+    std::vector<std::string> m_loop_break;
+    std::vector<std::string> m_loop_continue;
+    std::vector<std::string> m_function_return;
+    int m_next_block;
+
+    /// Literal texture file names, indexed by handle table slot.
+    std::vector<ustring> m_texture_files;
+
+    /// Literal renderer coordinate system names, indexed by named space
+    /// table slot.
+    std::vector<ustring> m_named_spaces;
+
+    /// Non-empty string literals and parameter values of the used layers.
+    std::vector<ustring> m_strings;
+
+    /// Literal attribute queries, indexed by uniform attribute table slot.
+    struct ArticAttribute {
+        ustring object, name;
+        bool array_lookup;
+        int index;
+        TypeDesc type;
+    };
+    std::vector<ArticAttribute> m_attributes;
+
+    /// Messages set under a literal name, with their type and the first
+    /// layer that sets them.  They are locals of that layer, handed on to
+    /// the later layers that get them; setmessage and getmessage with
+    /// other names go through the shading context at run time, and don't
+    /// see these.
+    struct ArticMessage {
+        ustring name;
+        TypeSpec type;
+        int layer;
+    };
+    std::vector<ArticMessage> m_messages;
+
+    /// Does the group use the tables of a colorspace other than Rec709?
+    bool m_color_system;
+};
+
+
+
+};  // namespace pvt
+OSL_NAMESPACE_EXIT
@@ -81,6 +81,7 @@ BackendLLVM::BackendLLVM (ShadingSystemImpl &shadingsys,
     ll.dumpasm(shadingsys.m_llvm_dumpasm);
     ll.jit_fma(shadingsys.m_llvm_jit_fma);
     ll.jit_aggressive(shadingsys.m_llvm_jit_aggressive);
+    ll.string_hashes(shadingsys.m_llvm_string_hashes);
 }
 
 
@@ -373,6 +374,54 @@ BackendLLVM::addCUDAVariable(const std::string& name, int size, int alignment,
 
 
 
+llvm::Value *
+BackendLLVM::llvm_const_data_ptr (const Symbol& sym)
+{
+    if (! ll.string_hashes() || use_optix())
+        return ll.constant_ptr (sym.data());
+
+    std::string name = Strutil::sprintf ("%s_%s_data", layer_function_name(),
+                                         sym.mangled());
+    auto it = m_const_map.find (name);
+    if (it != m_const_map.end())
+        return ll.void_ptr (it->second);
+
+    TypeDesc t = sym.typespec().simpletype();
+    int n = int(t.numelements() * t.aggregate);
+    llvm::Type *elemtype = nullptr;
+    std::vector<llvm::Constant*> values (n);
+    if (t.basetype == TypeDesc::FLOAT) {
+        elemtype = ll.type_float();
+        for (int i = 0; i < n; ++i)
+            values[i] = ll.constant (((const float *)sym.data())[i]);
+    } else if (t.basetype == TypeDesc::INT) {
+        elemtype = ll.type_int();
+        for (int i = 0; i < n; ++i)
+            values[i] = ll.constant (((const int *)sym.data())[i]);
+    } else if (t.basetype == TypeDesc::STRING) {
+        elemtype = ll.type_string();
+        for (int i = 0; i < n; ++i) {
+            ustring s = ((const ustring *)sym.data())[i];
+            values[i] = s.c_str() ? ll.string_symbol (s)
+                        : llvm::ConstantPointerNull::get (ll.type_string());
+            if (! values[i])
+                return ll.constant_ptr (sym.data());
+        }
+    } else {
+        return ll.constant_ptr (sym.data());
+    }
+
+    llvm::ArrayType *type = llvm::ArrayType::get (elemtype, n);
+    llvm::GlobalVariable *g_var = new llvm::GlobalVariable (*ll.module(), type,
+        true /*isConstant*/, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantArray::get (type, values), name);
+    g_var->setUnnamedAddr (llvm::GlobalValue::UnnamedAddr::Global);
+    m_const_map[name] = g_var;
+    return ll.void_ptr (g_var);
+}
+
+
+
 void
 BackendLLVM::createOptixMetadata (const std::string& name, const Symbol& sym)
 {
@@ -554,7 +603,7 @@ BackendLLVM::llvm_get_pointer (const Symbol& sym, int deriv,
         }
         else {
             // For constants, start with *OUR* pointer to the constant values.
-            result = ll.ptr_cast (ll.constant_ptr (sym.data()),
+            result = ll.ptr_cast (llvm_const_data_ptr (sym),
                                   ll.type_ptr (llvm_type(sym.typespec().elementtype())));
         }
 
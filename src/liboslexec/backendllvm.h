@@ -58,6 +58,18 @@ public:
     /// Create an llvm function for group initialization code.
     llvm::Function* build_llvm_init ();
 
+    /// Is the layer left to be JITed when it first runs (llvm_lazy_jit)?
+    /// That's any layer run only on demand by others.
+    bool layer_jitted_lazily (int layer) const {
+        return m_lazy_jit && m_layer_remap[layer] != -1 &&
+               ! group().is_entry_layer(layer) && group()[layer]->run_lazily();
+    }
+
+    /// Create the stub through which a layer JITed when it first runs is
+    /// called: it has osl_jit_layer JIT the layer the first time, then
+    /// calls it.
+    llvm::Function* build_llvm_lazy_stub (int layer);
+
     /// Build up LLVM IR code for the given range [begin,end) or
     /// opcodes, putting them (initially) into basic block bb (or the
     /// current basic block if bb==NULL).
@@ -214,6 +226,12 @@ public:
     llvm::Value *addCUDAVariable (const std::string& name, int size, int alignment,
                                   const void* data, TypeDesc type=TypeDesc::UNKNOWN);
 
+    /// Return a void* to the values held by sym.data(): that pointer
+    /// itself or, when strings are JITed as hashes, a private constant
+    /// copy of the values in the module, so the code doesn't refer to
+    /// memory of this process.
+    llvm::Value *llvm_const_data_ptr (const Symbol& sym);
+
     /// Create the extra semantic information needed for OptiX variables
     void createOptixMetadata (const std::string& name, const Symbol& sym );
 
@@ -433,6 +451,7 @@ private:
     std::vector<int> m_layer_remap;     ///< Remapping of layer ordering
     std::set<int> m_layers_already_run; ///< List of layers run
     int m_num_used_layers;              ///< Number of layers actually used
+    bool m_lazy_jit = false;            ///< JIT lazy layers when they run?
 
     double m_stat_total_llvm_time;        ///<   total time spent on LLVM
     double m_stat_llvm_setup_time;        ///<     llvm setup time
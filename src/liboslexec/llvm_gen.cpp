@@ -136,8 +136,13 @@ BackendLLVM::llvm_call_layer (int layer, bool unconditional)
         // insert point is now then_block
     }
 
+    // A layer JITed when it first runs is called through its stub.
+    std::string name = layer_function_name (group(), *parent);
+    if (layer_jitted_lazily (layer))
+        name += "_stub";
+
     // Mark the call as a fast call
-    llvm::Value *funccall = ll.call_function (layer_function_name(group(), *parent).c_str(), args);
+    llvm::Value *funccall = ll.call_function (name.c_str(), args);
     if (!parent->entry_layer())
         ll.mark_fast_func_call (funccall);
 
@@ -3299,6 +3304,24 @@ llvm_gen_keyword_fill(BackendLLVM &rop, Opcode &op, const ClosureRegistry::Closu
 
 
 
+// The address of an object or function of this process (the renderer, a
+// closure callback), referred to by a named symbol that the JIT resolves
+// so that the IR is still the same in another process and can go through
+// the JIT cache. OptiX can't resolve such symbols, and a name already
+// taken by another address falls back to the constant address.
+static llvm::Value *
+llvm_process_ptr (BackendLLVM &rop, string_view name, void *p,
+                  llvm::PointerType *type)
+{
+    if (! rop.use_optix()) {
+        if (llvm::Value *sym = rop.ll.pointer_symbol (name, p, type))
+            return sym;
+    }
+    return rop.ll.constant_ptr (p, type);
+}
+
+
+
 LLVMGEN (llvm_gen_closure)
 {
     Opcode &op (rop.inst()->ops()[opnum]);
@@ -3325,7 +3348,7 @@ LLVMGEN (llvm_gen_closure)
 
     // Call osl_allocate_closure_component(closure, id, size).  It returns
     // the memory for the closure parameter data.
-    llvm::Value *render_ptr = rop.ll.constant_ptr(rop.shadingsys().renderer(), rop.ll.type_void_ptr());
+    llvm::Value *render_ptr = llvm_process_ptr (rop, "renderer", rop.shadingsys().renderer(), rop.ll.type_void_ptr());
     llvm::Value *sg_ptr = rop.sg_void_ptr();
     llvm::Value *id_int = rop.ll.constant(clentry->id);
     llvm::Value *size_int = rop.ll.constant(clentry->struct_size);
@@ -3357,7 +3380,8 @@ LLVMGEN (llvm_gen_closure)
     // zero out the closure parameter memory.
     if (clentry->prepare) {
         // Call clentry->prepare(renderservices *, int id, void *mem)
-        llvm::Value *funct_ptr = rop.ll.constant_ptr((void *)clentry->prepare, rop.llvm_type_prepare_closure_func());
+        llvm::Value *funct_ptr = llvm_process_ptr (rop, Strutil::sprintf("closure_prepare_%s", closure_name),
+                                                   (void *)clentry->prepare, rop.llvm_type_prepare_closure_func());
         llvm::Value *args[] = {render_ptr, id_int, mem_void_ptr};
         rop.ll.call_function (funct_ptr, args);
     } else {
@@ -3395,7 +3419,8 @@ LLVMGEN (llvm_gen_closure)
     // setup(render_services, id, mem_ptr).
     if (clentry->setup) {
         // Call clentry->setup(renderservices *, int id, void *mem)
-        llvm::Value *funct_ptr = rop.ll.constant_ptr((void *)clentry->setup, rop.llvm_type_setup_closure_func());
+        llvm::Value *funct_ptr = llvm_process_ptr (rop, Strutil::sprintf("closure_setup_%s", closure_name),
+                                                   (void *)clentry->setup, rop.llvm_type_setup_closure_func());
         llvm::Value *args[] = {render_ptr, id_int, mem_void_ptr};
         rop.ll.call_function (funct_ptr, args);
     }
@@ -3516,8 +3541,8 @@ LLVMGEN (llvm_gen_pointcloud_search)
     static ustring errorfmt("Arrays too small for pointcloud lookup at (%s:%d)");
     llvm::Value *err_args[] = {
         rop.sg_void_ptr(),
-        rop.ll.constant_ptr ((void *)errorfmt.c_str()),
-        rop.ll.constant_ptr ((void *)op.sourcefile().c_str()),
+        rop.ll.constant (errorfmt),
+        rop.ll.constant (op.sourcefile()),
         rop.ll.constant (op.sourceline()),
     };
     rop.ll.call_function ("osl_error", err_args);
@@ -3576,8 +3601,8 @@ LLVMGEN (llvm_gen_pointcloud_get)
     static ustring errorfmt("Arrays too small for pointcloud attribute get at (%s:%d)");
     llvm::Value *err_args[] = {
         rop.sg_void_ptr(),
-        rop.ll.constant_ptr ((void *)errorfmt.c_str()),
-        rop.ll.constant_ptr ((void *)op.sourcefile().c_str()),
+        rop.ll.constant (errorfmt),
+        rop.ll.constant (op.sourcefile()),
         rop.ll.constant (op.sourceline()),
     };
     rop.ll.call_function ("osl_error", err_args);
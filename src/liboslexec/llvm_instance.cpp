@@ -511,7 +511,7 @@ BackendLLVM::llvm_assign_initial_value (const Symbol& sym, bool force)
     } else if (! sym.lockgeom() && ! sym.typespec().is_closure()) {
         // geometrically-varying param; memcpy its default value
         TypeDesc t = sym.typespec().simpletype();
-        ll.op_memcpy (llvm_void_ptr (sym), ll.constant_ptr (sym.data()),
+        ll.op_memcpy (llvm_void_ptr (sym), llvm_const_data_ptr (sym),
                       t.size(), t.basesize() /*align*/);
         if (sym.has_derivs())
             llvm_zero_derivs (sym);
@@ -875,6 +875,61 @@ BackendLLVM::build_llvm_init ()
 
 
 
+llvm::Function*
+BackendLLVM::build_llvm_lazy_stub (int layer)
+{
+    // Make code that looks like:
+    //     static std::atomic<void*> layer_code = NULL;
+    //     void layer_stub (ShaderGlobals *sg, GroupData *group)
+    //     {
+    //         if (! layer_code)
+    //             layer_code = osl_jit_layer (thisgroup, layer);
+    //         if (layer_code)
+    //             ((LayerFunc *)layer_code) (sg, group);
+    //     }
+    // Callers only get here when the layer_run flag says the layer hasn't
+    // run yet, so that is an extra test and an indirect call at most once
+    // per layer per shade. The code slot is loaded with acquire and stored
+    // with release, as any shading thread may be the first to get here.
+    // It stays NULL if the layer failed to JIT, which then doesn't run.
+    std::string name = layer_function_name (group(), *group()[layer]);
+    llvm::Value *code = new llvm::GlobalVariable (*ll.module(), ll.type_void_ptr(),
+                                                  false /* not constant */,
+                                                  llvm::GlobalValue::InternalLinkage,
+                                                  ll.void_ptr_null(), name + "_code");
+    ll.current_function (
+           ll.make_function (name + "_stub", true /* fastcall */,
+                             ll.type_void(), // return type
+                             llvm_type_sg_ptr(), llvm_type_groupdata_ptr()));
+    llvm::Value *args[] = { ll.current_function_arg(0), ll.current_function_arg(1) };
+
+    ll.new_builder (ll.new_basic_block (name + "_stub"));
+    llvm::BasicBlock *jit_block = ll.new_basic_block ("");
+    llvm::BasicBlock *call_block = ll.new_basic_block ("");
+    llvm::BasicBlock *after_block = ll.new_basic_block ("");
+    ll.op_branch (ll.op_eq (ll.op_load_acquire (code), ll.void_ptr_null()),
+                  jit_block, call_block);
+    // insert point is now jit_block
+    llvm::Value *jit_args[] = { ll.constant_ptr (&group()), ll.constant (layer) };
+    ll.op_store_release (ll.call_function ("osl_jit_layer", jit_args), code);
+    ll.op_branch (ll.op_eq (ll.op_load_acquire (code), ll.void_ptr_null()),
+                  after_block, call_block);
+
+    ll.set_insert_point (call_block);
+    llvm::Type *functype = ll.type_function_ptr (ll.type_void(),
+                                { llvm_type_sg_ptr(), llvm_type_groupdata_ptr() });
+    llvm::Value *funccall = ll.call_function (ll.ptr_cast (ll.op_load_acquire (code), functype),
+                                              args);
+    ll.mark_fast_func_call (funccall);
+    ll.op_branch (after_block);
+    ll.op_return();
+    ll.end_builder();  // clear the builder
+
+    return ll.current_function();
+}
+
+
+
 llvm::Function*
 BackendLLVM::build_llvm_instance (bool groupentry)
 {
@@ -1184,6 +1239,94 @@ static void empty_group_func (void*, void*)
 
 
 
+// Optimizes a unit that split_module() put in a module of its own, and
+// compiles it to an object, for llvm_parallel_layers and llvm_lazy_jit.
+struct UnitCompiler {
+    int debug, vector_width, optlevel;
+    bool target_host;
+
+    // Compile the module in bitcode, in the LLVMContext of thread_info,
+    // for the target of jit, and time the two steps. Errors go in err.
+    void operator() (LLVM_Util::PerThreadInfo &thread_info, LLVM_Util &jit,
+                     const std::string &bitcode, const std::string &name,
+                     std::string &object, double &opt_time, double &jit_time,
+                     std::string &err) const
+    {
+        OIIO::Timer timer;
+        llvm::Module *module = nullptr;
+        {
+            LLVM_Util ll (thread_info, debug, vector_width);
+            ll.jit_target (jit);
+            module = ll.module_from_bitcode (bitcode.data(), bitcode.size(),
+                                             name, &err);
+            if (! module)
+                return;
+            ll.module (module);
+            ll.setup_optimization_passes (optlevel, target_host);
+            ll.do_optimize (&err);
+            opt_time = timer.lap();
+            ll.emit_object (object, &err);
+            jit_time = timer.lap();
+        }
+        delete module;
+    }
+};
+
+}; // namespace pvt
+
+
+
+// The layers that llvm_lazy_jit left to be JITed when they first run, as
+// the modules split_module() made of them, and the JIT of the group,
+// which their objects join.
+struct ShaderGroup::LazyJIT {
+    LazyJIT (pvt::ShadingSystemImpl &shadingsys,
+             const pvt::UnitCompiler &compiler)
+        : shadingsys(shadingsys), compiler(compiler),
+          ll(thread_info, compiler.debug, compiler.vector_width) {}
+
+    pvt::ShadingSystemImpl &shadingsys;
+    pvt::UnitCompiler compiler;
+    pvt::LLVM_Util::PerThreadInfo thread_info; ///< Owns the context of ll
+    pvt::LLVM_Util ll;                    ///< The JIT of the group
+    mutex jit_mutex;                      ///< Guards ll and all below
+    std::vector<std::string> bitcode;     ///< Module of each lazy layer
+    std::vector<std::string> names;       ///< Function of each lazy layer
+    std::vector<void*> code;              ///< Each lazy layer, once JITed
+};
+
+
+
+void *
+ShaderGroup::llvm_jit_layer (int layer)
+{
+    LazyJIT &lazy (*m_llvm_lazy_jit);
+    lock_guard lock (lazy.jit_mutex);
+    // The bitcode is freed once the layer has been JITed, or has failed
+    // to, in which case its stub gets NULL and skips it from then on.
+    if (lazy.bitcode[layer].size()) {
+        OIIO::Timer timer;
+        std::string object, err;
+        double opt_time = 0.0, jit_time = 0.0;
+        lazy.compiler (lazy.thread_info, lazy.ll, lazy.bitcode[layer],
+                       lazy.names[layer], object, opt_time, jit_time, err);
+        if (err.empty() && lazy.ll.add_object (object, &err))
+            lazy.code[layer] = lazy.ll.getPointerToFunction (lazy.names[layer]);
+        else
+            lazy.shadingsys.errorf ("Failed to JIT %s, it will not run: %s",
+                                    lazy.names[layer], err);
+        std::string().swap (lazy.bitcode[layer]);  // free it
+        ++lazy.shadingsys.m_stat_llvm_lazy_layers_jitted;
+        spin_lock stat_lock (lazy.shadingsys.m_stat_mutex);
+        lazy.shadingsys.m_stat_llvm_lazy_jit_time += timer();
+    }
+    return lazy.code[layer];
+}
+
+
+
+namespace pvt {
+
 void
 BackendLLVM::run ()
 {
@@ -1231,6 +1374,7 @@ BackendLLVM::run ()
 
     // Create the ExecutionEngine. We don't create an ExecutionEngine in the
     // OptiX case, because we are using the NVPTX backend and not MCJIT
+    ll.jit_cache (shadingsys().llvm_jit_cache());
     if (! use_optix() &&
         ! ll.make_jit_execengine (&err, ll.lookup_isa_by_name(shadingsys().m_llvm_jit_target),
                                   shadingsys().llvm_debugging_symbols(),
@@ -1270,9 +1414,28 @@ BackendLLVM::run ()
 
     initialize_llvm_group ();
 
-    // Generate the LLVM IR for each layer.  Skip unused layers.
+    // Debug output needs the module to stay whole.
+    bool debug_output = llvm_debug() || shadingsys().llvm_debugging_symbols() ||
+                        shadingsys().llvm_profiling_events() ||
+                        shadingsys().llvm_output_bitcode();
+
+    // With llvm_lazy_jit, layers that only run when another layer needs
+    // them are called through stubs, and are only JITed if that happens.
+    m_lazy_jit = shadingsys().llvm_lazy_jit() && ! use_optix() && ! debug_output;
+
+    // Generate the LLVM IR for each layer.  Skip unused layers.  The
+    // init function and the layer functions are the units that are timed
+    // separately for the compile report, and with llvm_parallel_layers
+    // optimized and compiled separately.
     m_llvm_local_mem = 0;
+    OIIO::Timer unit_timer;
     llvm::Function* init_func = build_llvm_init ();
+    for (int layer = 0; layer < nlayers; ++layer)
+        if (layer_jitted_lazily (layer))
+            build_llvm_lazy_stub (layer);
+    std::vector<llvm::Function*> units { init_func };
+    std::vector<int> unit_layer { -1 };
+    std::vector<double> unit_ir_time { unit_timer.lap() };
     std::vector<llvm::Function*> funcs (nlayers, NULL);
     for (int layer = 0; layer < nlayers; ++layer) {
         set_inst (layer);
@@ -1281,6 +1444,9 @@ BackendLLVM::run ()
             // it's the single entry point for the whole group.
             bool is_single_entry = (layer == (nlayers-1) && group().num_entry_layers() == 0);
             funcs[layer] = build_llvm_instance (is_single_entry);
+            units.push_back (funcs[layer]);
+            unit_layer.push_back (layer);
+            unit_ir_time.push_back (unit_timer.lap());
         }
     }
     // llvm::Function* entry_func = group().num_entry_layers() ? NULL : funcs[m_num_used_layers-1];
@@ -1292,6 +1458,33 @@ BackendLLVM::run ()
                                  group().name(), m_llvm_local_mem/1024);
     }
 
+    // Can the group go through the persistent JIT cache? IR that bakes
+    // in addresses of this process can't be reused by another one, and
+    // neither can debug output be regenerated from a cached object.
+    bool jit_cacheable = ! use_optix() && shadingsys().llvm_jit_cache().size() &&
+                         ! ll.module_is_process_specific() && ! debug_output;
+
+    // Should the units be optimized and compiled in modules of their own,
+    // on several threads? Not if the module needs to stay whole: for the
+    // JIT cache, which keys and stores the module, or for debug output.
+    int parallel_threads = 0;
+    if (! use_optix() && ! jit_cacheable && ! debug_output)
+        parallel_threads = std::min (shadingsys().llvm_parallel_layers(),
+                                     int(units.size()));
+    bool parallel = parallel_threads > 1;
+
+    // Which units are left to be JITed when they first run? The group
+    // needs modules of its own for them, whether in parallel or not.
+    std::vector<bool> unit_deferred (units.size(), false);
+    int ndeferred = 0;
+    for (size_t i = 0; i < units.size(); ++i)
+        if (unit_layer[i] >= 0 && layer_jitted_lazily (unit_layer[i])) {
+            unit_deferred[i] = true;
+            ++ndeferred;
+        }
+    bool lazy = ndeferred > 0;
+    bool split = parallel || lazy;
+
     // The module contains tons of "library" functions that our generated IR
     // might call. But probably not. We don't want to incur the overhead of
     // fully compiling those, so we want to get rid of all functions not
@@ -1315,7 +1508,7 @@ BackendLLVM::run ()
         for (int layer = 0; layer < nlayers; ++layer) {
             // set_inst (layer);
             llvm::Function* f = funcs[layer];
-            if (f && group().is_entry_layer(layer))
+            if (f && (group().is_entry_layer(layer) || split))
                 entry_function_names.push_back (ll.func_name(f));
         }
         ll.internalize_module_functions ("osl_", external_function_names, entry_function_names);
@@ -1332,8 +1525,9 @@ BackendLLVM::run ()
             llvm::Function* f = funcs[layer];
             // If we plan to call bitcode_string of a layer's function after
             // optimization it may not exist after optimization unless we
-            // treat it as external.
-            if (f && (group().is_entry_layer(layer) || llvm_debug())) {
+            // treat it as external. Nor may it if it's to be compiled in
+            // a module of its own.
+            if (f && (group().is_entry_layer(layer) || llvm_debug() || split)) {
                 external_functions.insert(f);
             }
         }
@@ -1360,11 +1554,119 @@ BackendLLVM::run ()
         }
     }
 
-    // Optimize the LLVM IR unless it's a do-nothing group.
-    if (! group().does_nothing())
+    // Look the group up in the persistent JIT cache. The key hashes the
+    // pruned IR, which is the group as the runtime optimizer left it, so
+    // on a hit the native object is loaded when the engine is finalized
+    // and neither the LLVM optimizer nor codegen need to run.
+    bool jit_cached = false;
+    if (! use_optix() && shadingsys().llvm_jit_cache().size()) {
+        if (! jit_cacheable) {
+            ++shadingsys().m_stat_llvm_jit_cache_uncacheable;
+        } else {
+            std::string key = ll.jit_cache_key (
+                Strutil::sprintf ("llvm_optimize=%d llvm_target_host=%d",
+                                  shadingsys().llvm_optimize(),
+                                  shadingsys().llvm_target_host()));
+            jit_cached = ll.jit_cache_has (key);
+            if (jit_cached)
+                ++shadingsys().m_stat_llvm_jit_cache_hits;
+            else
+                ++shadingsys().m_stat_llvm_jit_cache_misses;
+        }
+    }
+
+    // Optimize the LLVM IR unless it's a do-nothing group or the JIT
+    // cache already has its optimized object.
+    //
+    // In parallel, each unit is split off with its own copy of the
+    // library functions it calls, then optimized and compiled to an
+    // object by one of the threads, in an LLVMContext of that thread.
+    // The objects are linked together when the engine is finalized, and
+    // what's left of the module only declares the units. IR generation
+    // itself stays serial, as all of it happens in our one context.
+    //
+    // The units left to be JITed when they first run are split off the
+    // same way, but only kept as bitcode, for ShaderGroup::llvm_jit_layer.
+    std::vector<std::string> names;
+    std::vector<std::string> pieces;
+    std::vector<std::string> objects;
+    std::vector<double> unit_opt_time (units.size(), 0.0);
+    std::vector<double> unit_jit_time (units.size(), 0.0);
+    UnitCompiler compiler { llvm_debug(), shadingsys().m_vector_width,
+                            shadingsys().llvm_optimize(),
+                            bool(shadingsys().llvm_target_host()) };
+    if (split) {
+        for (llvm::Function *f : units)
+            names.push_back (ll.func_name(f));
+        pieces = ll.split_module (units, &err);
+        if (err.size()) {
+            // split_module leaves the module whole when it fails, so it
+            // can still be compiled all at once.
+            shadingcontext()->warningf("Failed to split module, compiling it whole: %s", err);
+            err.clear ();
+            pieces.clear ();
+            // The stubs of the deferred layers then find them in place.
+            for (int layer = 0; layer < nlayers; ++layer) {
+                if (layer_jitted_lazily (layer)) {
+                    std::string name = layer_function_name (group(), *group()[layer]);
+                    ll.module()->getNamedGlobal (name + "_code")->setInitializer (
+                        llvm::ConstantExpr::getBitCast (funcs[layer], ll.type_void_ptr()));
+                }
+            }
+            std::fill (unit_deferred.begin(), unit_deferred.end(), false);
+            ndeferred = 0;
+            split = parallel = lazy = false;
+        }
+    }
+    if (split) {
+        std::vector<int> eager;
+        for (size_t i = 0; i < pieces.size(); ++i)
+            if (! unit_deferred[i])
+                eager.push_back (int(i));
+        objects.resize (pieces.size());
+        std::vector<std::string> errors (pieces.size());
+        std::atomic<int> next_piece (0);
+        auto compile_pieces = [&]() {
+            LLVM_Util::PerThreadInfo thread_info;
+            for (int e; (e = next_piece++) < int(eager.size()); ) {
+                int i = eager[e];
+                compiler (thread_info, ll, pieces[i], names[i], objects[i],
+                          unit_opt_time[i], unit_jit_time[i], errors[i]);
+            }
+        };
+        parallel_threads = std::max (1, std::min (parallel_threads, int(eager.size())));
+        std::vector<std::thread> threads;
+        for (int t = 1; t < parallel_threads; ++t)
+            threads.emplace_back (compile_pieces);
+        compile_pieces ();
+        for (auto&& thread : threads)
+            thread.join ();
+        for (size_t i = 0; i < errors.size(); ++i)
+            if (errors[i].size())
+                shadingcontext()->errorf("Failed to compile %s: %s", names[i], errors[i]);
+        if (parallel)
+            ++shadingsys().m_stat_llvm_parallel_groups;
+    }
+    else if (! group().does_nothing() && ! jit_cached)
         ll.do_optimize();
 
-    m_stat_llvm_opt_time += timer.lap();
+    if (split) {
+        // The threads optimized and compiled to objects at once. Divide
+        // the time between the two as the units' own times divide, so
+        // codegen counts as JIT time either way.
+        double opt_time = 0.0, jit_time = 0.0;
+        for (size_t i = 0; i < units.size(); ++i) {
+            opt_time += unit_opt_time[i];
+            jit_time += unit_jit_time[i];
+        }
+        double compile_time = timer.lap();
+        double opt_share = opt_time + jit_time > 0.0
+                         ? opt_time / (opt_time + jit_time) : 1.0;
+        m_stat_llvm_opt_time += compile_time * opt_share;
+        m_stat_llvm_jit_time += compile_time * (1.0 - opt_share);
+    }
+    else
+        m_stat_llvm_opt_time += timer.lap();
 
     if (llvm_debug()) {
         for (int layer = 0; layer < nlayers; ++layer)
@@ -1425,13 +1727,46 @@ BackendLLVM::run ()
 #endif
     }
     else {
+        // With deferred layers, the objects go in a JIT of the group's
+        // own, with its own context and memory, which outlives this one
+        // to take in the objects of those layers when they first run.
+        std::shared_ptr<ShaderGroup::LazyJIT> lazy_jit;
+        if (lazy) {
+            lazy_jit = std::make_shared<ShaderGroup::LazyJIT> (shadingsys(), compiler);
+            lazy_jit->ll.jit_fma (ll.jit_fma());
+            lazy_jit->ll.jit_aggressive (ll.jit_aggressive());
+            lazy_jit->ll.module (lazy_jit->ll.new_module ("lazy_jit"));
+            if (! lazy_jit->ll.make_jit_execengine (&err, ll.lookup_isa_by_name(shadingsys().m_llvm_jit_target))) {
+                shadingcontext()->errorf("Failed to create engine: %s\n", err);
+                OSL_ASSERT (0);
+                return;
+            }
+            for (auto&& i : llvm_helper_function_map)
+                lazy_jit->ll.add_function_mapping (i.first, (void *)i.second.function);
+            lazy_jit->bitcode.resize (nlayers);
+            lazy_jit->names.resize (nlayers);
+            lazy_jit->code.resize (nlayers, nullptr);
+            for (size_t i = 0; i < units.size(); ++i) {
+                if (unit_deferred[i]) {
+                    lazy_jit->bitcode[unit_layer[i]] = std::move (pieces[i]);
+                    lazy_jit->names[unit_layer[i]] = names[i];
+                }
+            }
+            shadingsys().m_stat_llvm_lazy_layers += ndeferred;
+        }
+        group().m_llvm_lazy_jit = lazy_jit;
+        LLVM_Util &jit (lazy ? lazy_jit->ll : ll);
+        for (size_t i = 0; i < objects.size(); ++i)
+            if (! unit_deferred[i] && ! jit.add_object (objects[i], &err))
+                shadingcontext()->errorf("Failed to load object: %s", err);
+
         // Force the JIT to happen now and retrieve the JITed function pointers
         // for the initialization and all public entry points.
-        group().llvm_compiled_init ((RunLLVMGroupFunc) ll.getPointerToFunction(init_func));
+        group().llvm_compiled_init ((RunLLVMGroupFunc) jit.getPointerToFunction(init_func));
         for (int layer = 0; layer < nlayers; ++layer) {
             llvm::Function* f = funcs[layer];
             if (f && group().is_entry_layer (layer))
-                group().llvm_compiled_layer (layer, (RunLLVMGroupFunc) ll.getPointerToFunction(f));
+                group().llvm_compiled_layer (layer, (RunLLVMGroupFunc) jit.getPointerToFunction(f));
         }
         if (group().num_entry_layers())
             group().llvm_compiled_version (NULL);
@@ -1465,11 +1800,31 @@ BackendLLVM::run ()
     m_stat_total_llvm_time = timer();
 
     if (shadingsys().m_compile_report) {
-        shadingcontext()->infof("JITed shader group %s:", group().name());
+        std::string how;
+        if (jit_cached)
+            how = " (from JIT cache)";
+        else if (split)
+            how = Strutil::sprintf (" (%d modules on %d threads, %d deferred)",
+                                    units.size(), parallel_threads, ndeferred);
+        shadingcontext()->infof("JITed shader group %s%s:", group().name(), how);
         shadingcontext()->infof("    (%1.2fs = %1.2f setup, %1.2f ir, %1.2f opt, %1.2f jit; local mem %dKB)",
                                 m_stat_total_llvm_time, m_stat_llvm_setup_time,
                                 m_stat_llvm_irgen_time, m_stat_llvm_opt_time,
                                 m_stat_llvm_jit_time, m_llvm_local_mem/1024);
+        for (size_t i = 0; i < units.size(); ++i) {
+            std::string name = unit_layer[i] < 0 ? std::string("init")
+                             : Strutil::sprintf ("layer %d %s", unit_layer[i],
+                                                 group()[unit_layer[i]]->layername());
+            if (unit_deferred[i])
+                shadingcontext()->infof("      %s: %1.2f ir, deferred",
+                                        name, unit_ir_time[i]);
+            else if (split)
+                shadingcontext()->infof("      %s: %1.2f ir, %1.2f opt, %1.2f jit",
+                                        name, unit_ir_time[i], unit_opt_time[i],
+                                        unit_jit_time[i]);
+            else
+                shadingcontext()->infof("      %s: %1.2f ir", name, unit_ir_time[i]);
+        }
     }
 }
 
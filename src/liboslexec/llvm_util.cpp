@@ -3,9 +3,12 @@
 // https://github.com/AcademySoftwareFoundation/OpenShadingLanguage
 
 
+#include <atomic>
 #include <memory>
 #include <cinttypes>
 #include <OpenImageIO/fmath.h>
+#include <OpenImageIO/hash.h>
+#include <OpenImageIO/strutil.h>
 #include <OpenImageIO/thread.h>
 #include <boost/thread/tss.hpp>   /* for thread_specific_ptr */
 
@@ -18,6 +21,7 @@
 #endif
 
 #include "llvm_passes.h"
+#include "string_hash.h"
 
 #include <llvm/InitializePasses.h>
 #include <llvm/Pass.h>
@@ -37,6 +41,7 @@
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/ValueSymbolTable.h>
+#include <llvm/IR/Mangler.h>
 #include <llvm/Linker/Linker.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/Host.h>
@@ -54,6 +59,9 @@
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/ExecutionEngine/JITEventListener.h>
 #include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Config/llvm-config.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/Support/PrettyStackTrace.h>
@@ -129,6 +137,40 @@ static OIIO::spin_mutex llvm_global_mutex;
 static bool setup_done = false;
 static std::unique_ptr<std::vector<std::shared_ptr<LLVMMemoryManager> >> jitmm_hold;
 static int jit_mem_hold_users = 0;
+static std::atomic<size_t> jit_mem_held (0);   // bytes allocated for jitmm_hold
+
+// The characters of every string LLVM_Util::string_symbol() has named,
+// by hash, for the JIT to resolve the "osl_ustr_<hash>" symbols against.
+static OIIO::spin_mutex string_symbols_mutex;
+static std::unordered_map<uint64_t, const char*> string_symbols;
+
+static uint64_t
+string_symbol_address (llvm::StringRef name)
+{
+    name.consume_front ("_");   // Mach-O global symbol prefix
+    uint64_t hash;
+    if (! name.consume_front ("osl_ustr_") || name.getAsInteger (16, hash))
+        return 0;
+    OIIO::spin_lock lock (string_symbols_mutex);
+    auto found = string_symbols.find (hash);
+    return found != string_symbols.end() ? uint64_t(found->second) : 0;
+}
+
+// The addresses LLVM_Util::pointer_symbol() has named, by symbol name, for
+// the JIT to resolve the "osl_ptr_<name>" symbols against.
+static OIIO::spin_mutex pointer_symbols_mutex;
+static std::unordered_map<std::string, void*> pointer_symbols;
+
+static uint64_t
+pointer_symbol_address (llvm::StringRef name)
+{
+    name.consume_front ("_");   // Mach-O global symbol prefix
+    if (! name.startswith ("osl_ptr_"))
+        return 0;
+    OIIO::spin_lock lock (pointer_symbols_mutex);
+    auto found = pointer_symbols.find (name.str());
+    return found != pointer_symbols.end() ? uint64_t(found->second) : 0;
+}
 
 
 #if OSL_LLVM_VERSION >= 120
@@ -160,6 +202,7 @@ LLVM_Util::ScopedJitMemoryUser::~ScopedJitMemoryUser()
     --jit_mem_hold_users;
     if (jit_mem_hold_users == 0) {
         jitmm_hold.reset();
+        jit_mem_held = 0;
     }
 }
 
@@ -203,11 +246,7 @@ LLVM_Util::PerThreadInfo::get() const
 size_t
 LLVM_Util::total_jit_memory_held ()
 {
-    // FIXME: This can't possibly be correct. It will always return 0,
-    // since jitmem is a local variable.
-    size_t jitmem = 0;
-    OIIO::spin_lock lock (llvm_global_mutex);
-    return jitmem;
+    return jit_mem_held;
 }
 
 
@@ -245,6 +284,10 @@ public:
     }
     
     llvm::JITSymbol findSymbol(const std::string &Name) override {
+        if (uint64_t addr = string_symbol_address(Name))
+            return llvm::JITSymbol(addr, llvm::JITSymbolFlags::Exported);
+        if (uint64_t addr = pointer_symbol_address(Name))
+            return llvm::JITSymbol(addr, llvm::JITSymbolFlags::Exported);
         return mm->findSymbol(Name);
     }
 
@@ -265,11 +308,13 @@ public:
     }
     uint8_t *allocateCodeSection(uintptr_t Size, unsigned Alignment,
                                  unsigned SectionID, llvm::StringRef SectionName) override {
+        jit_mem_held += Size;
         return mm->allocateCodeSection(Size, Alignment, SectionID, SectionName);
     }
     uint8_t *allocateDataSection(uintptr_t Size, unsigned Alignment,
                                  unsigned SectionID, llvm::StringRef SectionName,
                                  bool IsReadOnly) override {
+        jit_mem_held += Size;
         return mm->allocateDataSection(Size, Alignment, SectionID,
                                        SectionName, IsReadOnly);
     }
@@ -281,6 +326,10 @@ public:
     }
 
     uint64_t getSymbolAddress(const std::string &Name) override {
+        if (uint64_t addr = string_symbol_address(Name))
+            return addr;
+        if (uint64_t addr = pointer_symbol_address(Name))
+            return addr;
         return mm->getSymbolAddress (Name);
     }
 
@@ -301,6 +350,64 @@ public:
 
 
 
+/// ObjectCache - The persistent JIT cache: MCJIT asks it for the object of
+/// each module before compiling it, and hands it the object after.  Only
+/// modules named by jit_cache_key() are looked up or saved, as <key>.o in
+/// the cache directory.  Objects are written to a temporary file and
+/// renamed into place, so concurrent threads or processes compiling the
+/// same group never see a partial object.
+class LLVM_Util::ObjectCache final : public llvm::ObjectCache {
+public:
+    static const char *key_prefix () { return "osljit_"; }
+
+    void dir (const std::string &d) { m_dir = d; }
+
+    std::string path (llvm::StringRef key) const {
+        return m_dir + "/" + key.str() + ".o";
+    }
+
+    static bool is_key (llvm::StringRef id) {
+        return id.startswith(key_prefix());
+    }
+
+    void notifyObjectCompiled (const llvm::Module *M,
+                               llvm::MemoryBufferRef Obj) override {
+        llvm::StringRef id = M->getModuleIdentifier();
+        if (! is_key(id) || llvm::sys::fs::create_directories(m_dir))
+            return;
+        int fd;
+        llvm::SmallString<256> tmpname;
+        if (llvm::sys::fs::createUniqueFile(m_dir + "/" + id.str() + "-%%%%%%.tmp",
+                                            fd, tmpname))
+            return;
+        bool ok;
+        {
+            llvm::raw_fd_ostream out (fd, true /*shouldClose*/);
+            out << Obj.getBuffer();
+            out.close();
+            ok = ! out.has_error();
+            out.clear_error();
+        }
+        if (! ok || llvm::sys::fs::rename(tmpname, path(id)))
+            llvm::sys::fs::remove(tmpname);
+    }
+
+    std::unique_ptr<llvm::MemoryBuffer> getObject (const llvm::Module *M) override {
+        llvm::StringRef id = M->getModuleIdentifier();
+        if (! is_key(id))
+            return nullptr;
+        auto buf = llvm::MemoryBuffer::getFile(path(id));
+        if (! buf)
+            return nullptr;
+        return std::move(*buf);
+    }
+
+private:
+    std::string m_dir;
+};
+
+
+
 
 struct SetCommandLineOptionsForLLVM
 {
@@ -346,16 +453,6 @@ LLVM_Util::LLVM_Util (const PerThreadInfo &per_thread_info,
             m_thread->llvm_context = new llvm::LLVMContext();
             //static SetCommandLineOptionsForLLVM sSetCommandLineOptionsForLLVM;
         }
-
-        if (! m_thread->llvm_jitmm) {
-            m_thread->llvm_jitmm = new LLVMMemoryManager(&llvm_default_mapper);
-            OSL_DASSERT (m_thread->llvm_jitmm);
-            OSL_ASSERT (jitmm_hold &&
-                "An instance of OSL::pvt::LLVM_Util::ScopedJitMemoryUser must exist with a longer lifetime than this LLVM_Util object");
-            jitmm_hold->emplace_back (m_thread->llvm_jitmm);
-        }
-        // Hold the REAL manager and use it as an argument later
-        m_llvm_jitmm = m_thread->llvm_jitmm;
     }
 
     OSL_ASSERT(m_thread->llvm_context);
@@ -429,6 +526,8 @@ LLVM_Util::~LLVM_Util ()
     delete m_llvm_func_passes;
     delete m_builder;
     delete m_llvm_debug_builder;
+    delete m_llvm_jit_cache;
+    delete m_target_machine;
     module (NULL);
     // DO NOT delete m_llvm_jitmm;  // just the dummy wrapper around the real MM
 }
@@ -1356,6 +1455,22 @@ LLVM_Util::make_jit_execengine (std::string *err,
     //engine_builder.setCodeModel(llvm::CodeModel::Default);
     engine_builder.setVerifyModules(true);
 
+    // The memory manager of the thread is made by the first engine it
+    // needs, so that an LLVM_Util that only optimizes or emits objects
+    // (see jit_target()) doesn't leave one behind in jitmm_hold.
+    if (! m_llvm_jitmm) {
+        OIIO::spin_lock lock (llvm_global_mutex);
+        if (! m_thread->llvm_jitmm) {
+            m_thread->llvm_jitmm = new LLVMMemoryManager(&llvm_default_mapper);
+            OSL_DASSERT (m_thread->llvm_jitmm);
+            OSL_ASSERT (jitmm_hold &&
+                "An instance of OSL::pvt::LLVM_Util::ScopedJitMemoryUser must exist with a longer lifetime than this LLVM_Util object");
+            jitmm_hold->emplace_back (m_thread->llvm_jitmm);
+        }
+        // Hold the REAL manager and use it as an argument later
+        m_llvm_jitmm = m_thread->llvm_jitmm;
+    }
+
     // We are actually holding a LLVMMemoryManager
     engine_builder.setMCJITMemoryManager (std::unique_ptr<llvm::RTDyldMemoryManager>
         (new MemoryManager(m_llvm_jitmm)));
@@ -1424,6 +1539,13 @@ LLVM_Util::make_jit_execengine (std::string *err,
     if (! m_llvm_exec)
         return NULL;
 
+    if (m_jit_cache_dir.size()) {
+        if (! m_llvm_jit_cache)
+            m_llvm_jit_cache = new ObjectCache;
+        m_llvm_jit_cache->dir (m_jit_cache_dir);
+        m_llvm_exec->setObjectCache (m_llvm_jit_cache);
+    }
+
     //const llvm::DataLayout & data_layout = m_llvm_exec->getDataLayout();
     //OSL_DEV_ONLY(std::cout << "data_layout.getStringRepresentation()=" << data_layout.getStringRepresentation() << std::endl);
 
@@ -1616,6 +1738,11 @@ LLVM_Util::getPointerToFunction (llvm::Function *func)
         m_llvm_debug_builder->finalize();
     }
 
+    // A function of an add_object() is only declared in the module.
+    if (func->isDeclaration())
+        return getPointerToFunction (string_view (func->getName().data(),
+                                                  func->getName().size()));
+
     llvm::ExecutionEngine *exec = execengine();
     OSL_ASSERT(!exec->isCompilingLazily());
     if (!m_ModuleIsFinalized) {
@@ -1632,6 +1759,60 @@ LLVM_Util::getPointerToFunction (llvm::Function *func)
 
 
 
+void *
+LLVM_Util::getPointerToFunction (string_view name)
+{
+    llvm::ExecutionEngine *exec = execengine();
+    if (!m_ModuleIsFinalized) {
+        exec->finalizeObject ();
+        m_ModuleIsFinalized = true;
+    }
+
+    void *f = (void *)(uintptr_t)exec->getFunctionAddress (std::string(name));
+    OSL_ASSERT (f && "could not getPointerToFunction");
+    return f;
+}
+
+
+
+std::string
+LLVM_Util::jit_cache_key (string_view extra)
+{
+    OSL_ASSERT (m_llvm_exec && "jit_cache_key needs the target of make_jit_execengine");
+    // The IR says what is compiled, the rest what it is compiled with.
+    llvm::TargetMachine *target_machine = m_llvm_exec->getTargetMachine();
+    std::string target = OIIO::Strutil::sprintf ("OSL %s LLVM %s %s %s %s [%s] fma=%d aggressive=%d %s",
+        OSL_LIBRARY_VERSION_STRING, LLVM_VERSION_STRING,
+        target_machine->getTargetTriple().str(),
+        target_machine->getTargetCPU().str(), target_isa_name(m_target_isa),
+        target_machine->getTargetFeatureString().str(),
+        int(jit_fma()), int(jit_aggressive()), extra);
+    llvm::SmallVector<char, 0> buffer;
+    {
+        llvm::raw_svector_ostream stream (buffer);
+        llvm::WriteBitcodeToFile (*module(), stream);
+        stream << target;
+    }
+    auto h = OIIO::farmhash::Fingerprint128 (buffer.data(), buffer.size());
+    std::string key = OIIO::Strutil::sprintf ("%s%016x%016x", ObjectCache::key_prefix(),
+                                              OIIO::farmhash::Uint128High64(h),
+                                              OIIO::farmhash::Uint128Low64(h));
+    module()->setModuleIdentifier (key);
+    return key;
+}
+
+
+
+bool
+LLVM_Util::jit_cache_has (string_view key) const
+{
+    if (! m_llvm_jit_cache || ! ObjectCache::is_key(llvm::StringRef(key.data(), key.size())))
+        return false;
+    return llvm::sys::fs::exists (m_llvm_jit_cache->path(llvm::StringRef(key.data(), key.size())));
+}
+
+
+
 void
 LLVM_Util::InstallLazyFunctionCreator (void* (*P)(const std::string &))
 {
@@ -1658,7 +1839,8 @@ LLVM_Util::setup_optimization_passes (int optlevel, bool target_host)
 
     llvm::TargetMachine* target_machine = nullptr;
     if (target_host) {
-        target_machine = execengine()->getTargetMachine();
+        target_machine = m_target_machine ? m_target_machine
+                                          : execengine()->getTargetMachine();
         llvm::Triple ModuleTriple(module()->getTargetTriple());
         // Add an appropriate TargetLibraryInfo pass for the module's triple.
         llvm::TargetLibraryInfoImpl TLII(ModuleTriple);
@@ -1973,6 +2155,212 @@ LLVM_Util::do_optimize (std::string *out_err)
 
 
 
+std::vector<std::string>
+LLVM_Util::split_module (const std::vector<llvm::Function*> &units,
+                         std::string *out_err)
+{
+    std::vector<std::string> pieces;
+    OSL_ASSERT (m_llvm_module && "No module to split!");
+
+#if !defined(OSL_FORCE_BITCODE_PARSE)
+    LLVMErr err = m_llvm_module->materializeAll();
+    if (error_string(std::move(err), out_err))
+        return pieces;
+#endif
+
+    // Globals that are written to, and those LLVM itself gives meaning
+    // to, must exist once: the first piece defines them and the others
+    // refer to them by name. Everything else a unit uses is copied into
+    // its piece, where it is internal.
+    auto shared = [](const llvm::GlobalValue *gv) {
+        auto var = llvm::dyn_cast<llvm::GlobalVariable>(gv);
+        return gv->getName().startswith("llvm.") || (var && ! var->isConstant());
+    };
+    std::unordered_set<const llvm::GlobalValue*> unit_set (units.begin(), units.end());
+    for (llvm::Function *f : units)
+        f->setLinkage (llvm::GlobalValue::ExternalLinkage);
+    int nshared = 0;
+    for (llvm::GlobalVariable &global : m_llvm_module->globals()) {
+        if (shared(&global) && ! global.getName().startswith("llvm.") &&
+            global.hasLocalLinkage()) {
+            if (! global.hasName())
+                global.setName (OIIO::Strutil::sprintf ("osl_shared_%d", nshared++));
+            global.setLinkage (llvm::GlobalValue::ExternalLinkage);
+        }
+    }
+
+    for (size_t i = 0, e = units.size(); i < e; ++i) {
+        // The definitions the unit needs: what it refers to, directly or
+        // through constants, other definitions and initializers.
+        std::unordered_set<const llvm::GlobalValue*> defs;
+        std::unordered_set<const llvm::Value*> visited;
+        std::vector<const llvm::Value*> work { units[i] };
+        if (i == 0)
+            for (llvm::GlobalVariable &global : m_llvm_module->globals())
+                if (shared(&global) && global.hasInitializer())
+                    work.push_back (global.getInitializer());
+        while (work.size()) {
+            const llvm::Value *val = work.back();
+            work.pop_back();
+            if (! visited.insert(val).second)
+                continue;
+            if (auto gv = llvm::dyn_cast<llvm::GlobalValue>(val)) {
+                if (gv != units[i] && (unit_set.count(gv) || shared(gv) ||
+                                       gv->isDeclaration()))
+                    continue;
+                defs.insert (gv);
+                if (auto func = llvm::dyn_cast<llvm::Function>(gv)) {
+                    for (auto &block : *func)
+                        for (auto &inst : block)
+                            for (auto &op : inst.operands())
+                                if (llvm::isa<llvm::Constant>(op))
+                                    work.push_back (op);
+                } else if (auto var = llvm::dyn_cast<llvm::GlobalVariable>(gv)) {
+                    work.push_back (var->getInitializer());
+                } else if (auto alias = llvm::dyn_cast<llvm::GlobalAlias>(gv)) {
+                    work.push_back (alias->getAliasee());
+                }
+            } else if (auto c = llvm::dyn_cast<llvm::Constant>(val)) {
+                for (auto &op : c->operands())
+                    work.push_back (op);
+            }
+        }
+
+        llvm::ValueToValueMapTy vmap;
+        std::unique_ptr<llvm::Module> piece = llvm::CloneModule (*m_llvm_module, vmap,
+            [&](const llvm::GlobalValue *gv) {
+                return defs.count(gv) || (i == 0 && shared(gv));
+            });
+        std::vector<llvm::GlobalVariable*> unused;
+        for (llvm::GlobalVariable &global : piece->globals()) {
+            if (global.getName().startswith("llvm.")) {
+                if (global.isDeclaration() && global.use_empty())
+                    unused.push_back (&global);
+            } else if (! global.isDeclaration() && ! shared(&global)) {
+                global.setLinkage (llvm::GlobalValue::InternalLinkage);
+                global.setComdat (nullptr);
+            }
+        }
+        for (llvm::GlobalVariable *global : unused)
+            global->eraseFromParent();
+        const llvm::Value *unit = vmap[units[i]];
+        for (llvm::Function &func : *piece) {
+            if (! func.isDeclaration() && &func != unit) {
+                func.setLinkage (llvm::GlobalValue::InternalLinkage);
+                func.setComdat (nullptr);
+            }
+        }
+        for (llvm::GlobalAlias &alias : piece->aliases())
+            alias.setLinkage (llvm::GlobalValue::InternalLinkage);
+
+        std::string bitcode;
+        llvm::raw_string_ostream stream (bitcode);
+        llvm::WriteBitcodeToFile (*piece, stream);
+        stream.flush();
+        pieces.emplace_back (std::move(bitcode));
+    }
+
+    // Leave only the declarations of the units, which the JIT resolves
+    // against the objects of the pieces.
+    for (llvm::Function &func : *m_llvm_module) {
+        if (! func.isDeclaration())
+            func.deleteBody();
+        func.setComdat (nullptr);
+    }
+    for (llvm::GlobalVariable &global : m_llvm_module->globals())
+        if (global.hasInitializer())
+            global.setInitializer (nullptr);
+    while (! m_llvm_module->alias_empty()) {
+        llvm::GlobalAlias &alias (*m_llvm_module->alias_begin());
+        alias.replaceAllUsesWith (llvm::UndefValue::get(alias.getType()));
+        alias.eraseFromParent();
+    }
+    while (! m_llvm_module->global_empty())
+        m_llvm_module->global_begin()->eraseFromParent();
+    std::vector<llvm::Function*> unneeded_funcs;
+    for (llvm::Function &func : *m_llvm_module)
+        if (! unit_set.count(&func))
+            unneeded_funcs.push_back (&func);
+    for (llvm::Function *func : unneeded_funcs)
+        func->eraseFromParent();
+    return pieces;
+}
+
+
+
+void
+LLVM_Util::jit_target (LLVM_Util &jit)
+{
+    llvm::TargetMachine *target_machine = jit.execengine()->getTargetMachine();
+    delete m_target_machine;
+    m_target_machine = target_machine->getTarget().createTargetMachine (
+        target_machine->getTargetTriple().str(),
+        target_machine->getTargetCPU(),
+        target_machine->getTargetFeatureString(),
+        target_machine->Options,
+        target_machine->getRelocationModel(),
+        target_machine->getCodeModel(),
+        target_machine->getOptLevel(), true /* JIT */);
+    OSL_ASSERT (m_target_machine);
+    m_jit_fma = jit.m_jit_fma;
+    m_jit_aggressive = jit.m_jit_aggressive;
+    m_target_isa = jit.m_target_isa;
+    m_supports_masked_stores = jit.m_supports_masked_stores;
+    m_supports_llvm_bit_masks_natively = jit.m_supports_llvm_bit_masks_natively;
+    m_supports_avx512f = jit.m_supports_avx512f;
+    m_supports_avx2 = jit.m_supports_avx2;
+    m_supports_avx = jit.m_supports_avx;
+}
+
+
+
+bool
+LLVM_Util::emit_object (std::string &object, std::string *err)
+{
+    OSL_ASSERT (m_target_machine && "emit_object needs a jit_target()");
+    module()->setDataLayout (m_target_machine->createDataLayout());
+    module()->setTargetTriple (m_target_machine->getTargetTriple().str());
+
+    llvm::SmallVector<char, 0> buffer;
+    llvm::raw_svector_ostream stream (buffer);
+    llvm::legacy::PassManager mod_pm;
+#if OSL_LLVM_VERSION >= 100
+    bool failed = m_target_machine->addPassesToEmitFile (mod_pm, stream, nullptr,
+                                                         llvm::CGFT_ObjectFile);
+#else
+    bool failed = m_target_machine->addPassesToEmitFile (mod_pm, stream, nullptr,
+                                                         llvm::TargetMachine::CGFT_ObjectFile);
+#endif
+    if (failed) {
+        if (err)
+            *err = "The JIT target can't emit object files";
+        return false;
+    }
+    mod_pm.run (*module());
+    object.assign (buffer.begin(), buffer.end());
+    return true;
+}
+
+
+
+bool
+LLVM_Util::add_object (const std::string &object, std::string *err)
+{
+    std::unique_ptr<llvm::MemoryBuffer> buffer =
+        llvm::MemoryBuffer::getMemBufferCopy (object, "osl_object");
+    auto obj = llvm::object::ObjectFile::createObjectFile (buffer->getMemBufferRef());
+    if (! obj) {
+        error_string (obj.takeError(), err);
+        return false;
+    }
+    execengine()->addObjectFile (llvm::object::OwningBinary<llvm::object::ObjectFile>
+                                     (std::move(*obj), std::move(buffer)));
+    m_ModuleIsFinalized = false;
+    return true;
+}
+
+
+
 // llvm::Value::getNumUses requires that the entire module be materialized
 // which defeats the purpose of the materialize & prune unneeded below we
 // need to avoid getNumUses and use the materialized_* iterators to count
@@ -2361,6 +2749,17 @@ LLVM_Util::add_function_mapping (llvm::Function *func, void *addr)
 
 
 
+void
+LLVM_Util::add_function_mapping (string_view name, void *addr)
+{
+    llvm::SmallString<128> mangled;
+    llvm::Mangler::getNameWithPrefix (mangled, llvm::StringRef(name.data(), name.size()),
+                                      execengine()->getDataLayout());
+    execengine()->addGlobalMapping (mangled, uint64_t(uintptr_t(addr)));
+}
+
+
+
 llvm::Value *
 LLVM_Util::current_function_arg (int a)
 {
@@ -2702,6 +3101,8 @@ LLVM_Util::constant_ptr (void *p, llvm::PointerType *type)
 {
     if (! type)
         type = type_void_ptr();
+    if (p)
+        m_ModuleIsProcessSpecific = true;
     return builder().CreateIntToPtr (constant (size_t (p)), type, "const pointer");
 }
 
@@ -2710,6 +3111,12 @@ LLVM_Util::constant_ptr (void *p, llvm::PointerType *type)
 llvm::Value *
 LLVM_Util::constant (ustring s)
 {
+    if (m_string_hashes && s.c_str()) {
+        if (llvm::Constant *sym = string_symbol (s))
+            return sym;
+    }
+    if (s.c_str())
+        m_ModuleIsProcessSpecific = true;
     // Create a const size_t with the ustring contents
     size_t bits = sizeof(size_t)*8;
     llvm::Value *str = llvm::ConstantInt::get (context(),
@@ -2722,6 +3129,12 @@ LLVM_Util::constant (ustring s)
 llvm::Value *
 LLVM_Util::wide_constant (ustring s)
 {
+    if (m_string_hashes && s.c_str()) {
+        if (llvm::Constant *sym = string_symbol (s))
+            return builder().CreateVectorSplat (m_vector_width, sym);
+    }
+    if (s.c_str())
+        m_ModuleIsProcessSpecific = true;
     // Create a const size_t with the ustring contents
     size_t bits = sizeof(size_t)*8;
     llvm::Value *str = llvm::ConstantInt::get (context(),
@@ -2733,6 +3146,57 @@ LLVM_Util::wide_constant (ustring s)
 }
 
 
+llvm::Constant *
+LLVM_Util::string_symbol (ustring s)
+{
+    if (! s.c_str())
+        return nullptr;
+    uint64_t hash = UStringHash::Hash (s.c_str());
+    {
+        OIIO::spin_lock lock (string_symbols_mutex);
+        auto found = string_symbols.emplace (hash, s.c_str()).first;
+        if (found->second != s.c_str())
+            return nullptr;
+    }
+    // Declared as an array of unknown size, so LLVM doesn't presume
+    // anything about the characters behind it.
+    std::string name = OIIO::Strutil::sprintf ("osl_ustr_%016x", hash);
+    llvm::GlobalVariable *sym = module()->getNamedGlobal (name);
+    if (! sym)
+        sym = new llvm::GlobalVariable (*module(),
+                                        llvm::ArrayType::get (type_char(), 0),
+                                        true /*isConstant*/,
+                                        llvm::GlobalValue::ExternalLinkage,
+                                        nullptr, name);
+    return llvm::ConstantExpr::getPointerCast (sym, type_string());
+}
+
+
+
+llvm::Constant *
+LLVM_Util::pointer_symbol (string_view name, void *p, llvm::PointerType *type)
+{
+    if (! p)
+        return nullptr;
+    if (! type)
+        type = type_void_ptr();
+    std::string symname = OIIO::Strutil::sprintf ("osl_ptr_%s", name);
+    {
+        OIIO::spin_lock lock (pointer_symbols_mutex);
+        auto found = pointer_symbols.emplace (symname, p).first;
+        if (found->second != p)
+            return nullptr;
+    }
+    llvm::GlobalVariable *sym = module()->getNamedGlobal (symname);
+    if (! sym)
+        sym = new llvm::GlobalVariable (*module(), type_char(),
+                                        true /*isConstant*/,
+                                        llvm::GlobalValue::ExternalLinkage,
+                                        nullptr, symname);
+    return llvm::ConstantExpr::getPointerCast (sym, type);
+}
+
+
 llvm::Value * LLVM_Util::llvm_mask_to_native(llvm::Value *llvm_mask) {
 
     OSL_ASSERT(llvm_mask->getType() == type_wide_bool());
@@ -3555,6 +4019,39 @@ LLVM_Util::op_load (llvm::Value *ptr)
 
 
 
+llvm::Value *
+LLVM_Util::op_load_acquire (llvm::Value *ptr)
+{
+    llvm::LoadInst *load = builder().CreateLoad (ptr);
+#if OSL_LLVM_VERSION >= 110
+    load->setAlignment (llvm::Align(sizeof(void*)));
+#elif OSL_LLVM_VERSION >= 100
+    load->setAlignment (llvm::MaybeAlign(sizeof(void*)));
+#else
+    load->setAlignment (sizeof(void*));
+#endif
+    load->setAtomic (llvm::AtomicOrdering::Acquire);
+    return load;
+}
+
+
+
+void
+LLVM_Util::op_store_release (llvm::Value *val, llvm::Value *ptr)
+{
+    llvm::StoreInst *store = builder().CreateStore (val, ptr);
+#if OSL_LLVM_VERSION >= 110
+    store->setAlignment (llvm::Align(sizeof(void*)));
+#elif OSL_LLVM_VERSION >= 100
+    store->setAlignment (llvm::MaybeAlign(sizeof(void*)));
+#else
+    store->setAlignment (sizeof(void*));
+#endif
+    store->setAtomic (llvm::AtomicOrdering::Release);
+}
+
+
+
 llvm::Value *
 LLVM_Util::op_linearize_16x_indices(llvm::Value *wide_index)
 {
@@ -856,4 +856,23 @@ osl_transformc (void *sg, void *Cin, int Cin_derivs,
 
 
 
+#ifndef __CUDACC__
+// Artic
+//
+// transformc for shaders compiled ahead of time from Artic (see
+// anyosl_color.art), which only come here for the spaces they don't know
+// themselves, i.e. the OCIO ones.  The names are plain C strings.
+
+OSL_ARTIC_EXPORT void
+osl_artic_transformc (void *sg, const char *from, const char *to,
+                      const void *Cin, void *Cout)
+{
+    ColorSystem &cs = op_color_colorsystem(sg);
+    COL(Cout) = cs.transformc (ustring(from), ustring(to), COL(Cin),
+                               op_color_context(sg));
+}
+#endif
+
+
+
 OSL_NAMESPACE_EXIT
@@ -88,6 +88,16 @@ public:
 
     OSL_HOSTDEVICE const StringParam& colorspace() const { return m_colorspace; }
 
+    /// The data derived from the colorspace, for code generators that
+    /// bake it into the shaders they emit.
+    OSL_HOSTDEVICE const Matrix33& XYZ2RGB() const { return m_XYZ2RGB; }
+    OSL_HOSTDEVICE const Matrix33& RGB2XYZ() const { return m_RGB2XYZ; }
+    OSL_HOSTDEVICE const Color3& luminance_scale() const { return m_luminance_scale; }
+    OSL_HOSTDEVICE const Color3* blackbody_table() const { return m_blackbody_table; }
+    OSL_HOSTDEVICE int blackbody_table_size() const {
+        return int(sizeof(m_blackbody_table) / sizeof(m_blackbody_table[0]));
+    }
+
     OSL_HOSTDEVICE void error(StringParam src, StringParam dst, Context);
 
 private:
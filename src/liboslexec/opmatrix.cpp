@@ -185,6 +185,28 @@ osl_get_inverse_matrix (void *sg_, void *r, const char *to)
     }
     return ok;
 }
+
+
+
+// Artic
+//
+// Named coordinate systems for shaders compiled ahead of time from Artic
+// (see anyosl_matrix.art).  The names are plain C strings rather than
+// ustrings; otherwise these behave exactly like the ops above.
+
+OSL_ARTIC_EXPORT int
+osl_artic_get_matrix (void *sg, void *r, const char *from)
+{
+    return osl_get_matrix (sg, r, ustring(from).c_str());
+}
+
+
+
+OSL_ARTIC_EXPORT int
+osl_artic_get_inverse_matrix (void *sg, void *r, const char *to)
+{
+    return osl_get_inverse_matrix (sg, r, ustring(to).c_str());
+}
 #else
 // Implemented by the renderer
 #define OSL_SHADEOP_EXPORT extern "C" OSL_DLL_EXPORT
@@ -128,5 +128,46 @@ osl_getmessage (ShaderGlobals *sg, const char *source_, const char *name_,
 }
 
 
+
+// Artic
+//
+// setmessage and getmessage for shaders compiled ahead of time from
+// Artic (see anyosl_renderer.art), for the messages their names aren't
+// known for up front.  Names are plain C strings, the type comes as an
+// ArticTypeDesc and string values travel as their hashes.  Messages
+// between the layers of an optimized group with literal names never get
+// here; the Artic backend keeps those in locals.
+
+OSL_ARTIC_EXPORT void
+osl_artic_setmessage (void *sg_, const char *name, const void *type_,
+                      const void *data, int layer)
+{
+    ShaderGlobals *sg = (ShaderGlobals *)sg_;
+    TypeDesc type = ((const ArticTypeDesc *)type_)->typedesc();
+    std::vector<char> val ((const char *)data,
+                           (const char *)data + type.size());
+    artic_strings_from_hashes (type, val.data());
+    ustring msgname (name);
+    osl_setmessage (sg, msgname.c_str(), TYPEDESC(type), val.data(), layer,
+                    NULL, 0);
+}
+
+
+
+OSL_ARTIC_EXPORT int
+osl_artic_getmessage (void *sg_, const char *source, const char *name,
+                      const void *type_, void *data, int layer)
+{
+    ShaderGlobals *sg = (ShaderGlobals *)sg_;
+    TypeDesc type = ((const ArticTypeDesc *)type_)->typedesc();
+    ustring msgsource (source), msgname (name);
+    int ok = osl_getmessage (sg, msgsource.c_str(), msgname.c_str(),
+                             TYPEDESC(type), data, 0, layer, NULL, 0);
+    if (ok)
+        artic_strings_to_hashes (type, data);
+    return ok;
+}
+
+
 } // namespace pvt
 OSL_NAMESPACE_EXIT
@@ -11,6 +11,7 @@
 /////////////////////////////////////////////////////////////////////////
 
 #include <cstdarg>
+#include <unordered_map>
 
 #include <OpenImageIO/strutil.h>
 #include <OpenImageIO/filesystem.h>
@@ -234,5 +235,129 @@ osl_split (const char *str, ustring *results, const char *sep,
 }
 
 
+
+// Artic
+//
+// Shaders compiled ahead of time from Artic (see anyosl_string.art) carry
+// strings as their 64 bit hashes, the same ones ustring::hash() computes.
+// This table maps the hashes back to ustrings for the operations that
+// need the characters.  Literals are interned when a compiled shader is
+// loaded; every string the operations below make is interned as it is
+// made.
+
+static spin_mutex artic_strings_mutex;
+static std::unordered_map<uint64_t, ustring> artic_strings;
+
+uint64_t
+artic_intern (ustring s)
+{
+    uint64_t hash = s.hash();
+    if (hash) {
+        spin_lock lock (artic_strings_mutex);
+        artic_strings.emplace (hash, s);
+    }
+    return hash;
+}
+
+ustring
+artic_ustring (uint64_t hash)
+{
+    if (! hash)
+        return ustring();
+    spin_lock lock (artic_strings_mutex);
+    auto found = artic_strings.find (hash);
+    return found != artic_strings.end() ? found->second : ustring();
+}
+
+
+void
+artic_strings_to_hashes (TypeDesc type, void *data)
+{
+    if (type.basetype != TypeDesc::STRING)
+        return;
+    for (size_t i = 0, e = type.numelements() * type.aggregate;  i < e;  ++i) {
+        ustring s = ((ustring *)data)[i];
+        ((uint64_t *)data)[i] = artic_intern (s);
+    }
+}
+
+void
+artic_strings_from_hashes (TypeDesc type, void *data)
+{
+    if (type.basetype != TypeDesc::STRING)
+        return;
+    for (size_t i = 0, e = type.numelements() * type.aggregate;  i < e;  ++i)
+        ((ustring *)data)[i] = artic_ustring (((uint64_t *)data)[i]);
+}
+
+
+
+OSL_ARTIC_EXPORT uint64_t
+osl_artic_string_intern (const char *chars)
+{
+    return artic_intern (ustring(chars));
+}
+
+OSL_ARTIC_EXPORT const char *
+osl_artic_string_chars (uint64_t s)
+{
+    ustring chars = artic_ustring (s);
+    return chars.c_str() ? chars.c_str() : "";
+}
+
+OSL_ARTIC_EXPORT uint64_t
+osl_artic_concat (uint64_t s, uint64_t t)
+{
+    const char *r = osl_concat_sss (artic_ustring(s).c_str(),
+                                    artic_ustring(t).c_str());
+    return artic_intern (USTR(r));
+}
+
+OSL_ARTIC_EXPORT int
+osl_artic_strlen (uint64_t s)
+{
+    return (int) artic_ustring(s).length();
+}
+
+OSL_ARTIC_EXPORT int
+osl_artic_getchar (uint64_t s, int index)
+{
+    return osl_getchar_isi (artic_ustring(s).c_str(), index);
+}
+
+OSL_ARTIC_EXPORT int
+osl_artic_startswith (uint64_t s, uint64_t substr)
+{
+    return osl_startswith_iss (artic_ustring(s).c_str(),
+                               artic_ustring(substr).c_str());
+}
+
+OSL_ARTIC_EXPORT int
+osl_artic_endswith (uint64_t s, uint64_t substr)
+{
+    return osl_endswith_iss (artic_ustring(s).c_str(),
+                             artic_ustring(substr).c_str());
+}
+
+OSL_ARTIC_EXPORT int
+osl_artic_stoi (uint64_t s)
+{
+    return osl_stoi_is (artic_ustring(s).c_str());
+}
+
+OSL_ARTIC_EXPORT float
+osl_artic_stof (uint64_t s)
+{
+    return osl_stof_fs (artic_ustring(s).c_str());
+}
+
+OSL_ARTIC_EXPORT uint64_t
+osl_artic_substr (uint64_t s, int start, int length)
+{
+    const char *r = osl_substr_ssii (artic_ustring(s).c_str(), start, length);
+    return artic_intern (USTR(r));
+}
+
+
 } // end namespace pvt
 OSL_NAMESPACE_EXIT
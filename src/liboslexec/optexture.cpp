@@ -405,6 +405,194 @@ osl_get_textureinfo (void *sg_, const char *name, void *handle,
 
 
 
+// Artic
+//
+// Entry points imported by shaders compiled ahead of time from Artic
+// (see anyosl_texture.art).  Those shaders live outside of this library,
+// so unlike the ops above these are exported.  Names are plain C strings
+// rather than ustrings, handles travel as 64 bit integers (0 to look the
+// file up by name), and the options come as a plain struct.
+
+// Mirrors TextureOpt in anyosl_texture.art field for field.
+struct ArticTextureOpt {
+    int firstchannel;
+    int subimage;
+    int swrap, twrap, rwrap;
+    int interp;
+    float sblur, tblur, rblur;
+    float swidth, twidth, rwidth;
+    float fill;
+    float time;
+    float missingcolor[3];
+    float missingalpha;
+    int has_missingcolor;
+};
+
+
+// Fill in opt from the Artic options.  missing is storage for the
+// missing color (4 floats) that must outlive the lookup.
+static void
+artic_texture_opt (const void *aopt_, int chans, TextureOpt &opt,
+                   float *missing)
+{
+    const ArticTextureOpt &aopt (*(const ArticTextureOpt *)aopt_);
+    opt.firstchannel = aopt.firstchannel;
+    opt.subimage = aopt.subimage;
+    opt.swrap = (TextureOpt::Wrap)aopt.swrap;
+    opt.twrap = (TextureOpt::Wrap)aopt.twrap;
+    opt.rwrap = (TextureOpt::Wrap)aopt.rwrap;
+    opt.interpmode = (TextureOpt::InterpMode)aopt.interp;
+    opt.sblur = aopt.sblur;
+    opt.tblur = aopt.tblur;
+    opt.rblur = aopt.rblur;
+    opt.swidth = aopt.swidth;
+    opt.twidth = aopt.twidth;
+    opt.rwidth = aopt.rwidth;
+    opt.fill = aopt.fill;
+    opt.time = aopt.time;
+    if (aopt.has_missingcolor) {
+        for (int i = 0;  i < 4;  ++i)
+            missing[i] = i < 3 ? aopt.missingcolor[i] : 0.0f;
+        if (chans < 4)
+            missing[chans] = aopt.missingalpha;
+        opt.missingcolor = missing;
+    }
+}
+
+
+
+OSL_ARTIC_EXPORT uint64_t
+osl_artic_texture_handle (void *sg_, const char *name)
+{
+    ShaderGlobals *sg = (ShaderGlobals *)sg_;
+    return (uint64_t)(uintptr_t)sg->renderer->get_texture_handle (ustring(name),
+                                                                  sg->context);
+}
+
+
+
+OSL_ARTIC_EXPORT int
+osl_artic_texture (void *sg_, const char *name, uint64_t handle,
+                   const void *opt_, float s, float t,
+                   float dsdx, float dtdx, float dsdy, float dtdy,
+                   int chans, float *result)
+{
+    ShaderGlobals *sg = (ShaderGlobals *)sg_;
+    TextureOpt opt;
+    float missing[4];
+    artic_texture_opt (opt_, chans, opt, missing);
+    OIIO::simd::float4 result_simd;
+    bool ok = sg->renderer->texture (ustring(name),
+                                     (TextureSystem::TextureHandle *)(uintptr_t)handle,
+                                     sg->context->texture_thread_info(),
+                                     opt, sg, s, t, dsdx, dtdx, dsdy, dtdy, 4,
+                                     (float *)&result_simd, NULL, NULL, NULL);
+    result_simd.store (result);
+    return ok;
+}
+
+
+
+OSL_ARTIC_EXPORT int
+osl_artic_texture3d (void *sg_, const char *name, uint64_t handle,
+                     const void *opt_, const void *P_, const void *dPdx_,
+                     const void *dPdy_, int chans, float *result)
+{
+    const Vec3 &P (*(const Vec3 *)P_);
+    const Vec3 &dPdx (*(const Vec3 *)dPdx_);
+    const Vec3 &dPdy (*(const Vec3 *)dPdy_);
+    ShaderGlobals *sg = (ShaderGlobals *)sg_;
+    TextureOpt opt;
+    float missing[4];
+    artic_texture_opt (opt_, chans, opt, missing);
+    OIIO::simd::float4 result_simd;
+    bool ok = sg->renderer->texture3d (ustring(name),
+                                       (TextureSystem::TextureHandle *)(uintptr_t)handle,
+                                       sg->context->texture_thread_info(),
+                                       opt, sg, P, dPdx, dPdy, Vec3(0), 4,
+                                       (float *)&result_simd,
+                                       NULL, NULL, NULL, NULL);
+    result_simd.store (result);
+    return ok;
+}
+
+
+
+OSL_ARTIC_EXPORT int
+osl_artic_environment (void *sg_, const char *name, uint64_t handle,
+                       const void *opt_, const void *R_, const void *dRdx_,
+                       const void *dRdy_, int chans, float *result)
+{
+    const Vec3 &R (*(const Vec3 *)R_);
+    const Vec3 &dRdx (*(const Vec3 *)dRdx_);
+    const Vec3 &dRdy (*(const Vec3 *)dRdy_);
+    ShaderGlobals *sg = (ShaderGlobals *)sg_;
+    TextureOpt opt;
+    float missing[4];
+    artic_texture_opt (opt_, chans, opt, missing);
+    OIIO::simd::float4 result_simd;
+    bool ok = sg->renderer->environment (ustring(name),
+                                         (TextureSystem::TextureHandle *)(uintptr_t)handle,
+                                         sg->context->texture_thread_info(),
+                                         opt, sg, R, dRdx, dRdy, 4,
+                                         (float *)&result_simd,
+                                         NULL, NULL, NULL);
+    result_simd.store (result);
+    return ok;
+}
+
+
+
+OSL_ARTIC_EXPORT int
+osl_artic_get_textureinfo (void *sg_, const char *name, uint64_t handle,
+                           const char *dataname, int type, int arraylen,
+                           int aggregate, void *data)
+{
+    TypeDesc typedesc;
+    typedesc.basetype  = type;
+    typedesc.arraylen  = arraylen;
+    typedesc.aggregate = aggregate;
+
+    ShaderGlobals *sg = (ShaderGlobals *)sg_;
+    return sg->renderer->get_texture_info (ustring(name),
+                                           (RendererServices::TextureHandle *)(uintptr_t)handle,
+                                           sg->context->texture_thread_info(),
+                                           sg->context, 0 /*FIXME-ptex*/,
+                                           ustring(dataname), typedesc, data,
+                                           NULL);
+}
+
+
+
+// Mirrors TraceOpt in anyosl_renderer.art field for field.
+struct ArticTraceOpt {
+    float mindist;
+    float maxdist;
+    int shade;
+    uint64_t traceset;
+};
+
+
+OSL_ARTIC_EXPORT int
+osl_artic_trace (const void *opt_, void *sg_, const void *P_,
+                 const void *dPdx_, const void *dPdy_, const void *R_,
+                 const void *dRdx_, const void *dRdy_)
+{
+    ShaderGlobals *sg = (ShaderGlobals *)sg_;
+    const ArticTraceOpt &aopt (*(const ArticTraceOpt *)opt_);
+    RendererServices::TraceOpt opt;
+    opt.mindist = aopt.mindist;
+    opt.maxdist = aopt.maxdist;
+    opt.shade = aopt.shade != 0;
+    opt.traceset = artic_ustring (aopt.traceset);
+    return sg->renderer->trace (opt, sg, VEC(P_), VEC(dPdx_), VEC(dPdy_),
+                                VEC(R_), VEC(dRdx_), VEC(dRdy_));
+}
+
+#undef OSL_ARTIC_EXPORT
+
+
+
 // Trace
 
 // Utility: retrieve a pointer to the ShadingContext's trace options
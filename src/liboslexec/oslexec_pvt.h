@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <limits>
 #include <string>
 #include <vector>
 #include <stack>
@@ -12,6 +13,9 @@
 #include <list>
 #include <set>
 #include <unordered_map>
+#include <condition_variable>
+#include <future>
+#include <thread>
 
 #include <boost/thread/tss.hpp>   /* for thread_specific_ptr */
 
@@ -208,6 +212,30 @@ struct AttributeNeeded {
 // "C" linkage (no C++ name mangling).
 #define OSL_SHADEOP extern "C" OSL_DLL_LOCAL
 
+// Prefix for the entry points imported by shaders compiled ahead of time
+// from Artic.  Those shaders live outside of liboslexec, so unlike the
+// shade ops these are exported.
+#define OSL_ARTIC_EXPORT extern "C" OSL_DLL_EXPORT
+
+// Artic shaders carry strings as their ustring hashes; these map between
+// the two through the table in opstring.cpp.  The conversions rewrite a
+// value of the given type in place and leave anything but strings alone.
+uint64_t artic_intern (ustring s);
+ustring artic_ustring (uint64_t hash);
+void artic_strings_to_hashes (TypeDesc type, void *data);
+void artic_strings_from_hashes (TypeDesc type, void *data);
+
+// Mirrors TypeDesc in anyosl_renderer.art.
+struct ArticTypeDesc {
+    int basetype, aggregate, vecsemantics, arraylen;
+
+    TypeDesc typedesc () const {
+        return TypeDesc ((TypeDesc::BASETYPE)basetype,
+                         (TypeDesc::AGGREGATE)aggregate,
+                         (TypeDesc::VECSEMANTICS)vecsemantics, arraylen);
+    }
+};
+
 
 // Handy re-casting macros
 #define USTR(cstr) (*((ustring *)&cstr))
@@ -572,6 +600,8 @@ public:
     int llvm_debugging_symbols () const { return m_llvm_debugging_symbols; }
     int llvm_profiling_events () const { return m_llvm_profiling_events; }
     int llvm_output_bitcode () const { return m_llvm_output_bitcode; }
+    int artic_output () const { return m_artic_output; }
+    int vector_width () const { return m_vector_width; }
     ustring llvm_prune_ir_strategy () const { return m_llvm_prune_ir_strategy; }
     bool fold_getattribute () const { return m_opt_fold_getattribute; }
     bool opt_texture_handle () const { return m_opt_texture_handle; }
@@ -589,6 +619,9 @@ public:
 
     bool llvm_jit_fma() const { return m_llvm_jit_fma; }
     ustring llvm_jit_target () const { return m_llvm_jit_target; }
+    ustring llvm_jit_cache () const { return m_llvm_jit_cache; }
+    int llvm_parallel_layers () const { return m_llvm_parallel_layers; }
+    bool llvm_lazy_jit () const { return m_llvm_lazy_jit; }
 
     ustring debug_groupname() const { return m_debug_groupname; }
     ustring debug_layername() const { return m_debug_layername; }
@@ -606,6 +639,25 @@ public:
     /// (at least the ones that can't be overridden by the geometry).
     void optimize_group (ShaderGroup &group, ShadingContext *ctx, bool do_jit);
 
+    /// Queue the group for the background compile threads (or change its
+    /// priority if it is still queued), and return a future that is ready
+    /// once the group is optimized, and JITed if do_jit.
+    std::shared_future<void> optimize_group_async (ShaderGroupRef group,
+                                                   float priority, bool do_jit);
+
+    /// Optimize (and maybe JIT) the most urgent queued group on the
+    /// calling thread, using ctx if it isn't NULL. If wait is true, block
+    /// until a group is queued or the compile threads are stopped. Groups
+    /// with a priority below min_priority are left in the queue. Return
+    /// false if no group was compiled.
+    bool compile_queued_group (ShadingContext *ctx, bool wait = false,
+                               float min_priority = -std::numeric_limits<float>::infinity());
+
+    /// Bind the group to an ahead-of-time compiled entry point, marking
+    /// it optimized and JITed so that it is never compiled.
+    bool register_compiled_group (ShaderGroup &group, CompiledGroupFunc entry,
+                                  size_t groupdata_size);
+
     /// After doing all optimization and code JIT, we can clean up by
     /// deleting the instances' code and arguments, and paring their
     /// symbol tables down to just parameters.
@@ -651,6 +703,10 @@ public:
     bool is_renderer_output (ustring layername, ustring paramname,
                              ShaderGroup *group) const;
 
+    /// The renderer outputs in effect for the group: its own list if it
+    /// has one, otherwise the global one.
+    const std::vector<ustring>& renderer_outputs (const ShaderGroup &group) const;
+
     /// Serialize the entire group, including oso files, into a compressed
     /// archive.
     bool archive_shadergroup (ShaderGroup& group, string_view filename);
@@ -759,6 +815,7 @@ private:
     bool m_unknown_coordsys_error;        ///< Error to use unknown xform name?
     bool m_connection_error;              ///< Error for ConnectShaders to fail?
     bool m_greedyjit;                     ///< JIT as much as we can?
+    int m_jit_threads;                    ///< Threads for async compiles
     bool m_countlayerexecs;               ///< Count number of layer execs?
     bool m_relaxed_param_typecheck;       ///< Allow parameters to be set from isomorphic types (same data layout)
     int m_max_warnings_per_thread;        ///< How many warnings to display per thread before giving up?
@@ -782,8 +839,12 @@ private:
     bool m_opt_batched_analysis;          ///< Perform extra analysis required for batched execution?
     bool m_llvm_jit_fma;                  ///< Allow fused multiply/add in JIT
     bool m_llvm_jit_aggressive;           ///< Turn on llvm "aggressive" JIT
+    bool m_llvm_string_hashes;            ///< JIT strings as hash symbols
+    int m_llvm_parallel_layers;           ///< Threads to compile layers on
+    bool m_llvm_lazy_jit;                 ///< JIT lazy layers when they run
     bool m_optimize_nondebug;             ///< Fully optimize non-debug!
     ustring m_llvm_jit_target;            ///< ISA target for JIT
+    ustring m_llvm_jit_cache;             ///< Directory of the JIT cache
     int m_vector_width;                   ///< SIMD width maximum (8)
     int m_opt_passes;                     ///< Opt passes per layer
     int m_llvm_optimize;                  ///< OSL optimization strategy
@@ -796,6 +857,7 @@ private:
     int m_llvm_profiling_events;          ///< Emit Intel profiling events during JIT
     int m_llvm_output_bitcode;            ///< Output bitcode for each group
     int m_llvm_dumpasm;                   ///< Output CPU asm of the JIT
+    int m_artic_output;                   ///< Output optimized Artic source
     ustring m_llvm_prune_ir_strategy;     ///< LLVM IR pruning strategy
     ustring m_debug_groupname;            ///< Name of sole group to debug
     ustring m_debug_layername;            ///< Name of sole layer to debug
@@ -839,7 +901,14 @@ private:
     atomic_int m_stat_groupinstances;     ///< Stat: total inst in all groups
     atomic_int m_stat_instances_compiled; ///< Stat: instances compiled
     atomic_int m_stat_groups_compiled;    ///< Stat: groups compiled
+    atomic_int m_stat_groups_precompiled; ///< Stat: groups bound to AOT code
     atomic_int m_stat_empty_instances;    ///< Stat: shaders empty after opt
+    atomic_int m_stat_llvm_jit_cache_hits;   ///< Stat: groups loaded from JIT cache
+    atomic_int m_stat_llvm_jit_cache_misses; ///< Stat: groups added to JIT cache
+    atomic_int m_stat_llvm_jit_cache_uncacheable; ///< Stat: groups unfit for it
+    atomic_int m_stat_llvm_lazy_layers;   ///< Stat: layers left to JIT lazily
+    atomic_int m_stat_llvm_lazy_layers_jitted; ///< Stat: ...that were JITed
+    atomic_int m_stat_llvm_parallel_groups; ///< Stat: groups JITed in parallel
     atomic_int m_stat_merged_inst;        ///< Stat: number of merged instances
     atomic_int m_stat_merged_inst_opt;    ///< Stat: merged insts after opt
     atomic_int m_stat_empty_groups;       ///< Stat: groups empty after opt
@@ -863,6 +932,7 @@ private:
     double m_stat_llvm_irgen_time;        ///<     llvm IR generation time
     double m_stat_llvm_opt_time;          ///<     llvm IR optimization time
     double m_stat_llvm_jit_time;          ///<     llvm JIT time
+    double m_stat_llvm_lazy_jit_time;     ///<   llvm time JITing lazy layers
     double m_stat_inst_merge_time;        ///< Stat: time merging instances
     double m_stat_getattribute_time;      ///< Stat: time spent in getattribute
     double m_stat_getattribute_fail_time; ///< Stat: time spent in getattribute
@@ -904,12 +974,38 @@ private:
 
     atomic_int m_groups_to_compile_count;
     atomic_int m_threads_currently_compiling;
+
+    // Queue of optimize_group_async requests and the threads serving it.
+    struct CompileJob {
+        ShaderGroupRef group;
+        float priority;
+        long long order;                ///< Arrival, to break priority ties
+        bool do_jit;
+        std::promise<void> done;
+        std::shared_future<void> future;
+    };
+    struct MoreUrgentJob {
+        bool operator() (const CompileJob *a, const CompileJob *b) const {
+            return a->priority != b->priority ? a->priority > b->priority
+                                              : a->order < b->order;
+        }
+    };
+    std::mutex m_compile_queue_mutex;
+    std::condition_variable m_compile_queue_cv;
+    std::set<CompileJob*,MoreUrgentJob> m_compile_queue;  ///< Not yet started
+    std::unordered_map<ShaderGroup*,std::unique_ptr<CompileJob>> m_compile_jobs; ///< Queued or running
+    long long m_compile_jobs_queued = 0;
+    bool m_compile_threads_stop = false;
+    std::vector<std::thread> m_compile_threads;
+    void compile_thread_main ();
+    void stop_compile_threads ();
     mutable std::map<ustring,long long> m_group_profile_times;
     // N.B. group_profile_times is protected by m_stat_mutex.
 
     LLVM_Util::ScopedJitMemoryUser m_llvm_jit_memory_user;
 
     friend class OSL::ShadingContext;
+    friend class OSL::ShaderGroup;
     friend class ShaderMaster;
     friend class ShaderInstance;
     friend class RuntimeOptimizer;
@@ -1483,6 +1579,9 @@ public:
     int batch_jitted () const { return m_batch_jitted; }
     void batch_jitted (int batch_jitted) { m_batch_jitted = batch_jitted; }
 
+    /// Is the group bound to an ahead-of-time compiled entry point?
+    bool precompiled () const { return m_precompiled; }
+
     size_t llvm_groupdata_size () const { return m_llvm_groupdata_size; }
     void llvm_groupdata_size (size_t size) { m_llvm_groupdata_size = size; }
 
@@ -1510,6 +1609,9 @@ public:
         if (layer < nlayers())
             m_llvm_compiled_layers[layer] = func;
     }
+    /// JIT a layer that llvm_lazy_jit left to be JITed when it first
+    /// runs, unless that has happened already, and return its function.
+    void *llvm_jit_layer (int layer);
 
     // Hold onto wide versions of llvm functions side by side with scalar
     RunLLVMGroupFuncWide llvm_compiled_wide_version() const {
@@ -1614,6 +1716,7 @@ private:
     volatile int m_jitted = 0;       ///< Is it already jitted?
     bool m_does_nothing = false;     ///< Is the shading group just func() { return; }
     volatile int m_batch_jitted = 0; ///< Is it already jitted for batch execution?
+    bool m_precompiled = false;      ///< Bound to ahead-of-time compiled code?
     size_t m_llvm_groupdata_size = 0;///< Heap size needed for its groupdata
     size_t m_llvm_groupdata_wide_size = 0;    ///< Heap size needed for its wide groupdata
     int m_id;                        ///< Unique ID for the group
@@ -1654,6 +1757,11 @@ private:
     // PTX assembly for compiled ShaderGroup
     std::string m_llvm_ptx_compiled_version;
 
+    // The layers left to be JITed when they first run, and the JIT they
+    // are loaded into (see BackendLLVM::run).
+    struct LazyJIT;
+    std::shared_ptr<LazyJIT> m_llvm_lazy_jit;
+
     ParamValueList m_pending_params;      ///< Pending Parameter() values
     ustring m_group_use;                  ///< "Usage" of group
     bool m_complete = false;              ///< Successfully ShaderGroupEnd?
@@ -12,6 +12,7 @@
 #include "oslexec_pvt.h"
 #include <OSL/genclosure.h>
 #include "backendllvm.h"
+#include "backendartic.h"
 #include "batched_backendllvm.h"
 #include <OSL/oslquery.h>
 
@@ -619,6 +620,17 @@ ShadingSystem::raytype_bit (ustring name)
 
 
 
+bool
+ShadingSystem::register_compiled_group (ShaderGroup *group,
+                                        CompiledGroupFunc entry,
+                                        size_t groupdata_size)
+{
+    return group && m_impl->register_compiled_group (*group, entry,
+                                                     groupdata_size);
+}
+
+
+
 void
 ShadingSystem::optimize_all_groups (int nthreads, bool do_jit)
 {
@@ -627,6 +639,23 @@ ShadingSystem::optimize_all_groups (int nthreads, bool do_jit)
 
 
 
+std::shared_future<void>
+ShadingSystem::optimize_group_async (ShaderGroupRef group, float priority,
+                                     bool do_jit)
+{
+    return m_impl->optimize_group_async (group, priority, do_jit);
+}
+
+
+
+bool
+ShadingSystem::compile_queued_group ()
+{
+    return m_impl->compile_queued_group (nullptr);
+}
+
+
+
 TextureSystem *
 ShadingSystem::texturesys () const
 {
@@ -865,7 +894,7 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
       m_error_repeats(false),
       m_range_checking(true),
       m_unknown_coordsys_error(true), m_connection_error(true),
-      m_greedyjit(false), m_countlayerexecs(false),
+      m_greedyjit(false), m_jit_threads(0), m_countlayerexecs(false),
       m_relaxed_param_typecheck(false),
       m_max_warnings_per_thread(100),
       m_profile(0),
@@ -883,6 +912,9 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
                              (renderer->batched(WidthOf<8>()) != nullptr)),
       m_llvm_jit_fma(false),
       m_llvm_jit_aggressive(false),
+      m_llvm_string_hashes(false),
+      m_llvm_parallel_layers(0),
+      m_llvm_lazy_jit(false),
       m_optimize_nondebug(false),
       m_vector_width(4),
       m_opt_passes(10),
@@ -894,6 +926,7 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
       m_llvm_profiling_events(0),
       m_llvm_output_bitcode(0),
       m_llvm_dumpasm(0),
+      m_artic_output(0),
       m_commonspace_synonym("world"),
       m_max_local_mem_KB(2048),
       m_compile_report(false),
@@ -910,6 +943,7 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
       m_stat_total_llvm_time(0),
       m_stat_llvm_setup_time(0), m_stat_llvm_irgen_time(0),
       m_stat_llvm_opt_time(0), m_stat_llvm_jit_time(0),
+      m_stat_llvm_lazy_jit_time(0),
       m_stat_inst_merge_time(0),
       m_stat_max_llvm_local_mem(0)
 {
@@ -919,7 +953,14 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
     m_stat_groupinstances = 0;
     m_stat_instances_compiled = 0;
     m_stat_groups_compiled = 0;
+    m_stat_groups_precompiled = 0;
     m_stat_empty_instances = 0;
+    m_stat_llvm_jit_cache_hits = 0;
+    m_stat_llvm_jit_cache_misses = 0;
+    m_stat_llvm_jit_cache_uncacheable = 0;
+    m_stat_llvm_lazy_layers = 0;
+    m_stat_llvm_lazy_layers_jitted = 0;
+    m_stat_llvm_parallel_groups = 0;
     m_stat_merged_inst = 0;
     m_stat_merged_inst_opt = 0;
     m_stat_empty_groups = 0;
@@ -1244,6 +1285,8 @@ ShadingSystemImpl::query_closure(const char **name, int *id,
 
 ShadingSystemImpl::~ShadingSystemImpl ()
 {
+    stop_compile_threads ();
+
     size_t ngroups = m_all_shader_groups.size();
     for (size_t i = 0;  i < ngroups;  ++i) {
         if (ShaderGroupRef g = m_all_shader_groups[i].lock()) {
@@ -1356,7 +1399,11 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     ATTR_SET ("opt_batched_analysis", int, m_opt_batched_analysis);
     ATTR_SET ("llvm_jit_fma", int, m_llvm_jit_fma);
     ATTR_SET ("llvm_jit_aggressive", int, m_llvm_jit_aggressive);
+    ATTR_SET ("llvm_string_hashes", int, m_llvm_string_hashes);
+    ATTR_SET ("llvm_parallel_layers", int, m_llvm_parallel_layers);
+    ATTR_SET ("llvm_lazy_jit", int, m_llvm_lazy_jit);
     ATTR_SET_STRING ("llvm_jit_target", m_llvm_jit_target);
+    ATTR_SET_STRING ("llvm_jit_cache", m_llvm_jit_cache);
     ATTR_SET ("vector_width", int, m_vector_width);
     ATTR_SET ("opt_passes", int, m_opt_passes);
     ATTR_SET ("optimize_nondebug", int, m_optimize_nondebug);
@@ -1379,12 +1426,14 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     ATTR_SET ("llvm_profiling_events", int, m_llvm_profiling_events);
     ATTR_SET ("llvm_output_bitcode", int, m_llvm_output_bitcode);
     ATTR_SET ("llvm_dumpasm", int, m_llvm_dumpasm);
+    ATTR_SET ("artic_output", int, m_artic_output);
     ATTR_SET_STRING ("llvm_prune_ir_strategy", m_llvm_prune_ir_strategy);
     ATTR_SET ("strict_messages", int, m_strict_messages);
     ATTR_SET ("range_checking", int, m_range_checking);
     ATTR_SET ("unknown_coordsys_error", int, m_unknown_coordsys_error);
     ATTR_SET ("connection_error", int, m_connection_error);
     ATTR_SET ("greedyjit", int, m_greedyjit);
+    ATTR_SET ("jit_threads", int, m_jit_threads);
     ATTR_SET ("relaxed_param_typecheck", int, m_relaxed_param_typecheck);
     ATTR_SET ("countlayerexecs", int, m_countlayerexecs);
     ATTR_SET ("max_warnings_per_thread", int, m_max_warnings_per_thread);
@@ -1516,7 +1565,11 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("opt_seed_bblock_aliases", int, m_opt_seed_bblock_aliases);
     ATTR_DECODE ("llvm_jit_fma", int, m_llvm_jit_fma);
     ATTR_DECODE ("llvm_jit_aggressive", int, m_llvm_jit_aggressive);
+    ATTR_DECODE ("llvm_string_hashes", int, m_llvm_string_hashes);
+    ATTR_DECODE ("llvm_parallel_layers", int, m_llvm_parallel_layers);
+    ATTR_DECODE ("llvm_lazy_jit", int, m_llvm_lazy_jit);
     ATTR_DECODE_STRING ("llvm_jit_target", m_llvm_jit_target);
+    ATTR_DECODE_STRING ("llvm_jit_cache", m_llvm_jit_cache);
     ATTR_DECODE ("vector_width", int, m_vector_width);
     ATTR_DECODE ("opt_passes", int, m_opt_passes);
     ATTR_DECODE ("optimize_nondebug", int, m_optimize_nondebug);
@@ -1530,12 +1583,14 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("llvm_profiling_events", int, m_llvm_profiling_events);
     ATTR_DECODE ("llvm_output_bitcode", int, m_llvm_output_bitcode);
     ATTR_DECODE ("llvm_dumpasm", int, m_llvm_dumpasm);
+    ATTR_DECODE ("artic_output", int, m_artic_output);
     ATTR_DECODE ("strict_messages", int, m_strict_messages);
     ATTR_DECODE ("error_repeats", int, m_error_repeats);
     ATTR_DECODE ("range_checking", int, m_range_checking);
     ATTR_DECODE ("unknown_coordsys_error", int, m_unknown_coordsys_error);
     ATTR_DECODE ("connection_error", int, m_connection_error);
     ATTR_DECODE ("greedyjit", int, m_greedyjit);
+    ATTR_DECODE ("jit_threads", int, m_jit_threads);
     ATTR_DECODE ("countlayerexecs", int, m_countlayerexecs);
     ATTR_DECODE ("relaxed_param_typecheck", int, m_relaxed_param_typecheck);
     ATTR_DECODE ("max_warnings_per_thread", int, m_max_warnings_per_thread);
@@ -1562,7 +1617,14 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("stat:groups", int, m_stat_groups);
     ATTR_DECODE ("stat:instances_compiled", int, m_stat_instances_compiled);
     ATTR_DECODE ("stat:groups_compiled", int, m_stat_groups_compiled);
+    ATTR_DECODE ("stat:groups_precompiled", int, m_stat_groups_precompiled);
     ATTR_DECODE ("stat:empty_instances", int, m_stat_empty_instances);
+    ATTR_DECODE ("stat:llvm_jit_cache_hits", int, m_stat_llvm_jit_cache_hits);
+    ATTR_DECODE ("stat:llvm_jit_cache_misses", int, m_stat_llvm_jit_cache_misses);
+    ATTR_DECODE ("stat:llvm_jit_cache_uncacheable", int, m_stat_llvm_jit_cache_uncacheable);
+    ATTR_DECODE ("stat:llvm_lazy_layers", int, m_stat_llvm_lazy_layers);
+    ATTR_DECODE ("stat:llvm_lazy_layers_jitted", int, m_stat_llvm_lazy_layers_jitted);
+    ATTR_DECODE ("stat:llvm_parallel_groups", int, m_stat_llvm_parallel_groups);
     ATTR_DECODE ("stat:merged_inst", int, m_stat_merged_inst);
     ATTR_DECODE ("stat:merged_inst_opt", int, m_stat_merged_inst_opt);
     ATTR_DECODE ("stat:empty_groups", int, m_stat_empty_groups);
@@ -1587,6 +1649,7 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("stat:llvm_irgen_time", float, m_stat_llvm_irgen_time);
     ATTR_DECODE ("stat:llvm_opt_time", float, m_stat_llvm_opt_time);
     ATTR_DECODE ("stat:llvm_jit_time", float, m_stat_llvm_jit_time);
+    ATTR_DECODE ("stat:llvm_lazy_jit_time", float, m_stat_llvm_lazy_jit_time);
     ATTR_DECODE ("stat:inst_merge_time", float, m_stat_inst_merge_time);
     ATTR_DECODE ("stat:getattribute_calls", long long, m_stat_getattribute_calls);
     ATTR_DECODE ("stat:get_userdata_calls", long long, m_stat_get_userdata_calls);
@@ -1730,6 +1793,12 @@ ShadingSystemImpl::getattribute (ShaderGroup *group, string_view name,
             ((ustring *)val)[i] = (*group)[i]->layername();
         return true;
     }
+    if (name == "shader_names" && type.basetype == TypeDesc::STRING) {
+        size_t n = std::min (type.numelements(), (size_t)group->nlayers());
+        for (size_t i = 0;  i < n;  ++i)
+            ((ustring *)val)[i] = ustring((*group)[i]->shadername());
+        return true;
+    }
     if (name == "num_renderer_outputs" && type.basetype == TypeDesc::INT) {
         *(int *)val = (int) group->m_renderer_outputs.size();
         return true;
@@ -2027,6 +2096,7 @@ ShadingSystemImpl::getstats (int level) const
     BOOLOPT (llvm_target_host);
     BOOLOPT (llvm_output_bitcode);
     BOOLOPT (llvm_dumpasm);
+    BOOLOPT (artic_output);
     BOOLOPT (llvm_prune_ir_strategy);
     BOOLOPT (lazylayers);
     BOOLOPT (lazyglobals);
@@ -2042,6 +2112,7 @@ ShadingSystemImpl::getstats (int level) const
     BOOLOPT (error_repeats);
     BOOLOPT (range_checking);
     BOOLOPT (greedyjit);
+    INTOPT (jit_threads);
     BOOLOPT (countlayerexecs);
     BOOLOPT (opt_simplify_param);
     BOOLOPT (opt_constant_fold);
@@ -2061,8 +2132,12 @@ ShadingSystemImpl::getstats (int level) const
     BOOLOPT (opt_batched_analysis);
     BOOLOPT (llvm_jit_fma);
     BOOLOPT (llvm_jit_aggressive);
+    BOOLOPT (llvm_string_hashes);
+    INTOPT (llvm_parallel_layers);
+    BOOLOPT (llvm_lazy_jit);
     INTOPT (vector_width);
     STROPT (llvm_jit_target);
+    STROPT (llvm_jit_cache);
     INTOPT  (opt_passes);
     INTOPT (no_noise);
     INTOPT (no_pointcloud);
@@ -2139,6 +2214,9 @@ ShadingSystemImpl::getstats (int level) const
 
     out << "  Compiled " << m_stat_groups_compiled << " groups, "
         << m_stat_instances_compiled << " instances\n";
+    if (m_stat_groups_precompiled > 0)
+        out << "  Bound " << m_stat_groups_precompiled
+            << " groups to precompiled code\n";
     out << "  Merged " << (m_stat_merged_inst+m_stat_merged_inst_opt)
         << " instances (" << m_stat_merged_inst << " initial, "
         << m_stat_merged_inst_opt << " after opt) in "
@@ -2185,6 +2263,17 @@ ShadingSystemImpl::getstats (int level) const
         out << "    LLVM JIT:                  "
             << Strutil::timeintervalformat (m_stat_llvm_jit_time, 2) << "\n";
     }
+    if (m_llvm_jit_cache.size())
+        out << "  JIT cache: " << (int)m_stat_llvm_jit_cache_hits << " hits, "
+            << (int)m_stat_llvm_jit_cache_misses << " misses, "
+            << (int)m_stat_llvm_jit_cache_uncacheable << " uncacheable groups\n";
+    if (m_llvm_lazy_jit)
+        out << "  Lazy JIT: " << (int)m_stat_llvm_lazy_layers_jitted << " of "
+            << (int)m_stat_llvm_lazy_layers << " deferred layers JITed ("
+            << Strutil::timeintervalformat (m_stat_llvm_lazy_jit_time, 2) << ")\n";
+    if (m_llvm_parallel_layers > 1)
+        out << "  Parallel layers: " << (int)m_stat_llvm_parallel_groups
+            << " groups compiled in modules on several threads\n";
 
     out << "  Texture calls compiled: "
         << (int)m_stat_tex_calls_codegened
@@ -3149,6 +3238,15 @@ ShadingSystemImpl::is_renderer_output (ustring layername, ustring paramname,
 
 
 
+const std::vector<ustring>&
+ShadingSystemImpl::renderer_outputs (const ShaderGroup &group) const
+{
+    return group.m_renderer_outputs.size() ? group.m_renderer_outputs
+                                           : m_renderer_outputs;
+}
+
+
+
 void
 ShadingSystemImpl::group_post_jit_cleanup (ShaderGroup &group)
 {
@@ -3198,7 +3296,31 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx, bool
         return;    // already optimized and optionally jitted
 
     OIIO::Timer timer;
-    lock_guard lock (group.m_mutex);
+    std::unique_lock<mutex> lock (group.m_mutex, std::try_to_lock);
+    if (! lock.owns_lock()) {
+        // Another thread is compiling this group. Rather than sit idle
+        // until it's done, compile groups waiting in the async queue (on
+        // their own clock: they record their own stats) -- but only those
+        // at least as urgent as this one, so that we never make this
+        // group's caller wait on less important work. A group that isn't
+        // queued has no priority to compare with, so just wait for it.
+        bool queued;
+        float priority = 0.0f;
+        {
+            std::lock_guard<std::mutex> qlock (m_compile_queue_mutex);
+            auto found = m_compile_jobs.find (&group);
+            queued = (found != m_compile_jobs.end());
+            if (queued)
+                priority = found->second->priority;
+        }
+        timer.stop ();
+        while (queued && compile_queued_group (nullptr, false, priority)
+               && ! lock.try_lock())
+            ;
+        timer.start ();
+        if (! lock.owns_lock())
+            lock.lock ();
+    }
     bool need_jit = do_jit && !group.jitted();
     if (group.optimized() && !need_jit) {
         // The group was somehow optimized by another thread between the
@@ -3272,6 +3394,13 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx, bool
         }
         group.m_optimized = true;
 
+        // The ops are only around until the group is JITed, so this is
+        // the place to translate them.
+        if (m_artic_output) {
+            BackendArtic artic (*this, group, ctx);
+            artic.run ();
+        }
+
         spin_lock stat_lock (m_stat_mutex);
         if (!need_jit) {
             m_stat_opt_locking_time += locking_time;
@@ -3322,6 +3451,172 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx, bool
     m_groups_to_compile_count -= 1;
 }
 
+std::shared_future<void>
+ShadingSystemImpl::optimize_group_async (ShaderGroupRef group, float priority,
+                                         bool do_jit)
+{
+    if (! group || (group->optimized() && (!do_jit || group->jitted()))) {
+        std::promise<void> done;
+        done.set_value ();
+        return done.get_future().share();
+    }
+
+    std::lock_guard<std::mutex> lock (m_compile_queue_mutex);
+    auto& job = m_compile_jobs[group.get()];
+    if (job) {
+        // Already requested: reorder it if it hasn't started yet, and
+        // make sure it will be JITed if that's asked for now.
+        if (m_compile_queue.erase (job.get())) {
+            job->priority = priority;
+            m_compile_queue.insert (job.get());
+        }
+        job->do_jit |= do_jit;
+        return job->future;
+    }
+    job.reset (new CompileJob);
+    job->group = group;
+    job->priority = priority;
+    job->order = m_compile_jobs_queued++;
+    job->do_jit = do_jit;
+    job->future = job->done.get_future().share();
+    m_compile_queue.insert (job.get());
+
+    // A negative jit_threads means no background threads at all: the
+    // queue is then only served by compile_queued_group.
+    if (m_compile_threads.empty() && ! m_compile_threads_stop
+        && m_jit_threads >= 0) {
+        int nthreads = m_jit_threads > 0 ? m_jit_threads
+                     : std::max (1, (int)std::thread::hardware_concurrency());
+        for (int t = 0;  t < nthreads;  ++t)
+            m_compile_threads.emplace_back (&ShadingSystemImpl::compile_thread_main, this);
+    }
+    m_compile_queue_cv.notify_one ();
+    return job->future;
+}
+
+
+
+bool
+ShadingSystemImpl::compile_queued_group (ShadingContext *ctx, bool wait,
+                                         float min_priority)
+{
+    CompileJob *job = nullptr;
+    bool do_jit;
+    {
+        std::unique_lock<std::mutex> lock (m_compile_queue_mutex);
+        if (wait)
+            m_compile_queue_cv.wait (lock, [&]{
+                return m_compile_threads_stop || ! m_compile_queue.empty();
+            });
+        if (m_compile_threads_stop || m_compile_queue.empty()
+            || (*m_compile_queue.begin())->priority < min_priority)
+            return false;
+        job = *m_compile_queue.begin();
+        m_compile_queue.erase (m_compile_queue.begin());
+        do_jit = job->do_jit;
+    }
+
+    ShaderGroup *group = job->group.get();
+    std::unique_ptr<CompileJob> finished;
+    while (! finished) {
+        optimize_group (*group, ctx, do_jit);
+        // A JIT may have been asked for while we were only optimizing.
+        std::lock_guard<std::mutex> lock (m_compile_queue_mutex);
+        if (job->do_jit == do_jit) {
+            auto found = m_compile_jobs.find (group);
+            finished = std::move (found->second);
+            m_compile_jobs.erase (found);
+            finished->done.set_value ();
+        }
+        do_jit = job->do_jit;
+    }
+    // N.B. finished may hold the last reference to the group, so let it
+    // go only now that m_compile_queue_mutex is released.
+    return true;
+}
+
+
+
+void
+ShadingSystemImpl::compile_thread_main ()
+{
+    PerThreadInfo* threadinfo = create_thread_info();
+    ShadingContext* ctx = get_context(threadinfo);
+    while (compile_queued_group (ctx, true /*wait*/))
+        ;
+    release_context(ctx);
+    destroy_thread_info(threadinfo);
+}
+
+
+
+void
+ShadingSystemImpl::stop_compile_threads ()
+{
+    {
+        std::lock_guard<std::mutex> lock (m_compile_queue_mutex);
+        m_compile_threads_stop = true;
+    }
+    m_compile_queue_cv.notify_all ();
+    for (auto&& t : m_compile_threads)
+        t.join ();
+    m_compile_threads.clear ();
+    // Jobs that never started are dropped; their futures report a
+    // broken promise.
+    m_compile_queue.clear ();
+    m_compile_jobs.clear ();
+}
+
+
+
+// Precompiled groups run all their layers from the entry point, so there
+// is nothing to do at execute_init time.
+static void
+precompiled_group_init (void* /*sg*/, void* /*groupdata*/)
+{
+}
+
+
+
+bool
+ShadingSystemImpl::register_compiled_group (ShaderGroup &group,
+                                            CompiledGroupFunc entry,
+                                            size_t groupdata_size)
+{
+    if (! entry) {
+        errorf ("register_compiled_group: no entry point given for group \"%s\"",
+                group.name());
+        return false;
+    }
+    lock_guard lock (group.m_mutex);
+    if (group.jitted() || group.nlayers() == 0 || m_curgroup.get() == &group) {
+        errorf ("register_compiled_group: group \"%s\" is %s", group.name(),
+                group.jitted() ? "already compiled" : "not complete");
+        return false;
+    }
+
+    // A group that was already optimized (but not JITed) was taken off
+    // the to-compile count by optimize_group, don't count it twice.
+    bool was_optimized = group.optimized();
+
+    // Execution only ever calls the last layer (the entry) after the
+    // init function, exactly the parts of a JITed group that are used.
+    group.llvm_compiled_init (precompiled_group_init);
+    group.llvm_compiled_layer (group.nlayers()-1, (RunLLVMGroupFunc)entry);
+    group.llvm_compiled_version ((RunLLVMGroupFunc)entry);
+    group.llvm_groupdata_size (groupdata_size);
+    group.m_precompiled = true;
+    group.m_optimized = true;
+    group.m_jitted = true;
+
+    m_stat_groups_precompiled += 1;
+    if (! was_optimized)
+        m_groups_to_compile_count -= 1;
+    return true;
+}
+
+
+
 template <int WidthT>
 void
 ShadingSystemImpl::Batched<WidthT>::jit_group (ShaderGroup &group, ShadingContext *ctx)
@@ -4142,3 +4437,108 @@ osl_bind_interpolated_param (void *sg_, const void *name, long long type,
     }
     return 0;  // no such user data
 }
+
+
+
+// Called by the stub of a layer that llvm_lazy_jit left to be JITed when
+// it first runs, to JIT it.
+OSL_SHADEOP void *
+osl_jit_layer (void *group_, int layer)
+{
+    ShaderGroup *group = (ShaderGroup *)group_;
+    return group->llvm_jit_layer (layer);
+}
+
+
+
+// Artic
+//
+// The attribute and userdata callbacks of RendererServices, for shaders
+// compiled ahead of time from Artic (see anyosl_renderer.art).  Names are
+// plain C strings, types come as an ArticTypeDesc and string values
+// travel as their hashes.
+
+// Call query with type, and if that fails for a triple given without
+// vector semantics (the AST transpiler can't tell colors from points),
+// with each of the semantics a renderer may be checking for.
+template<typename Query>
+static bool
+artic_query_triple (TypeDesc type, Query query)
+{
+    if (query (type))
+        return true;
+    if (type.basetype != TypeDesc::FLOAT || type.aggregate != TypeDesc::VEC3
+        || type.vecsemantics != TypeDesc::NOSEMANTICS)
+        return false;
+    for (auto semantics : { TypeDesc::COLOR, TypeDesc::POINT,
+                            TypeDesc::VECTOR, TypeDesc::NORMAL }) {
+        type.vecsemantics = semantics;
+        if (query (type))
+            return true;
+    }
+    return false;
+}
+
+
+
+OSL_ARTIC_EXPORT int
+osl_artic_get_attribute (void *sg_, int derivatives, const char *object,
+                         const void *type_, const char *name,
+                         int array_lookup, int index, void *data)
+{
+    ShaderGlobals *sg = (ShaderGlobals *)sg_;
+    ustring objname (object), attrname (name);
+    TypeDesc type = ((const ArticTypeDesc *)type_)->typedesc();
+    bool ok = artic_query_triple (type, [&](TypeDesc t) {
+        return sg->context->osl_get_attribute (sg, sg->objdata, derivatives,
+                                               objname, attrname,
+                                               array_lookup, index, t, data);
+    });
+    if (ok)
+        artic_strings_to_hashes (type, data);
+    return ok;
+}
+
+
+
+// The same query with a NULL sg, the way the runtime optimizer asks:
+// the renderer only answers what holds wherever the group is run, so
+// the answer can be shared by a whole batch of points.  sg only leads
+// to the renderer.
+OSL_ARTIC_EXPORT int
+osl_artic_get_uniform_attribute (void *sg_, const char *object,
+                                 const void *type_, const char *name,
+                                 int array_lookup, int index, void *data)
+{
+    ShaderGlobals *sg = (ShaderGlobals *)sg_;
+    ustring objname (object), attrname (name);
+    TypeDesc type = ((const ArticTypeDesc *)type_)->typedesc();
+    bool ok = artic_query_triple (type, [&](TypeDesc t) {
+        return array_lookup
+            ? sg->renderer->get_array_attribute (NULL, false, objname, t,
+                                                 attrname, index, data)
+            : sg->renderer->get_attribute (NULL, false, objname, t,
+                                           attrname, data);
+    });
+    if (ok)
+        artic_strings_to_hashes (type, data);
+    return ok;
+}
+
+
+
+OSL_ARTIC_EXPORT int
+osl_artic_get_userdata (int derivatives, const char *name, const void *type_,
+                        void *sg_, void *data)
+{
+    ShaderGlobals *sg = (ShaderGlobals *)sg_;
+    ustring dataname (name);
+    TypeDesc type = ((const ArticTypeDesc *)type_)->typedesc();
+    bool ok = artic_query_triple (type, [&](TypeDesc t) {
+        return sg->renderer->get_userdata (derivatives, dataname, t, sg, data);
+    });
+    sg->context->incr_get_userdata_calls ();
+    if (ok)
+        artic_strings_to_hashes (type, data);
+    return ok;
+}
@@ -43,7 +43,13 @@ usage()
            "\t-MD, -MMD      Write a depfile containing headers used, to a file\n"
            "\t-M, -MM        Like -MD, but write depfile to stdout\n"
            "\t-MF filename   Specify the name of the depfile to output (for -MD, -MMD)\n"
-           "\t-MT target     Specify a custom dependency target name for -M...\n";
+           "\t-MT target     Specify a custom dependency target name for -M...\n"
+           "\t-t target      Output target: oso (default) or artic\n"
+           "\t-artic-width N SIMD width of the Artic batch entry (1/4/8/16, default 8)\n"
+           "\t-artic-group   Input is a serialized shader group, fuse it into one Artic function\n"
+           "\t-param name value  Bake an instance value of an input into the Artic output\n"
+           "\t-artic-output name Also emit an Artic batch entry computing only the named\n"
+           "\t                   outputs (repeatable; output parameters, P, N or Ci)\n";
 }
 
 
@@ -136,6 +142,7 @@ main(int argc, const char* argv[])
                    || !strcmp(argv[a], "--write-dependencies")
                    || !strcmp(argv[a], "-MMD")
                    || !strcmp(argv[a], "--write-user-dependencies")
+                   || !strcmp(argv[a], "-artic-group")
                    || OIIO::Strutil::starts_with(argv[a], "-MF")
                    || OIIO::Strutil::starts_with(argv[a], "-MT")) {
             // Valid command-line argument
@@ -156,10 +163,16 @@ main(int argc, const char* argv[])
             args.emplace_back(argv[a]);
         } else if (!strcmp(argv[a], "-buffer")) {
             compile_from_buffer = true;
-        } else if(!strcmp(argv[a], "-t") && a < argc - 1) {
+        } else if((!strcmp(argv[a], "-t") || !strcmp(argv[a], "-artic-width")
+                   || !strcmp(argv[a], "-artic-output"))
+                  && a < argc - 1) {
             args.emplace_back(argv[a]);
             ++a;
             args.emplace_back(argv[a]);
+        } else if (!strcmp(argv[a], "-param") && a < argc - 2) {
+            args.emplace_back(argv[a++]);
+            args.emplace_back(argv[a++]);
+            args.emplace_back(argv[a]);
         }
 
         else {
@@ -0,0 +1,103 @@
+// Copyright Contributors to the Open Shading Language project.
+// SPDX-License-Identifier: BSD-3-Clause
+// https://github.com/AcademySoftwareFoundation/OpenShadingLanguage
+
+
+#include <OpenImageIO/plugin.h>
+
+#include "articshading.h"
+
+
+OSL_NAMESPACE_ENTER
+
+
+ArticShaderLibrary::~ArticShaderLibrary ()
+{
+    if (m_handle)
+        OIIO::Plugin::close (m_handle);
+}
+
+
+
+bool
+ArticShaderLibrary::load (const std::string& filename, ShadingSystem* shadingsys,
+                          const std::vector<ShaderGroupRef>& groups,
+                          OIIO::ErrorHandler& errhandler)
+{
+    m_handle = OIIO::Plugin::open (filename, /*global=*/false);
+    if (! m_handle) {
+        errhandler.error ("Could not open Artic shader library \"%s\": %s",
+                          filename, OIIO::Plugin::geterror());
+        return false;
+    }
+
+    m_eval = (EvalFunc) OIIO::Plugin::getsym (m_handle, "osl_artic_closure_eval");
+    m_sample = (SampleFunc) OIIO::Plugin::getsym (m_handle, "osl_artic_closure_sample");
+    m_emission = (EmissionFunc) OIIO::Plugin::getsym (m_handle, "osl_artic_closure_emission");
+    m_background = (EmissionFunc) OIIO::Plugin::getsym (m_handle, "osl_artic_closure_background");
+    if (! m_eval || ! m_sample || ! m_emission || ! m_background) {
+        errhandler.error ("\"%s\" lacks the osl_artic_closure_* entry points, "
+                          "was it built with anyosl_closure_exports.art?",
+                          filename);
+        return false;
+    }
+
+    m_shade.assign (groups.size(), nullptr);
+    for (size_t i = 0;  i < groups.size();  ++i) {
+        ShaderGroup *group = groups[i].get();
+        if (! group)
+            continue;
+        ustring groupname;
+        int nlayers = 0;
+        shadingsys->getattribute (group, "groupname", groupname);
+        shadingsys->getattribute (group, "num_layers", nlayers);
+        std::vector<ustring> shadernames (nlayers);
+        if (nlayers)
+            shadingsys->getattribute (group, "shader_names",
+                                      TypeDesc(TypeDesc::STRING, nlayers),
+                                      &shadernames[0]);
+
+        std::string prefix = groupname.string();
+        m_shade[i] = (ShadeFunc) OIIO::Plugin::getsym (m_handle, prefix + "_shade");
+        if (! m_shade[i] && nlayers) {
+            prefix = shadernames.back().string();
+            m_shade[i] = (ShadeFunc) OIIO::Plugin::getsym (m_handle, prefix + "_shade");
+        }
+        if (! m_shade[i]) {
+            errhandler.warning ("No Artic shader for group \"%s\" in \"%s\"",
+                                groupname, filename);
+            continue;
+        }
+        errhandler.info ("Artic: group \"%s\" runs %s_shade", groupname, prefix);
+
+        // The entry's string literals are hashes until their characters
+        // are interned; libraries built before that have no such entry.
+        auto load_strings = (LoadStringsFunc)
+            OIIO::Plugin::getsym (m_handle, prefix + "_load_strings");
+        if (load_strings)
+            load_strings ();
+    }
+    return true;
+}
+
+
+
+float
+ArticShaderLibrary::continuation (const ArticClosure& ci, const Color3& path_weight)
+{
+    float sum = path_weight.x + path_weight.y + path_weight.z;
+    if (sum == 0)
+        return 0;  // a black path can't continue
+    float w = 1 / sum;
+    float total = 0;
+    for (int i = 0;  i < ci.count;  ++i) {
+        // light lobes don't scatter
+        if (ci.lobes[i].id == ARTIC_CLOSURE_EMISSION ||
+            ci.lobes[i].id == ARTIC_CLOSURE_BACKGROUND)
+            continue;
+        total += ci.lobes[i].weight.dot(path_weight) * w;
+    }
+    return total;
+}
+
+OSL_NAMESPACE_EXIT
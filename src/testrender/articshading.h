@@ -0,0 +1,127 @@
+// Copyright Contributors to the Open Shading Language project.
+// SPDX-License-Identifier: BSD-3-Clause
+// https://github.com/AcademySoftwareFoundation/OpenShadingLanguage
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <OpenImageIO/errorhandler.h>
+
+#include <OSL/oslexec.h>
+
+
+OSL_NAMESPACE_ENTER
+
+/// Lobe ids and layouts of the closure structs of
+/// anyosl_integration_example.art.
+enum ArticClosureID {
+    ARTIC_CLOSURE_NONE = 0,
+    ARTIC_CLOSURE_DIFFUSE,
+    ARTIC_CLOSURE_REFLECTION,
+    ARTIC_CLOSURE_EMISSION,
+    ARTIC_CLOSURE_BACKGROUND,
+};
+
+struct ArticClosureLobe {
+    int   id;
+    Vec3  weight;
+    Vec3  N;
+    float params[4];
+};
+
+struct ArticClosure {
+    enum { MaxLobes = 8 };
+    int count;
+    ArticClosureLobe lobes[MaxLobes];
+};
+
+struct ArticEvaluateOut { Vec3 bsdf; float pdf; };
+struct ArticSampleOut   { Vec3 indir; float pdf; Vec3 bsdf_over_pdf; };
+
+
+/// Shaders compiled ahead of time by `oslc -t artic` and linked into a
+/// shared library, bound to the shader groups of a scene.  Each group runs
+/// the exported <groupname>_shade entry if the library has one, otherwise
+/// the <shadername>_shade entry of its last layer.  The closures those
+/// return are evaluated through the osl_artic_closure_* entry points of
+/// the library.
+class ArticShaderLibrary {
+public:
+    typedef void (*ShadeFunc)(ShaderGlobals* sg, ArticClosure* ci);
+
+    ArticShaderLibrary () {}
+    ~ArticShaderLibrary ();
+
+    /// Open the library and find an entry for every group.  Return false
+    /// (after reporting the problem to errhandler) if the library or one
+    /// of the closure entry points can't be found.  Groups without an
+    /// entry are reported and left unshaded.
+    bool load (const std::string& filename, ShadingSystem* shadingsys,
+               const std::vector<ShaderGroupRef>& groups,
+               OIIO::ErrorHandler& errhandler);
+
+    /// Run the shader of group number shaderID; return false if it has none.
+    bool shade (int shaderID, ShaderGlobals& sg, ArticClosure& ci) const {
+        if (shaderID < 0 || shaderID >= int(m_shade.size()) || !m_shade[shaderID])
+            return false;
+        ci.count = 0;
+        m_shade[shaderID] (&sg, &ci);
+        return true;
+    }
+
+    Color3 eval (const ArticClosure& ci, ShaderGlobals& sg, const Vec3& indir,
+                 float& pdf) const {
+        ArticEvaluateOut result;
+        Vec3 outdir = -sg.I;
+        m_eval (&ci, &sg, &indir, &outdir, &result);
+        pdf = result.pdf;
+        return result.bsdf;
+    }
+
+    Color3 sample (const ArticClosure& ci, ShaderGlobals& sg, const Vec3& rnd,
+                   Vec3& indir, float& pdf) const {
+        ArticSampleOut result;
+        Vec3 outdir = -sg.I;
+        m_sample (&ci, &sg, &outdir, &rnd, &result);
+        indir = result.indir;
+        pdf = result.pdf;
+        return result.bsdf_over_pdf;
+    }
+
+    Color3 emission (const ArticClosure& ci) const {
+        Vec3 result;
+        m_emission (&ci, &result);
+        return result;
+    }
+
+    Color3 background (const ArticClosure& ci) const {
+        Vec3 result;
+        m_background (&ci, &result);
+        return result;
+    }
+
+    /// Probability of continuing the path after this bounce, computed the
+    /// same way CompositeBSDF::prepare weighs its lobes (all lobes have an
+    /// albedo of 1).
+    static float continuation (const ArticClosure& ci, const Color3& path_weight);
+
+private:
+    typedef void (*EvalFunc)(const ArticClosure*, ShaderGlobals*, const Vec3*,
+                             const Vec3*, ArticEvaluateOut*);
+    typedef void (*SampleFunc)(const ArticClosure*, ShaderGlobals*,
+                               const Vec3*, const Vec3*, ArticSampleOut*);
+    typedef void (*EmissionFunc)(const ArticClosure*, Vec3*);
+    typedef void (*LoadStringsFunc)();
+
+    void* m_handle = nullptr;
+    std::vector<ShadeFunc> m_shade;   // indexed like the scene's groups
+    EvalFunc m_eval = nullptr;
+    SampleFunc m_sample = nullptr;
+    EmissionFunc m_emission = nullptr;
+    EmissionFunc m_background = nullptr;
+};
+
+OSL_NAMESPACE_EXIT
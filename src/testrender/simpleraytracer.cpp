@@ -744,10 +744,97 @@ Vec3 SimpleRaytracer::eval_background(const Dual2<Vec3>& dir, ShadingContext* ct
     sg.I = dir.val();
     sg.dIdx = dir.dx();
     sg.dIdy = dir.dy();
+    if (artic) {
+        ArticClosure ci;
+        if (!artic->shade(backgroundShaderID, sg, ci))
+            return Vec3(0, 0, 0);
+        return artic->background(ci);
+    }
     shadingsys->execute(*ctx, *m_shaders[backgroundShaderID], sg);
     return process_background_closure(sg.Ci);
 }
 
+namespace {
+
+// The shading of a hit point, which is all the path tracer of
+// SimpleRaytracer::subpixel_radiance knows of shaders and closures:
+//   bool shade(int shaderID, ShaderGlobals& sg, bool light_only)
+//       runs the shader of the point, false if it has none,
+//   Color3 emission() const
+//       is the light the point emits,
+//   bool prepare(const ShaderGlobals& sg, Color3& path_weight, bool absorb,
+//                Sampler& sampler)
+//       gets ready to sample the closures, and returns false if the path
+//       is absorbed (russian roulette) instead,
+//   Color3 eval(ShaderGlobals& sg, const Vec3& wi, float& pdf) const
+//   Color3 sample(ShaderGlobals& sg, const Vec3& rnd, Dual2<Vec3>& wi,
+//                 float& pdf) const
+//       evaluate and sample the closures like CompositeBSDF does.
+
+// Shaders run by the ShadingSystem, closures turned into a CompositeBSDF.
+struct OSLShading {
+    OSLShading(SimpleRaytracer& rend, ShadingContext* ctx) : rend(rend), ctx(ctx) {}
+
+    bool shade(int shaderID, ShaderGlobals& sg, bool light_only) {
+        if (shaderID < 0 || !rend.shaders()[shaderID]) return false;
+        rend.shadingsys->execute(*ctx, *rend.shaders()[shaderID], sg);
+        process_closure(result, sg.Ci, light_only);
+        return true;
+    }
+    Color3 emission() const { return result.Le; }
+    bool prepare(const ShaderGlobals& sg, Color3& path_weight, bool absorb, Sampler& /*sampler*/) {
+        // absorption leaves the lobe pdfs summing to less than one, so
+        // that sample() may return black
+        result.bsdf.prepare(sg, path_weight, absorb);
+        return true;
+    }
+    Color3 eval(ShaderGlobals& sg, const Vec3& wi, float& pdf) const {
+        return result.bsdf.eval(sg, wi, pdf);
+    }
+    Color3 sample(ShaderGlobals& sg, const Vec3& rnd, Dual2<Vec3>& wi, float& pdf) const {
+        return result.bsdf.sample(sg, rnd.x, rnd.y, rnd.z, wi, pdf);
+    }
+
+    SimpleRaytracer& rend;
+    ShadingContext* ctx;
+    ShadingResult result;
+};
+
+// Shaders of the Artic shader library, called directly, and closures
+// evaluated and sampled by the library's closure entry points.
+struct ArticShading {
+    ArticShading(SimpleRaytracer& rend, ShadingContext* /*ctx*/) : lib(*rend.artic) {}
+
+    bool shade(int shaderID, ShaderGlobals& sg, bool /*light_only*/) {
+        return lib.shade(shaderID, sg, ci);
+    }
+    Color3 emission() const { return lib.emission(ci); }
+    bool prepare(const ShaderGlobals& /*sg*/, Color3& path_weight, bool absorb, Sampler& sampler) {
+        // russian roulette, the way CompositeBSDF::prepare absorbs
+        float q = ArticShaderLibrary::continuation(ci, path_weight);
+        if (absorb && q < 1) {
+            if (!(sampler.get().x < q)) return false;
+            path_weight *= 1 / q;
+        }
+        return true;
+    }
+    Color3 eval(ShaderGlobals& sg, const Vec3& wi, float& pdf) const {
+        return lib.eval(ci, sg, wi, pdf);
+    }
+    Color3 sample(ShaderGlobals& sg, const Vec3& rnd, Dual2<Vec3>& wi, float& pdf) const {
+        Vec3 indir;
+        Color3 weight = lib.sample(ci, sg, rnd, indir, pdf);
+        wi = Dual2<Vec3>(indir);
+        return weight;
+    }
+
+    const ArticShaderLibrary& lib;
+    ArticClosure ci;
+};
+
+} // anonymous namespace
+
+template <typename Shading>
 Color3 SimpleRaytracer::subpixel_radiance(float x, float y, Sampler& sampler, ShadingContext* ctx) {
     Ray r = camera.get(x, y);
     Color3 path_weight(1, 1, 1);
@@ -777,13 +864,11 @@ Color3 SimpleRaytracer::subpixel_radiance(float x, float y, Sampler& sampler, Sh
         ShaderGlobals sg;
         globals_from_hit(sg, r, t, id, flip);
         int shaderID = scene.shaderid(id);
-        if (shaderID < 0 || !m_shaders[shaderID]) break; // no shader attached? done
+        bool last_bounce = b == max_bounces;
 
         // execute shader and process the resulting list of closures
-        shadingsys->execute (*ctx, *m_shaders[shaderID], sg);
-        ShadingResult result;
-        bool last_bounce = b == max_bounces;
-        process_closure(result, sg.Ci, last_bounce);
+        Shading shading(*this, ctx);
+        if (!shading.shade(shaderID, sg, last_bounce)) break; // no shader attached? done
 
         // add self-emission
         float k = 1;
@@ -792,26 +877,25 @@ Color3 SimpleRaytracer::subpixel_radiance(float x, float y, Sampler& sampler, Sh
             float light_pdf = scene.shapepdf(id, r.origin.val(), sg.P);
             k = MIS::power_heuristic<MIS::WEIGHT_EVAL>(bsdf_pdf, light_pdf);
         }
-        path_radiance += path_weight * k * result.Le;
+        path_radiance += path_weight * k * shading.emission();
 
         // last bounce? nothing left to do
         if (last_bounce) break;
 
         // build internal pdf for sampling between bsdf closures
-        result.bsdf.prepare(sg, path_weight, b >= rr_depth);
+        if (!shading.prepare(sg, path_weight, b >= rr_depth, sampler)) break;
 
         // get three random numbers
         Vec3 s = sampler.get();
         float xi = s.x;
         float yi = s.y;
-        float zi = s.z;
 
         // trace one ray to the background
         if (backgroundResolution > 0) {
             Dual2<Vec3> bg_dir;
             float bg_pdf = 0, bsdf_pdf = 0;
             Vec3 bg = background.sample(xi, yi, bg_dir, bg_pdf);
-            Color3 bsdf_weight = result.bsdf.eval(sg, bg_dir.val(), bsdf_pdf);
+            Color3 bsdf_weight = shading.eval(sg, bg_dir.val(), bsdf_pdf);
             Color3 contrib = path_weight * bsdf_weight * bg * MIS::power_heuristic<MIS::WEIGHT_WEIGHT>(bg_pdf, bsdf_pdf);
             if ((contrib.x + contrib.y + contrib.z) > 0) {
                 int shadow_id = id;
@@ -832,7 +916,7 @@ Color3 SimpleRaytracer::subpixel_radiance(float x, float y, Sampler& sampler, Sh
             float light_pdf;
             Vec3 ldir = scene.sample(lid, sg.P, xi, yi, light_pdf);
             float bsdf_pdf = 0;
-            Color3 bsdf_weight = result.bsdf.eval(sg, ldir, bsdf_pdf);
+            Color3 bsdf_weight = shading.eval(sg, ldir, bsdf_pdf);
             Color3 contrib = path_weight * bsdf_weight * MIS::power_heuristic<MIS::EVAL_WEIGHT>(light_pdf, bsdf_pdf);
             if ((contrib.x + contrib.y + contrib.z) > 0) {
                 Ray shadow_ray = Ray(sg.P, ldir);
@@ -845,17 +929,15 @@ Color3 SimpleRaytracer::subpixel_radiance(float x, float y, Sampler& sampler, Sh
                     ShaderGlobals light_sg;
                     globals_from_hit(light_sg, shadow_ray, shadow_dist, lid, false);
                     // execute the light shader (for emissive closures only)
-                    shadingsys->execute (*ctx, *m_shaders[shaderID], light_sg);
-                    ShadingResult light_result;
-                    process_closure(light_result, light_sg.Ci, true);
-                    // accumulate contribution
-                    path_radiance += contrib * light_result.Le;
+                    Shading light_shading(*this, ctx);
+                    if (light_shading.shade(shaderID, light_sg, true))
+                        path_radiance += contrib * light_shading.emission(); // accumulate contribution
                 }
             }
         }
 
         // trace indirect ray and continue
-        path_weight *= result.bsdf.sample(sg, xi, yi, zi, r.direction, bsdf_pdf);
+        path_weight *= shading.sample(sg, s, r.direction, bsdf_pdf);
         if (!(path_weight.x > 0) && !(path_weight.y > 0) && !(path_weight.z > 0))
             break; // filter out all 0's or NaNs
         prev_id = id;
@@ -876,7 +958,8 @@ Color3 SimpleRaytracer::antialias_pixel(int x, int y, ShadingContext* ctx)
         j.x *= 2; j.x = j.x < 1 ? sqrtf(j.x) - 1 : 1 - sqrtf(2 - j.x);
         j.y *= 2; j.y = j.y < 1 ? sqrtf(j.y) - 1 : 1 - sqrtf(2 - j.y);
         // trace eye ray (apply jitter from center of the pixel)
-        Color3 r = subpixel_radiance(x + 0.5f + j.x, y + 0.5f + j.y, sampler, ctx);
+        Color3 r = artic ? subpixel_radiance<ArticShading>(x + 0.5f + j.x, y + 0.5f + j.y, sampler, ctx)
+                         : subpixel_radiance<OSLShading>(x + 0.5f + j.x, y + 0.5f + j.y, sampler, ctx);
         // mix in result via lerp for numerical stability
         result = OIIO::lerp(result, r, 1.0f / (si + 1));
     }
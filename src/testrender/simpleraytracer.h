@@ -16,6 +16,7 @@
 #include "raytracer.h"
 #include "sampling.h"
 #include "background.h"
+#include "articshading.h"
 
 
 OSL_NAMESPACE_ENTER
@@ -95,6 +96,9 @@ public:
     Scene scene;
     Background background;
     ShadingSystem *shadingsys = nullptr;
+    // When set, surfaces are shaded by AOT-compiled Artic shaders instead
+    // of the ShadingSystem.
+    std::unique_ptr<ArticShaderLibrary> artic;
     OIIO::ParamValueList options;
     OIIO::ImageBuf pixelbuf;
 
@@ -162,6 +166,8 @@ private:
     void globals_from_hit(ShaderGlobals& sg, const Ray& r,
                           const Dual2<float>& t, int id, bool flip);
     Vec3 eval_background(const Dual2<Vec3>& dir, ShadingContext* ctx);
+    // The path tracer, shading hit points with Shading (OSL's or Artic's)
+    template <typename Shading>
     Color3 subpixel_radiance(float x, float y, Sampler& sampler,
                              ShadingContext* ctx);
     Color3 antialias_pixel(int x, int y, ShadingContext* ctx);
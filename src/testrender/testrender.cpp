@@ -54,6 +54,7 @@ static int num_threads = 0;
 static int iters = 1;
 static std::string scenefile, imagefile;
 static std::string shaderpath;
+static std::string articlib;
 static bool shadingsys_options_set = false;
 static bool use_optix = OIIO::Strutil::stoi(OIIO::Sysutil::getenv("TESTSHADE_OPTIX"));
 
@@ -131,6 +132,7 @@ void getargs(int argc, const char *argv[])
                 "--path %s", &shaderpath, "Specify oso search path",
                 "--options %s", &extraoptions, "Set extra OSL options",
                 "--texoptions %s", &texoptions, "Set extra TextureSystem options",
+                "--artic %s", &articlib, "Shade with the AOT-compiled shaders of an Artic library (oslc -t artic)",
                 NULL);
     if (ap.parse(argc, argv) < 0) {
         std::cerr << ap.geterror() << std::endl;
@@ -220,6 +222,19 @@ main (int argc, const char *argv[])
         rend->camera.resolution (xres, yres);
         rend->parse_scene_xml (scenefile);
 
+        // Bind the scene's groups to the precompiled Artic shaders. They
+        // are never JITed then, so setup time only covers loading them.
+        if (articlib.size()) {
+            if (use_optix) {
+                std::cerr << "testrender: --artic is not supported with --optix\n";
+                return EXIT_FAILURE;
+            }
+            rend->artic.reset (new ArticShaderLibrary);
+            if (! rend->artic->load (articlib, shadingsys, rend->shaders(),
+                                     rend->errhandler()))
+                return EXIT_FAILURE;
+        }
+
         rend->prepare_render ();
 
         rend->pixelbuf.reset (ImageSpec(xres, yres, 3, TypeDesc::FLOAT));
@@ -7,6 +7,7 @@
 #include <fstream>
 #include <iostream>
 #include <locale>
+#include <map>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -21,6 +22,7 @@
 #include <OpenImageIO/sysutil.h>
 #include <OpenImageIO/filesystem.h>
 #include <OpenImageIO/timer.h>
+#include <OpenImageIO/plugin.h>
 
 #ifdef OSL_USE_OPTIX
 // purely to get optix version -- once optix 7.0 is required this can go away
@@ -47,6 +49,7 @@ static std::vector<ustring> outputvarnames;
 static std::string dataformatname = "";
 static std::vector<std::string> entrylayers;
 static std::vector<std::string> entryoutputs;
+static std::vector<std::string> printstats;
 static std::vector<int> entrylayer_index;
 static std::vector<const ShaderSymbol *> entrylayer_symbols;
 static bool debug1 = false;
@@ -72,6 +75,8 @@ static bool use_group_outputs = false;
 static bool do_oslquery = false;
 static bool inbuffer = false;
 static bool use_shade_image = false;
+static bool async_jit = false;
+static std::string async_queue;
 static bool userdata_isconnected = false;
 static bool print_outputs = false;
 static bool use_optix = OIIO::Strutil::stoi(OIIO::Sysutil::getenv("TESTSHADE_OPTIX"));
@@ -85,6 +90,7 @@ static ParamValueList params;
 static ParamValueList reparams;
 static std::string reparam_layer;
 static ErrorHandler errhandler;
+static std::string articlib;
 static int iters = 1;
 static std::string raytype = "camera";
 static bool raytype_opt = false;
@@ -192,7 +198,9 @@ set_shadingsys_options ()
     if (const char *opt_env = getenv ("TESTSHADE_BATCH_SIZE"))
         batch_size = atoi(opt_env);
 
-    if (batched) {
+    // The Artic library brings its own vectorized entry, none of the
+    // batched JIT requirements apply.
+    if (batched && articlib.empty()) {
         // We are only building FMA versions, so force it on
         shadingsys->attribute ("llvm_jit_fma", 1);
 
@@ -227,7 +235,7 @@ set_shadingsys_options ()
         }
     }
 
-    if (!batched) {
+    if (!batched || articlib.size()) {
         // NOTE:  When opt_batched_analysis is enabled,
         // uniform and varying temps will not coalesce
         // with each other.  Neither will symbols
@@ -520,6 +528,61 @@ action_groupspec (int /*argc*/, const char *argv[])
 
 
 
+// Queue the group for the background compile threads, and wait for it
+// like a renderer would before shading with it. If --async-queue asked
+// for it, first queue copies of the group, so that the test can check the
+// order in which the queue is served. While waiting, help compile queued
+// groups on this thread (which is the only one serving the queue when
+// jit_threads is negative), reporting every group as it is done.
+static void
+async_compile_group ()
+{
+    std::string pickle;
+    shadingsys->getattribute (shadergroup.get(), "pickle", pickle);
+    std::vector<std::string> names;
+    std::map<std::string,ShaderGroupRef> copies;
+    std::map<std::string,std::shared_future<void>> futures;
+    std::vector<std::string> requests;
+    OIIO::Strutil::split (async_queue, requests);
+    for (auto&& r : requests) {
+        std::vector<std::string> fields;
+        OIIO::Strutil::split (r, fields, ":");
+        const std::string& name (fields[0]);
+        float priority = fields.size() > 1 ? OIIO::Strutil::from_string<float> (fields[1]) : 0.0f;
+        bool do_jit = fields.size() > 2 && fields[2] == "jit";
+        ShaderGroupRef& group (copies[name]);
+        if (! group) {
+            group = shadingsys->ShaderGroupBegin (name, "surface", pickle);
+            shadingsys->ShaderGroupEnd (*group);
+            names.push_back (name);
+        }
+        futures[name] = shadingsys->optimize_group_async (group, priority, do_jit);
+    }
+    std::shared_future<void> done = shadingsys->optimize_group_async (shadergroup);
+    names.push_back (groupname.size() ? groupname : std::string("shaded group"));
+    futures[names.back()] = done;
+
+    auto ready = [](const std::shared_future<void>& f) {
+        return f.wait_for (std::chrono::seconds(0)) == std::future_status::ready;
+    };
+    auto report = [&]() {
+        for (auto&& name : names) {
+            auto f = futures.find (name);
+            if (f != futures.end() && ready (f->second)) {
+                std::cout << "Compiled " << name << "\n";
+                futures.erase (f);
+            }
+        }
+    };
+    while (! ready (done) && shadingsys->compile_queued_group ()) {
+        if (async_queue.size())
+            report ();
+    }
+    done.wait ();
+}
+
+
+
 static void
 stash_shader_arg (int argc, const char* argv[])
 {
@@ -584,7 +647,9 @@ getargs (int argc, const char *argv[])
                 "--llvm_debug", &llvm_debug, "Turn on LLVM debugging info",
                 "--runstats", &runstats, "Print run statistics",
                 "--stats", &runstats, "",  // DEPRECATED 1.7
+                "--printstat %L", &printstats, "Print a shading system statistic (e.g. stat:llvm_jit_cache_hits) when done",
                 "--batched", &batched, "Submit batches to ShadingSystem",
+                "--artic %s", &articlib, "Shade with the group compiled into this Artic library (built from the artic_output source)",
                 "--vary_pdxdy", &vary_Pdxdy, "populate Dx(P) & Dy(P) with varying values (vs. uniform)",
                 "--vary_udxdy", &vary_udxdy, "populate Dx(u) & Dy(u) with varying values (vs. uniform)",
                 "--vary_vdxdy", &vary_vdxdy, "populate Dx(v) & Dy(v) with varying values (vs. uniform)",
@@ -633,6 +698,8 @@ getargs (int argc, const char *argv[])
                 "--inbuffer", &inbuffer, "Compile osl source from and to buffer",
                 "--shadeimage", &use_shade_image, "Use shade_image utility",
                 "--noshadeimage %!", &use_shade_image, "Don't use shade_image utility",
+                "--async", &async_jit, "Compile the group with optimize_group_async on the jit_threads",
+                "--async-queue %s", &async_queue, "With --async, first queue copies of the group (args: space-separated name:priority[:jit] requests) and report the order they are compiled in",
                 "--expr %@ %s", stash_shader_arg, NULL, "Specify an OSL expression to evaluate",
                 "--offsetuv %f %f", &uoffset, &voffset, "Offset s & t texture coordinates (default: 0 0)",
                 "--offsetst %f %f", &uoffset, &voffset, "", // old name
@@ -864,7 +931,11 @@ setup_output_images (SimpleRenderer *rend, ShadingSystem *shadingsys,
     // We also choose to JIT it now during timing for setup
     OSL::PerThreadInfo *thread_info = shadingsys->create_thread_info();
     ShadingContext *ctx = shadingsys->get_context(thread_info);
-    if (batched) {
+    if (articlib.size()) {
+        // The code comes from the Artic library, optimize only to be
+        // able to find the output symbols.
+        shadingsys->optimize_group (shadergroup.get(), ctx, false /*do_jit*/);
+    } else if (batched) {
         // jit_group will optimize the group if necesssary
         if (batch_size == 16) {
             shadingsys->batched<16>().jit_group (shadergroup.get(), ctx);
@@ -872,6 +943,8 @@ setup_output_images (SimpleRenderer *rend, ShadingSystem *shadingsys,
             ASSERT((batch_size == 8) && "Unsupport batch size");
             shadingsys->batched<8>().jit_group (shadergroup.get(), ctx);
         }
+    } else if (async_jit) {
+        async_compile_group ();
     } else {
         shadingsys->optimize_group (shadergroup.get(), ctx, true /*do_jit*/);
     }
@@ -957,6 +1030,41 @@ setup_output_images (SimpleRenderer *rend, ShadingSystem *shadingsys,
 // renderer outputs).  You would, of course, also grab the closure Ci
 // and integrate the lights using that BSDF to determine the radiance
 // in the direction of the camera for that pixel.
+static void
+save_output_pixel (SimpleRenderer *rend, size_t i, int x, int y,
+                   TypeDesc t, const void *data)
+{
+    OIIO::ImageBuf* outputimg = rend->outputbuf(i);
+    int nchans = outputimg->nchannels();
+    if (t.basetype == TypeDesc::FLOAT) {
+        // If the variable we are outputting is float-based, set it
+        // directly in the output buffer.
+        outputimg->setpixel (x, y, (const float *)data);
+        if (print_outputs) {
+            printf ("  %s :", outputvarnames[i].c_str());
+            for (int c = 0; c < nchans; ++c)
+                printf (" %g", ((const float *)data)[c]);
+            printf ("\n");
+        }
+    } else if (t.basetype == TypeDesc::INT) {
+        // We are outputting an integer variable, so we need to
+        // convert it to floating point.
+        float *pixel = OIIO_ALLOCA(float, nchans);
+        OIIO::convert_types (TypeDesc::BASETYPE(t.basetype), data,
+                             TypeDesc::FLOAT, pixel, nchans);
+        outputimg->setpixel (x, y, &pixel[0]);
+        if (print_outputs) {
+            printf ("  %s :", outputvarnames[i].c_str());
+            for (int c = 0; c < nchans; ++c)
+                printf (" %d", ((const int *)data)[c]);
+            printf ("\n");
+        }
+    }
+    // N.B. Drop any outputs that aren't float- or int-based
+}
+
+
+
 static void
 save_outputs (SimpleRenderer *rend, ShadingSystem *shadingsys,
               ShadingContext *ctx, int x, int y)
@@ -977,32 +1085,7 @@ save_outputs (SimpleRenderer *rend, ShadingSystem *shadingsys,
         if (!data)
             continue;  // Skip if symbol isn't found
 
-        int nchans = outputimg->nchannels();
-        if (t.basetype == TypeDesc::FLOAT) {
-            // If the variable we are outputting is float-based, set it
-            // directly in the output buffer.
-            outputimg->setpixel (x, y, (const float *)data);
-            if (print_outputs) {
-                printf ("  %s :", outputvarnames[i].c_str());
-                for (int c = 0; c < nchans; ++c)
-                    printf (" %g", ((const float *)data)[c]);
-                printf ("\n");
-            }
-        } else if (t.basetype == TypeDesc::INT) {
-            // We are outputting an integer variable, so we need to
-            // convert it to floating point.
-            float *pixel = OIIO_ALLOCA(float, nchans);
-            OIIO::convert_types (TypeDesc::BASETYPE(t.basetype), data,
-                                 TypeDesc::FLOAT, pixel, nchans);
-            outputimg->setpixel (x, y, &pixel[0]);
-            if (print_outputs) {
-                printf ("  %s :", outputvarnames[i].c_str());
-                for (int c = 0; c < nchans; ++c)
-                    printf (" %d", ((const int *)data)[c]);
-                printf ("\n");
-            }
-        }
-        // N.B. Drop any outputs that aren't float- or int-based
+        save_output_pixel (rend, i, x, y, t, data);
     }
 }
 
@@ -1541,6 +1624,134 @@ batched_shade_region (SimpleRenderer *rend, ShaderGroup *shadergroup, OIIO::ROI
 }
 
 
+// --artic mode: the group is run by the entries that the Artic backend
+// (the "artic_output" option) emitted for it, compiled into a shared
+// library.  <group>_outputs shades one point and <group>_batch a run of
+// points; both store renderer output number 'slot' (in the order of the
+// -o arguments) through the pointer given for that slot.
+struct ArticGroupEntries {
+    typedef void (*OutputsFunc)(ShaderGlobals *sg, void **outputs);
+    typedef void (*BatchFunc)(int count, ShaderGlobals *sgs, void **outputs,
+                              const int *strides);
+    typedef void (*LoadTexturesFunc)(ShaderGlobals *sg);
+    typedef void (*LoadStringsFunc)();
+
+    OIIO::Plugin::Handle handle = nullptr;
+    OutputsFunc outputs = nullptr;
+    BatchFunc batch = nullptr;
+    std::vector<TypeDesc> slot_types;   // type of each output slot
+    std::vector<int> output_slot;       // slot of each rend output image
+    int slot_size = 0;                  // bytes reserved per slot and point
+};
+
+static ArticGroupEntries artic;
+
+
+
+static bool
+setup_artic (SimpleRenderer *rend, ShaderGroup *group)
+{
+    artic.handle = OIIO::Plugin::open (articlib, /*global=*/false);
+    if (! artic.handle) {
+        std::cerr << "ERROR: Could not open Artic library \"" << articlib
+                  << "\": " << OIIO::Plugin::geterror() << "\n";
+        return false;
+    }
+
+    // Entry points are named after the group, the way BackendArtic
+    // turns it into an Artic identifier.
+    ustring gname;
+    shadingsys->getattribute (group, "groupname", gname);
+    std::string prefix = gname.string();
+    for (auto& c : prefix)
+        if (! isalnum ((unsigned char)c))
+            c = '_';
+    artic.outputs = (ArticGroupEntries::OutputsFunc)
+        OIIO::Plugin::getsym (artic.handle, prefix + "_outputs");
+    artic.batch = (ArticGroupEntries::BatchFunc)
+        OIIO::Plugin::getsym (artic.handle, prefix + "_batch");
+    auto load_textures = (ArticGroupEntries::LoadTexturesFunc)
+        OIIO::Plugin::getsym (artic.handle, prefix + "_load_textures");
+    auto load_strings = (ArticGroupEntries::LoadStringsFunc)
+        OIIO::Plugin::getsym (artic.handle, prefix + "_load_strings");
+    if (! artic.outputs || ! artic.batch || ! load_textures || ! load_strings) {
+        std::cerr << "ERROR: \"" << articlib << "\" has no entry points for "
+                  << "group \"" << gname << "\"\n";
+        return false;
+    }
+
+    // Every slot gets storage, "null" outputs and ones without an image
+    // included, since the library writes them all.
+    artic.slot_size = int (sizeof(Matrix44));
+    for (auto&& var : outputvars) {
+        const ShaderSymbol *sym = shadingsys->find_symbol (*group, ustring(var));
+        TypeDesc t = sym ? shadingsys->symbol_typedesc (sym) : TypeDesc();
+        artic.slot_types.push_back (t);
+        artic.slot_size = std::max (artic.slot_size, int (t.size()));
+    }
+    for (size_t i = 0, e = rend->noutputs();  i < e;  ++i) {
+        auto found = std::find (outputvars.begin(), outputvars.end(),
+                                rend->outputname(i).string());
+        artic.output_slot.push_back (found == outputvars.end() ? -1
+                                     : int (found - outputvars.begin()));
+    }
+
+    // Resolve the texture handles once, as JITing would.
+    ShaderGlobals sg;
+    setup_shaderglobals (sg, shadingsys, 0, 0);
+    load_strings ();
+    load_textures (&sg);
+    return true;
+}
+
+
+
+static void
+artic_shade_region (SimpleRenderer *rend, OIIO::ROI roi, bool save)
+{
+    // One row of points at a time, with the outputs of point i of the
+    // row at i * slot_size bytes into the storage of their slot.
+    int width = roi.width();
+    size_t nslots = artic.slot_types.size();
+    std::vector<ShaderGlobals> sgs (width);
+    std::vector<char> storage (std::max (size_t(1), nslots) * width * artic.slot_size);
+    std::vector<void *> outputs (nslots);
+    std::vector<int> strides (nslots, artic.slot_size);
+    for (size_t s = 0;  s < nslots;  ++s)
+        outputs[s] = &storage[s * width * artic.slot_size];
+
+    for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+        for (int i = 0;  i < width;  ++i)
+            setup_shaderglobals (sgs[i], shadingsys, roi.xbegin + i, y);
+        if (batched) {
+            artic.batch (width, sgs.data(), outputs.data(), strides.data());
+        } else {
+            std::vector<void *> point (nslots);
+            for (int i = 0;  i < width;  ++i) {
+                for (size_t s = 0;  s < nslots;  ++s)
+                    point[s] = (char *)outputs[s] + i * artic.slot_size;
+                artic.outputs (&sgs[i], point.data());
+            }
+        }
+        if (! save)
+            continue;
+        for (int i = 0;  i < width;  ++i) {
+            if (print_outputs)
+                printf ("Pixel (%d, %d):\n", roi.xbegin + i, y);
+            for (size_t o = 0, e = rend->noutputs();  o < e;  ++o) {
+                int slot = artic.output_slot[o];
+                if (! rend->outputbuf(o) || slot < 0)
+                    continue;
+                save_output_pixel (rend, o, roi.xbegin + i, y,
+                                   artic.slot_types[slot],
+                                   (const char *)outputs[slot] + i * artic.slot_size);
+            }
+        }
+    }
+}
+
+
+
 static void synchio() {
     // Synch all writes to stdout & stderr now (mostly for Windows)
     std::cout.flush();
@@ -1751,6 +1962,9 @@ test_shade (int argc, const char *argv[])
     // Set up the image outputs requested on the command line
     setup_output_images (rend, shadingsys, shadergroup);
 
+    if (articlib.size() && ! setup_artic (rend, shadergroup.get()))
+        return EXIT_FAILURE;
+
     if (debug1)
         test_group_attributes (shadergroup.get());
 
@@ -1793,7 +2007,12 @@ test_shade (int argc, const char *argv[])
 #if 0
             shade_region (rend, shadergroup.get(), roi, save);
 #else
-            if (batched) {
+            if (articlib.size()) {
+                OIIO::ImageBufAlgo::parallel_image (roi, num_threads,
+                    [&](OIIO::ROI sub_roi)->void {
+                        artic_shade_region (rend, sub_roi, save);
+                    });
+            } else if (batched) {
                 if (batch_size == 16) {
                     OIIO::ImageBufAlgo::parallel_image (roi, num_threads,
                         [&](OIIO::ROI sub_roi)->void {
@@ -1868,6 +2087,18 @@ test_shade (int argc, const char *argv[])
         }
     }
 
+    // Print the statistics that were asked for by name
+    for (auto&& name : printstats) {
+        int ival;
+        float fval;
+        if (shadingsys->getattribute (name, TypeDesc::INT, &ival))
+            std::cout << name << " = " << ival << "\n";
+        else if (shadingsys->getattribute (name, TypeDesc::FLOAT, &fval))
+            std::cout << name << " = " << fval << "\n";
+        else
+            std::cout << "Unknown statistic " << name << "\n";
+    }
+
     // Print some debugging info
     if (debug1 || runstats || profile) {
         double writetime = timer.lap();
@@ -1887,6 +2118,11 @@ test_shade (int argc, const char *argv[])
     // Give the renderer a chance to do initial cleanup while everything is still alive
     rend->clear();
 
+    if (artic.handle) {
+        OIIO::Plugin::close (artic.handle);
+        artic = ArticGroupEntries();
+    }
+
     // We're done with the shading system now, destroy it
     shadergroup.reset ();  // Must release this before destroying shadingsys
 
@@ -0,0 +1,336 @@
+#!/usr/bin/env python
+
+# Copyright Contributors to the Open Shading Language project.
+# SPDX-License-Identifier: BSD-3-Clause
+# https://github.com/AcademySoftwareFoundation/OpenShadingLanguage
+
+# Benchmark the LLVM JIT path against the Artic AOT path.
+#
+# Every shader in src/shaders, plus the test.osl of every testsuite test
+# that is driven by testshade, is shaded on the same grid in four modes:
+#
+#   llvm_scalar    testshade
+#   llvm_batched   testshade --batched
+#   artic_scalar   testshade --artic <lib>
+#   artic_vector   testshade --artic <lib> --batched
+#
+# For each shader and mode the shades/sec, the startup time (shading
+# system setup plus the warmup launch, which is where the JIT happens) and
+# the size of the generated code are written to a JSON report.  The code
+# size of the LLVM modes is the JIT memory that the shading system reports
+# in its --runstats, so the timed runs need no extra output.  Outputs of
+# every mode are compared against llvm_scalar with idiff, and the script
+# exits nonzero if any of them differs by more than the tolerance.
+#
+# The Artic library of a shader is built from the <group>.art that the
+# shading system writes with the "artic_output" option: the artic compiler
+# turns it, together with the Artic std library at the top of the source
+# tree, into LLVM IR, and the C compiler links that into a shared library.
+# The Artic modes are skipped when no artic compiler is given or when
+# testshade has no --artic mode.  With --strict, a mode that is skipped or
+# fails to run counts as a mismatch too, which is how the testsuite uses
+# this script to check that both paths give the same images.
+
+from __future__ import print_function, absolute_import
+import os
+import glob
+import sys
+import re
+import json
+import time
+import shutil
+import subprocess
+
+from optparse import OptionParser
+
+
+parser = OptionParser(usage="%prog [options] [shader.osl ...]")
+parser.add_option("--build-dir", help="OSL build directory",
+                  action="store", type="string", dest="build_dir", default=".")
+parser.add_option("--source-dir", help="OSL source directory",
+                  action="store", type="string", dest="source_dir", default=".")
+parser.add_option("--work-dir", help="scratch directory (default: <build-dir>/benchmark)",
+                  action="store", type="string", dest="work_dir", default="")
+parser.add_option("--json", help="write the report to this file (default: stdout)",
+                  action="store", type="string", dest="json", default="")
+parser.add_option("-g", "--grid", help="grid resolution (default: 512)",
+                  action="store", type="int", dest="grid", default=512)
+parser.add_option("--iters", help="shading iterations per mode (default: 10)",
+                  action="store", type="int", dest="iters", default=10)
+parser.add_option("-t", "--threads", help="testshade threads (default: auto)",
+                  action="store", type="int", dest="threads", default=0)
+parser.add_option("--tolerance", help="idiff failure threshold (default: 0.004)",
+                  action="store", type="float", dest="tolerance", default=0.004)
+parser.add_option("--failpercent", help="allowed percent of failing pixels (default: 0)",
+                  action="store", type="float", dest="failpercent", default=0.0)
+parser.add_option("--artic", help="artic compiler executable",
+                  action="store", type="string", dest="artic",
+                  default=os.environ.get("ARTIC", ""))
+parser.add_option("--cc", help="C compiler used to link Artic IR (default: clang)",
+                  action="store", type="string", dest="cc",
+                  default=os.environ.get("CC", "clang"))
+parser.add_option("--modes", help="comma separated list of modes to run",
+                  action="store", type="string", dest="modes",
+                  default="llvm_scalar,llvm_batched,artic_scalar,artic_vector")
+parser.add_option("--no-testsuite", help="only benchmark src/shaders",
+                  action="store_true", dest="no_testsuite", default=False)
+parser.add_option("--strict", help="fail on modes that are skipped or fail to run",
+                  action="store_true", dest="strict", default=False)
+(options, args) = parser.parse_args()
+
+build_dir = os.path.abspath(options.build_dir)
+source_dir = os.path.abspath(options.source_dir)
+work_dir = os.path.abspath(options.work_dir if options.work_dir
+                           else os.path.join(build_dir, "benchmark"))
+modes = [m for m in options.modes.split(",") if m]
+
+# The Artic std library, in the order the artic compiler needs it.
+artic_std_files = [ "intrinsics_thorin.art", "intrinsics_math.art",
+                    "anyosl_std.art", "anyosl_string.art", "anyosl_matrix.art",
+                    "anyosl_noise.art", "anyosl_spline.art", "anyosl_color.art",
+                    "anyosl_texture.art", "anyosl_renderer.art",
+                    "anyosl_integration_example.art" ]
+# The closure entry points, exported once per library.
+artic_export_files = [ "anyosl_closure_exports.art" ]
+
+
+def osl_app (app) :
+    for d in [ os.path.join(build_dir, "bin"),
+               os.path.join(build_dir, "src", app) ] :
+        path = os.path.join(d, app)
+        if os.path.exists(path) :
+            return path
+    return app
+
+
+def oiio_app (app) :
+    root = os.environ.get("OpenImageIO_ROOT", None)
+    if root :
+        return os.path.join(root, "bin", app)
+    return app
+
+
+def run (cmd, cwd) :
+    "Run a command, return (exit status, combined output, seconds)."
+    start = time.time()
+    proc = subprocess.Popen(cmd, cwd=cwd, stdout=subprocess.PIPE,
+                            stderr=subprocess.STDOUT)
+    out = proc.communicate()[0].decode("utf-8", "replace")
+    return (proc.returncode, out, time.time() - start)
+
+
+# Parse OIIO::Strutil::timeintervalformat output, e.g. "1m 2.5s" or "0.3s".
+def parse_interval (text) :
+    seconds = 0.0
+    for value, unit in re.findall(r"([0-9.]+)\s*([dhms])", text) :
+        seconds += float(value) * { "d": 86400, "h": 3600,
+                                    "m": 60, "s": 1 }[unit]
+    return seconds
+
+
+# Parse OIIO::Strutil::memformat output, e.g. "1.5 MB" or "512 B".
+def parse_memory (text) :
+    m = re.match(r"\s*([0-9.]+)\s*([KMG]?B)", text)
+    if not m :
+        return 0
+    return int(float(m.group(1)) * { "B": 1, "KB": 1 << 10, "MB": 1 << 20,
+                                     "GB": 1 << 30 }[m.group(2)])
+
+
+def parse_runstats (out) :
+    stats = {}
+    for key, label in [ ("setup", "Setup"), ("warmup", "Warmup"),
+                        ("run", "Run") ] :
+        m = re.search(r"^" + label + r"\s*:\s*(.*)$", out, re.MULTILINE)
+        if m :
+            stats[key] = parse_interval(m.group(1))
+    m = re.search(r"LLVM JIT memory:\s*(.*)$", out, re.MULTILINE)
+    if m :
+        stats["jit_memory"] = parse_memory(m.group(1))
+    return stats
+
+
+def output_params (oso, cwd) :
+    "Names of the output parameters of a compiled shader."
+    status, out, _ = run([osl_app("oslinfo"), "-v", oso], cwd)
+    if status != 0 :
+        return []
+    return re.findall(r'^\s*"([^"]+)"\s+"output ', out, re.MULTILINE)
+
+
+def collect_shaders () :
+    shaders = sorted(glob.glob(os.path.join(source_dir, "src", "shaders", "*.osl")))
+    if not options.no_testsuite :
+        for test in sorted(glob.glob(os.path.join(source_dir, "testsuite", "*", "test.osl"))) :
+            runpy = os.path.join(os.path.dirname(test), "run.py")
+            try :
+                with open(runpy) as f :
+                    if "testshade" not in f.read() :
+                        continue
+            except IOError :
+                continue
+            shaders.append(test)
+    return shaders
+
+
+def shader_name (path) :
+    if os.path.basename(path) == "test.osl" :
+        return "testsuite/" + os.path.basename(os.path.dirname(path))
+    return os.path.splitext(os.path.basename(path))[0]
+
+
+def testshade_has_artic () :
+    status, out, _ = run([osl_app("testshade"), "--help"], work_dir)
+    return "--artic" in out
+
+
+def build_artic_library (artfile, cwd) :
+    """Compile <group>.art with the Artic std library into a shared
+    library.  Return (library path or None, seconds, log)."""
+    stem = os.path.splitext(artfile)[0]
+    srcs = [ os.path.join(source_dir, f)
+             for f in artic_std_files + artic_export_files ] + [ artfile ]
+    status, log1, t1 = run([options.artic] + srcs
+                           + [ "--emit-llvm", "-O3", "-o", stem ], cwd)
+    if status != 0 :
+        return (None, t1, log1)
+    lib = "lib" + stem + ".so"
+    status, log2, t2 = run([options.cc, "-O3", "-shared", "-fPIC",
+                            stem + ".ll", "-o", lib ], cwd)
+    if status != 0 :
+        return (None, t1 + t2, log1 + log2)
+    return (os.path.join(cwd, lib), t1 + t2, log1 + log2)
+
+
+def images_match (a, b, cwd) :
+    status, out, _ = run([oiio_app("idiff"), "-a",
+                          "-fail", str(options.tolerance),
+                          "-failpercent", str(options.failpercent),
+                          a, b], cwd)
+    # idiff returns 1 for a warning, 2 and up for failures
+    return status <= 1
+
+
+def benchmark_shader (path) :
+    name = shader_name(path)
+    cwd = os.path.join(work_dir, name.replace("/", "_"))
+    if os.path.exists(cwd) :
+        shutil.rmtree(cwd)
+    os.makedirs(cwd)
+    result = { "name": name, "source": os.path.relpath(path, source_dir),
+               "modes": {} }
+
+    status, out, _ = run([osl_app("oslc"), "-q", path], cwd)
+    osos = glob.glob(os.path.join(cwd, "*.oso"))
+    if status != 0 or not osos :
+        result["error"] = "oslc failed: " + out.strip()
+        return result
+    oso = os.path.basename(osos[0])
+    shader = os.path.splitext(oso)[0]
+    outputs = output_params(oso, cwd)
+    result["outputs"] = outputs
+
+    base = [ osl_app("testshade"), "-g", str(options.grid), str(options.grid),
+             "--center", "--groupname", "bench", "--runstats", "--warmup" ]
+    if options.threads :
+        base += [ "-t", str(options.threads) ]
+
+    artic_lib = None
+    for mode in modes :
+        r = { }
+        result["modes"][mode] = r
+        args = list(base)
+        if mode.startswith("artic") :
+            if not have_artic :
+                r["skipped"] = "no artic compiler or testshade --artic"
+                continue
+            if artic_lib is None :
+                # Let the shading system write bench.art for this group.
+                # The -o order fixes the output slots of the entries.
+                gen = base + [ "--iters", "1", "--options", "artic_output=1" ]
+                for o in outputs :
+                    gen += [ "-o", o, "null" ]
+                status, out, _ = run(gen + [ shader ], cwd)
+                if status != 0 or not os.path.exists(os.path.join(cwd, "bench.art")) :
+                    r["error"] = "artic_output failed: " + out.strip()
+                    continue
+                artic_lib, r_compile, log = build_artic_library("bench.art", cwd)
+                result["artic_compile_time"] = r_compile
+                if artic_lib is None :
+                    r["error"] = "artic build failed: " + log.strip()
+                    continue
+            args += [ "--artic", artic_lib ]
+        if mode.endswith("batched") or mode.endswith("vector") :
+            args += [ "--batched" ]
+        for o in outputs :
+            args += [ "-o", o, "%s_%s.exr" % (mode, o) ]
+        args += [ "--iters", str(options.iters), shader ]
+
+        status, out, wall = run(args, cwd)
+        if status != 0 :
+            r["error"] = "testshade failed: " + out.strip()[-2000:]
+            continue
+        stats = parse_runstats(out)
+        runtime = stats.get("run", 0.0)
+        r["run_time"] = runtime
+        r["startup_time"] = stats.get("setup", 0.0) + stats.get("warmup", 0.0)
+        r["wall_time"] = wall
+        if runtime > 0 :
+            r["shades_per_sec"] = options.grid * options.grid * options.iters / runtime
+        if mode.startswith("artic") :
+            r["compile_time"] = result.get("artic_compile_time", 0.0)
+            r["code_size"] = os.path.getsize(artic_lib)
+        else :
+            r["code_size"] = stats.get("jit_memory", 0)
+
+        if mode != "llvm_scalar" and "llvm_scalar" in result["modes"] \
+               and "error" not in result["modes"]["llvm_scalar"] :
+            mismatched = [ o for o in outputs if not
+                           images_match("llvm_scalar_%s.exr" % o,
+                                        "%s_%s.exr" % (mode, o), cwd) ]
+            r["match"] = not mismatched
+            if mismatched :
+                r["mismatched_outputs"] = mismatched
+    return result
+
+
+if not os.path.exists(work_dir) :
+    os.makedirs(work_dir)
+have_artic = bool(options.artic) and testshade_has_artic()
+
+shaders = [ os.path.abspath(a) for a in args ] if args else collect_shaders()
+report = { "grid": [ options.grid, options.grid ],
+           "iters": options.iters,
+           "tolerance": options.tolerance,
+           "modes": modes,
+           "shaders": [] }
+failures = []
+for path in shaders :
+    res = benchmark_shader(path)
+    report["shaders"].append(res)
+    if options.strict and "error" in res :
+        failures.append("%s (oslc)" % res["name"])
+    for mode, r in res["modes"].items() :
+        if r.get("match", True) is False \
+               or (options.strict and ("error" in r or "skipped" in r)) :
+            failures.append("%s (%s)" % (res["name"], mode))
+    print("%-40s %s" % (res["name"],
+          "  ".join("%s=%.3g" % (m, r["shades_per_sec"])
+                    for m, r in sorted(res["modes"].items())
+                    if "shades_per_sec" in r)), file=sys.stderr)
+
+report["failures"] = failures
+if options.json :
+    with open(options.json, "w") as f :
+        json.dump(report, f, indent=2, sort_keys=True)
+else :
+    json.dump(report, sys.stdout, indent=2, sort_keys=True)
+    print("")
+
+if failures :
+    print("Outputs differ beyond tolerance %g%s:" % (options.tolerance,
+          " (or did not run)" if options.strict else ""), file=sys.stderr)
+    for f in failures :
+        print("    " + f, file=sys.stderr)
+    sys.exit(1)
+sys.exit(0)
@@ -0,0 +1,29 @@
+#!/usr/bin/env python
+
+# Copyright Contributors to the Open Shading Language project.
+# SPDX-License-Identifier: BSD-3-Clause
+# https://github.com/AcademySoftwareFoundation/OpenShadingLanguage
+
+# The layers-lazy group, compiled by optimize_group_async instead of on
+# the thread that shades: it must shade the same as layers-lazy.
+#
+# The second run has no background threads (jit_threads=-1), so testshade
+# serves the queue itself while it waits for its group, and reports the
+# order in which the queued groups are done. Before its own group (at
+# priority 0), it queues copies of it:
+#   - "low" at priority 0, then again at priority 3, which must move it to
+#     the front of the queue,
+#   - "high" at priority 2,
+#   - "mid" at priority 1, optimize only, then again asking for a JIT,
+#     which must upgrade the queued request rather than queue a new one.
+# So the order must be low, high, mid, then the shaded group.
+
+# The shaders of layers-lazy, compiled like local ones once copied here.
+for shader in [ "a.osl", "b.osl", "c.osl" ] :
+    shutil.copyfile (os.path.join (test_source_dir, "..", "layers-lazy", shader),
+                     shader)
+
+groupsetup = ("-g 2 2 -layer alayer a -layer blayer b --layer clayer c --connect alayer f_out clayer f_in --connect alayer c_out clayer c_in --connect blayer out clayer unused")
+
+command += testshade("--async --options jit_threads=2 " + groupsetup)
+command += testshade("--async --options jit_threads=-1 --async-queue \"low:0 high:2 mid:1 low:3 mid:1:jit\" " + groupsetup)
@@ -0,0 +1,23 @@
+#!/usr/bin/env python
+
+# Copyright Contributors to the Open Shading Language project.
+# SPDX-License-Identifier: BSD-3-Clause
+# https://github.com/AcademySoftwareFoundation/OpenShadingLanguage
+
+# Shade the same group twice with a persistent JIT cache: the first run
+# misses and stores the compiled group, the second one loads it from the
+# cache and must shade exactly the same. String constants go by hash, and
+# the closure refers to the renderer by a named symbol, or the group would
+# bake in addresses of the process and not be cacheable.
+# Neither is debug output, which testshade asks for unless turned off.
+
+shutil.rmtree ("jitcache", ignore_errors=True)
+
+cacheargs = ("-g 2 2 --options llvm_jit_cache=jitcache,llvm_string_hashes=1," +
+             "llvm_debug=0,llvm_debugging_symbols=0,llvm_profiling_events=0 " +
+             "--printstat stat:llvm_jit_cache_hits " +
+             "--printstat stat:llvm_jit_cache_misses " +
+             "--printstat stat:llvm_jit_cache_uncacheable test")
+
+command += testshade(cacheargs)
+command += testshade(cacheargs)
@@ -0,0 +1,28 @@
+#!/usr/bin/env python
+
+# Copyright Contributors to the Open Shading Language project.
+# SPDX-License-Identifier: BSD-3-Clause
+# https://github.com/AcademySoftwareFoundation/OpenShadingLanguage
+
+# The layers-lazy group with llvm_lazy_jit: layers a and b are left to be
+# JITed when they first run. Layer a is JITed when layer c first pulls its
+# outputs, and layer b, whose output c never reads, is never JITed at all.
+# Once on its own and once with parallel layers, it must shade the same as
+# layers-lazy.
+#
+# testshade asks for debugging symbols and profiling events, which keep
+# the module whole, so they are turned off. The test only runs
+# unoptimized (NOOPTIMIZE), since the runtime optimizer would remove
+# layer b altogether.
+
+# The shaders of layers-lazy, compiled like local ones once copied here.
+for shader in [ "a.osl", "b.osl", "c.osl" ] :
+    shutil.copyfile (os.path.join (test_source_dir, "..", "layers-lazy", shader),
+                     shader)
+
+options = "llvm_lazy_jit=1,llvm_debug=0,llvm_debugging_symbols=0,llvm_profiling_events=0"
+stats = "--printstat stat:llvm_lazy_layers --printstat stat:llvm_lazy_layers_jitted "
+groupsetup = ("-g 2 2 -layer alayer a -layer blayer b --layer clayer c --connect alayer f_out clayer f_in --connect alayer c_out clayer c_in --connect blayer out clayer unused")
+
+command += testshade("--options " + options + " " + stats + groupsetup)
+command += testshade("--options " + options + ",llvm_parallel_layers=4 " + stats + groupsetup)
@@ -0,0 +1,20 @@
+#!/usr/bin/env python
+
+# Copyright Contributors to the Open Shading Language project.
+# SPDX-License-Identifier: BSD-3-Clause
+# https://github.com/AcademySoftwareFoundation/OpenShadingLanguage
+
+# The layers-lazy group, with its layers optimized and compiled in modules
+# of their own on several threads and then linked: it must shade the same,
+# and llvm_parallel_groups tells that the group really was split.
+#
+# testshade asks for debugging symbols and profiling events, which keep
+# the module whole, so they are turned off.
+
+# The shaders of layers-lazy, compiled like local ones once copied here.
+for shader in [ "a.osl", "b.osl", "c.osl" ] :
+    shutil.copyfile (os.path.join (test_source_dir, "..", "layers-lazy", shader),
+                     shader)
+
+options = "llvm_parallel_layers=4,llvm_debug=0,llvm_debugging_symbols=0,llvm_profiling_events=0"
+command += testshade("-g 2 2 --options " + options + " --printstat stat:llvm_parallel_groups -layer alayer a -layer blayer b --layer clayer c --connect alayer f_out clayer f_in --connect alayer c_out clayer c_in --connect blayer out clayer unused")
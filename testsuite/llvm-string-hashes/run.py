@@ -0,0 +1,11 @@
+#!/usr/bin/env python
+
+# Copyright Contributors to the Open Shading Language project.
+# SPDX-License-Identifier: BSD-3-Clause
+# https://github.com/AcademySoftwareFoundation/OpenShadingLanguage
+
+# String constants referred to by address and by hash must give the same
+# strings, compare equal to the ones made at runtime, and hash the same.
+
+command += testshade("-param name world test")
+command += testshade("--options llvm_string_hashes=1 -param name world test")
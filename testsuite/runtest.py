@@ -66,7 +66,7 @@ else :
 
 refdir = "ref/"
 mytest = os.path.split(os.path.abspath(os.getcwd()))[-1]
-if str(mytest).endswith('.opt') or str(mytest).endswith('.optix') :
+if str(mytest).endswith('.opt') or str(mytest).endswith('.optix') or str(mytest).endswith('.artic') :
     mytest = mytest.split('.')[0]
 test_source_dir = os.getenv('OSL_TESTSUITE_SRC',
                             os.path.join(OSL_TESTSUITE_ROOT, mytest))
@@ -229,9 +229,44 @@ def testshade (args) :
         testshadename = os.environ['OSL_TESTSHADE_NAME'] + " "
     else :
         testshadename = osl_app("testshade")
+    if os.environ.__contains__('TESTSHADE_ARTIC') :
+        return testshade_artic (testshadename, args)
     return (testshadename + args + redirect + " ;\n")
 
 
+# The Artic std library, in the order the artic compiler needs it (the
+# same as testsuite/benchmark.py), and the closure entry points.
+artic_std_files = [ "intrinsics_thorin.art", "intrinsics_math.art",
+                    "anyosl_std.art", "anyosl_string.art", "anyosl_matrix.art",
+                    "anyosl_noise.art", "anyosl_spline.art", "anyosl_color.art",
+                    "anyosl_texture.art", "anyosl_renderer.art",
+                    "anyosl_integration_example.art",
+                    "anyosl_closure_exports.art" ]
+artic_groups = 0
+
+# In the .artic variant of a test, TESTSHADE_ARTIC names the artic
+# compiler, and every testshade run shades with the group compiled ahead
+# of time: a first run has the shading system write the Artic source of
+# the group ("artic_output"), which is built with the Artic std library
+# into a shared library (linked by TESTSHADE_ARTIC_CC) for the real run
+# to shade with (--artic). Only the real run appends to "out.txt".
+def testshade_artic (testshadename, args) :
+    global artic_groups
+    artic_groups += 1
+    group = "artic_group" + str(artic_groups)
+    log = " >> " + group + ".log 2>&1 "
+    srcs = [ os.path.join (OSL_SOURCE_DIR, f) for f in artic_std_files ]
+    cc = os.getenv ("TESTSHADE_ARTIC_CC", "clang")
+    lib = os.path.abspath ("lib" + group + ".so")
+    return ("OSL_OPTIONS=artic_output=1 " + testshadename
+            + "--groupname " + group + " " + args + log + " ;\n"
+            + os.environ['TESTSHADE_ARTIC'] + " " + " ".join(srcs) + " "
+            + group + ".art --emit-llvm -O3 -o " + group + log + " ;\n"
+            + cc + " -O3 -shared -fPIC " + group + ".ll -o " + lib + log + " ;\n"
+            + testshadename + "--groupname " + group + " --artic " + lib
+            + " " + args + redirect + " ;\n")
+
+
 # Construct a command that run testrender with the specified arguments,
 # appending output to the file "out.txt".
 def testrender (args) :